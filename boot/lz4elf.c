@@ -0,0 +1,198 @@
+/*
+ * Host tool that turns the kernel ELF into the compressed image the boot
+ * loader reads from disk.
+ *
+ * The ELF header and the program headers are copied, followed by the data of
+ * every loadable segment compressed as a single LZ4 block. The segments are
+ * flagged with ELF_PROG_FLAG_LZ4 and their p_offset and p_filesz are updated
+ * to describe the compressed data, while p_memsz still gives the size of the
+ * segment in memory. Section headers are not needed to boot and are dropped.
+ *
+ * Usage: lz4elf <kernel> <image>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/elf.h"
+
+#define HASH_BITS	12
+#define MIN_MATCH	4
+#define MAX_OFFSET	65535
+
+/* LZ4 requires the last match to start at least 12 bytes before the end of
+ * the block, and the last 5 bytes to be literals. */
+#define MF_LIMIT	12
+#define LAST_LITERALS	5
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "lz4elf: %s\n", msg);
+	exit(1);
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+static uint32_t hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/* Writes the part of a length that does not fit in the 4 bits of the token. */
+static uint8_t *put_len(uint8_t *dst, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*dst++ = 255;
+
+	*dst++ = len;
+	return dst;
+}
+
+/* Emits the sequence of literals src[0..nlit) followed by a match of mlen
+ * bytes at the given offset, or no match if mlen is 0. */
+static uint8_t *put_seq(uint8_t *dst, const uint8_t *src, size_t nlit,
+	size_t off, size_t mlen)
+{
+	uint8_t *token = dst++;
+
+	*token = (nlit < 15 ? nlit : 15) << 4;
+
+	if (nlit >= 15)
+		dst = put_len(dst, nlit - 15);
+
+	memcpy(dst, src, nlit);
+	dst += nlit;
+
+	if (mlen == 0)
+		return dst;
+
+	*dst++ = off;
+	*dst++ = off >> 8;
+	mlen -= MIN_MATCH;
+	*token |= mlen < 15 ? mlen : 15;
+
+	if (mlen >= 15)
+		dst = put_len(dst, mlen - 15);
+
+	return dst;
+}
+
+/* Compresses n bytes at src into dst, which must have room for at least
+ * n + n / 255 + 16 bytes, using a greedy single-probe hash search. Returns the
+ * size of the compressed block. */
+static size_t lz4_compress(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	static uint32_t table[1 << HASH_BITS];
+	uint8_t *d = dst;
+	size_t i = 0, anchor = 0, ref, len, h;
+
+	memset(table, 0, sizeof table);
+
+	/* Positions are stored plus one, such that zero means empty. */
+	while (n >= MF_LIMIT && i + MF_LIMIT <= n) {
+		h = hash(read32(src + i));
+		ref = table[h];
+		table[h] = i + 1;
+
+		if (!ref-- || i - ref > MAX_OFFSET ||
+		    read32(src + ref) != read32(src + i)) {
+			++i;
+			continue;
+		}
+
+		len = MIN_MATCH;
+
+		while (i + len < n - LAST_LITERALS && src[ref + len] == src[i + len])
+			++len;
+
+		d = put_seq(d, src + anchor, i - anchor, i - ref, len);
+		i += len;
+		anchor = i;
+	}
+
+	d = put_seq(d, src + anchor, n - anchor, 0, 0);
+	return d - dst;
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in, *out;
+	uint8_t *elf, *buf;
+	size_t size, off, n;
+	struct elf *hdr;
+	struct elf_proghdr *ph;
+	uint16_t i;
+
+	if (argc != 3)
+		die("usage: lz4elf <kernel> <image>");
+
+	if (!(in = fopen(argv[1], "rb")))
+		die("cannot open the kernel");
+
+	fseek(in, 0, SEEK_END);
+	size = ftell(in);
+	rewind(in);
+
+	if (!(elf = malloc(size)) || fread(elf, 1, size, in) != size)
+		die("cannot read the kernel");
+
+	fclose(in);
+
+	hdr = (struct elf *)elf;
+
+	if (size < sizeof *hdr || hdr->e_magic != ELF_MAGIC ||
+	    hdr->e_phentsize != sizeof *ph ||
+	    hdr->e_phoff + hdr->e_phnum * sizeof *ph > size)
+		die("not a valid ELF");
+
+	if (!(buf = malloc(size + size / 255 + 16)))
+		die("out of memory");
+
+	if (!(out = fopen(argv[2], "wb")))
+		die("cannot create the image");
+
+	/* The headers come first, the compressed segments follow them. */
+	off = hdr->e_phoff + hdr->e_phnum * sizeof *ph;
+	fseek(out, off, SEEK_SET);
+
+	for (i = 0; i < hdr->e_phnum; ++i) {
+		ph = (struct elf_proghdr *)(elf + hdr->e_phoff) + i;
+
+		if (ph->p_type != ELF_PROG_LOAD || ph->p_filesz == 0)
+			continue;
+
+		if (ph->p_offset + ph->p_filesz > size)
+			die("segment out of bounds");
+
+		n = lz4_compress(buf, elf + ph->p_offset, ph->p_filesz);
+
+		if (fwrite(buf, 1, n, out) != n)
+			die("cannot write the image");
+
+		ph->p_flags |= ELF_PROG_FLAG_LZ4;
+		ph->p_offset = off;
+		ph->p_filesz = n;
+		off += n;
+	}
+
+	hdr->e_shoff = 0;
+	hdr->e_shnum = 0;
+	hdr->e_shstrndx = 0;
+
+	rewind(out);
+
+	if (fwrite(elf, 1, hdr->e_phoff + hdr->e_phnum * sizeof *ph, out) !=
+	    hdr->e_phoff + hdr->e_phnum * sizeof *ph)
+		die("cannot write the image");
+
+	fclose(out);
+	return 0;
+}
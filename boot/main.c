@@ -34,15 +34,25 @@
 #define SECTSIZE	512
 #define ELFHDR	  ((struct elf *) 0x10000) /* scratch space */
 
-void readsect(void*, uint32_t);
+/* The BIOS can only read to memory below 1M, so sectors are read into a
+ * bounce buffer between the memory map at 0x500 and the stack below 0x7C00
+ * first, as many as fit at a time. */
+#define BOUNCE_BUF	((void *) 0x1000)
+#define BOUNCE_SECTS	32
+
+void readsect(void*, uint32_t, uint32_t);
 void readseg(uint32_t, uint32_t, uint32_t);
+void *memset(void *, int, size_t);
+uint32_t lz4_decompress(uint8_t *, const uint8_t *, uint32_t);
 
 extern void puts32(const char *s);
-extern void read_sector32(void *, uint32_t);
+extern void read_sector32(void *, uint32_t, uint32_t);
 
 void bootmain(struct boot_info *boot_info)
 {
 	struct elf_proghdr *ph, *eph;
+	uint8_t *pa, *src;
+	uint32_t filesz;
 
 	boot_info->elf_hdr = ELFHDR;
 
@@ -58,10 +68,26 @@ void bootmain(struct boot_info *boot_info)
 	/* load each program segment (ignores ph flags) */
 	ph = (struct elf_proghdr *) ((uint8_t *) ELFHDR + ELFHDR->e_phoff);
 	eph = ph + ELFHDR->e_phnum;
-	for (; ph < eph; ph++)
+	for (; ph < eph; ph++) {
 		/* p_pa is the load address of this segment (as well as the physical
 		 * address) */
-		readseg(ph->p_pa, ph->p_memsz, ph->p_offset);
+		pa = (uint8_t *) (uint32_t) ph->p_pa;
+		filesz = ph->p_filesz;
+
+		/* a compressed segment is read just past where it goes in memory,
+		 * keeping the sector offset, and decompressed into place */
+		if (ph->p_flags & ELF_PROG_FLAG_LZ4) {
+			src = (uint8_t *) (((uint32_t) pa + (uint32_t) ph->p_memsz +
+				SECTSIZE - 1) & ~(SECTSIZE - 1)) + ph->p_offset % SECTSIZE;
+			readseg((uint32_t) src, filesz, ph->p_offset);
+			filesz = lz4_decompress(pa, src, filesz);
+		} else {
+			readseg((uint32_t) pa, filesz, ph->p_offset);
+		}
+
+		/* the rest of the segment (e.g. .bss) is not on disk */
+		memset(pa + filesz, 0, ph->p_memsz - filesz);
+	}
 
 	/* call the entry point from the ELF header
 	 * note: does not return! */
@@ -87,6 +113,66 @@ void *memcpy(void *dst, const void *src, size_t n)
 	return dst;
 }
 
+void *memset(void *dst, int c, size_t n)
+{
+	char *d = dst;
+
+	while (n--) {
+		*d++ = c;
+	}
+
+	return dst;
+}
+
+/* Reads a length that does not fit in the 4 bits of an LZ4 token. */
+static uint32_t lz4_len(const uint8_t **src, uint32_t len)
+{
+	uint8_t b;
+
+	if (len == 15) {
+		do {
+			b = *(*src)++;
+			len += b;
+		} while (b == 255);
+	}
+
+	return len;
+}
+
+/* Decompresses the LZ4 block of n bytes at src to dst. Returns the number of
+ * bytes written. */
+uint32_t lz4_decompress(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+	const uint8_t *end = src + n, *match;
+	uint8_t *d = dst;
+	uint32_t len;
+	uint8_t token;
+
+	while (src < end) {
+		token = *src++;
+
+		/* a run of literals */
+		len = lz4_len(&src, token >> 4);
+		memcpy(d, src, len);
+		d += len;
+		src += len;
+
+		/* the last sequence has no match */
+		if (src >= end)
+			break;
+
+		/* a match, which may overlap with the bytes it produces: this is
+		 * fine as memcpy() above copies forward one byte at a time */
+		match = d - (src[0] | src[1] << 8);
+		src += 2;
+		len = lz4_len(&src, token & 0xf) + 4;
+		memcpy(d, match, len);
+		d += len;
+	}
+
+	return d - dst;
+}
+
 /*
  * Read 'count' bytes at 'offset' from kernel into physical address 'pa'.
  * Might copy more than asked.
@@ -94,7 +180,7 @@ void *memcpy(void *dst, const void *src, size_t n)
 void readseg(uint32_t pa, uint32_t count, uint32_t offset)
 {
 	extern char stage2[], stage2_end[];
-	uint32_t end_pa;
+	uint32_t end_pa, nsects;
 
 	end_pa = pa + count;
 
@@ -106,22 +192,28 @@ void readseg(uint32_t pa, uint32_t count, uint32_t offset)
 	offset += 1;
 	offset += (stage2_end - stage2 + SECTSIZE - 1) / SECTSIZE;
 
-	/* If this is too slow, we could read lots of sectors at a time. We'd write
-	 * more to memory than asked, but it doesn't matter -- we load in increasing
-	 * order. */
+	/* We read as many sectors at a time as the bounce buffer holds. We may
+	 * write more to memory than asked, up to the end of the last sector, but it
+	 * doesn't matter -- we load in increasing order. */
 	while (pa < end_pa) {
+		nsects = (end_pa - pa + SECTSIZE - 1) / SECTSIZE;
+
+		if (nsects > BOUNCE_SECTS)
+			nsects = BOUNCE_SECTS;
+
 		/* Since we haven't enabled paging yet and we're using an identity
 		 * segment mapping (see boot.S), we can use physical addresses directly.
 		 * This won't be the case once OpenLSD enables the MMU. */
-		readsect((uint8_t *) pa, offset);
-		pa += SECTSIZE;
-		offset++;
+		readsect((uint8_t *) pa, offset, nsects);
+		pa += nsects * SECTSIZE;
+		offset += nsects;
 	}
 }
 
-void readsect(void *dst, uint32_t offset)
+/* Reads nsects sectors starting at sector offset to dst. */
+void readsect(void *dst, uint32_t offset, uint32_t nsects)
 {
-	read_sector32((void *)0x1000, offset);
-	memcpy(dst, (void *)0x1000, SECTSIZE);
+	read_sector32(BOUNCE_BUF, offset, nsects);
+	memcpy(dst, BOUNCE_BUF, nsects * SECTSIZE);
 }
 
@@ -0,0 +1,265 @@
+/*
+ * Benchmarks for the page allocator in ../kernel/mem, which runs on the host
+ * on top of shim.c.
+ *
+ * Every workload runs in its own child process on a fresh allocator. After
+ * filling half of the memory, it randomly allocates or frees a chunk on every
+ * operation while keeping at most 7/8 of the memory allocated:
+ *
+ *   random  chunks of random orders, each order half as likely as the one
+ *           below it, freed in random order
+ *   lifo    single pages, freed in the reverse order of their allocation
+ *   fifo    single pages, freed in the order of their allocation
+ *   huge    single pages and one 2M page out of 16, freed in random order
+ *
+ * Ten times per run the time per operation over the last interval is
+ * reported, together with the free memory, the largest free order and the
+ * fragmentation index of 2M chunks (see buddy_fragmentation_index(), -1 when
+ * a 2M chunk is free), which shows how the free lists degrade over time.
+ *
+ * Usage: buddy_bench [-n ops] [-m MiB] [-w workload] [-p] [-t threshold]
+ *
+ * -p disables the per-CPU page caches and -t sets the lazy merge threshold,
+ * 0 (the default) merging the chunks eagerly.
+ */
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shim.h"
+
+#define SEED 1337
+#define PAGE_SIZE 4096
+#define NSAMPLES 10
+
+enum { FREE_RANDOM, FREE_LIFO, FREE_FIFO };
+
+struct workload {
+    const char *name;
+    int free_order;
+    /* Returns the order of the next allocation and sets its shim flags. */
+    size_t (*next)(uint64_t r, int *flags);
+};
+
+struct chunk {
+    struct page_info *page;
+    size_t order;
+};
+
+static uint64_t rand_state;
+static size_t max_order;
+
+static uint64_t xorshift64(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static size_t next_random(uint64_t r, int *flags) {
+    *flags = 0;
+    return __builtin_ctzll(r | 1ull << max_order);
+}
+
+static size_t next_page(uint64_t r, int *flags) {
+    *flags = 0;
+    return 0;
+}
+
+static size_t next_huge(uint64_t r, int *flags) {
+    if (r % 16 == 0) {
+        *flags = SHIM_HUGE;
+        return max_order;
+    }
+
+    *flags = 0;
+    return 0;
+}
+
+static const struct workload workloads[] = {
+    { "random", FREE_RANDOM, next_random },
+    { "lifo", FREE_LIFO, next_page },
+    { "fifo", FREE_FIFO, next_page },
+    { "huge", FREE_RANDOM, next_huge },
+};
+
+/*
+ * The chunks that are allocated sit in a ring, from the oldest at head to the
+ * most recent at head + live - 1, such that either end can be freed.
+ */
+struct ring {
+    struct chunk *chunks;
+    size_t cap, head, live, used;
+};
+
+static struct chunk *ring_at(struct ring *ring, size_t i) {
+    return &ring->chunks[(ring->head + i) % ring->cap];
+}
+
+static int ring_alloc(struct ring *ring, const struct workload *w) {
+    int flags;
+    size_t order = w->next(xorshift64() >> 1, &flags);
+    struct page_info *page = shim_alloc(order, flags);
+
+    if (!page)
+        return -1;
+
+    *ring_at(ring, ring->live++) = (struct chunk){ page, order };
+    ring->used += (size_t)1 << order;
+    return 0;
+}
+
+static void ring_free(struct ring *ring, const struct workload *w) {
+    struct chunk *last = ring_at(ring, ring->live - 1), *victim, tmp;
+
+    switch (w->free_order) {
+    case FREE_RANDOM:
+        victim = ring_at(ring, xorshift64() % ring->live);
+        tmp = *victim;
+        *victim = *last;
+        *last = tmp;
+        /* fall through */
+    case FREE_LIFO:
+        victim = last;
+        break;
+    default:
+        victim = ring_at(ring, 0);
+        ring->head = (ring->head + 1) % ring->cap;
+        break;
+    }
+
+    shim_free(victim->page);
+    ring->used -= (size_t)1 << victim->order;
+    --ring->live;
+}
+
+static void run(const struct workload *w, size_t npages, size_t ops) {
+    struct ring ring = { .cap = npages };
+    size_t budget = npages / 8 * 7, failed = 0, i, j;
+    uint64_t start, ns, total = 0;
+
+    ring.chunks = calloc(ring.cap, sizeof *ring.chunks);
+    if (!ring.chunks) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    while (ring.used < npages / 2 && ring_alloc(&ring, w) == 0)
+        ;
+
+    for (i = 0; i < NSAMPLES; i++) {
+        start = now_ns();
+
+        for (j = 0; j < ops / NSAMPLES; j++) {
+            if (ring.live > 0 &&
+                ((xorshift64() & 1) || ring.used >= budget))
+                ring_free(&ring, w);
+            else if (ring_alloc(&ring, w) < 0)
+                failed++;
+        }
+
+        ns = now_ns() - start;
+        total += ns;
+
+        printf("%-8s %10zu %8.1f %9zu %8zd %8.3f %8zu\n", w->name,
+               (i + 1) * (ops / NSAMPLES), (double)ns / (ops / NSAMPLES),
+               shim_free_pages() * PAGE_SIZE >> 20,
+               (ssize_t)shim_largest_order(),
+               shim_fragmentation(max_order) / 1000.0, failed);
+    }
+
+    printf("%-8s %10s %8.1f\n", w->name, "total",
+           (double)total / (ops / NSAMPLES * NSAMPLES));
+
+    while (ring.live > 0)
+        ring_free(&ring, w);
+    free(ring.chunks);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: buddy_bench [-n ops] [-m MiB] [-w workload] "
+            "[-p] [-t threshold]\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    size_t ops = 4000000, mib = 256, threshold = 0;
+    const char *only = NULL;
+    int pcp = 1, opt;
+
+    while ((opt = getopt(argc, argv, "n:m:w:pt:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ops = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            mib = strtoull(optarg, NULL, 0);
+            break;
+        case 'w':
+            only = optarg;
+            break;
+        case 'p':
+            pcp = 0;
+            break;
+        case 't':
+            threshold = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage();
+        }
+    }
+
+    if (ops < NSAMPLES || mib < 4)
+        usage();
+
+    printf("%zu MiB, per-CPU caches %s, merge threshold %zu\n", mib,
+           pcp ? "on" : "off", threshold);
+    printf("%-8s %10s %8s %9s %8s %8s %8s\n", "workload", "ops", "ns/op",
+           "free MiB", "largest", "frag 2M", "failed");
+
+    for (size_t i = 0; i < sizeof workloads / sizeof *workloads; i++) {
+        pid_t pid;
+        int status;
+
+        if (only && strcmp(only, workloads[i].name) != 0)
+            continue;
+
+        fflush(stdout);
+        pid = fork();
+
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+
+        if (pid == 0) {
+            rand_state = SEED;
+            shim_init((mib << 20) / PAGE_SIZE, 1);
+            shim_tune(pcp, threshold);
+            max_order = shim_max_order();
+            run(&workloads[i], (mib << 20) / PAGE_SIZE, ops);
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
+        }
+
+        waitpid(pid, &status, 0);
+        if (WIFSIGNALED(status))
+            printf("%-8s crashed (signal %d)\n", workloads[i].name,
+                   WTERMSIG(status));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/*
+ * Runs the memory checks of ../kernel/tests/lab1.c against the allocator set
+ * up by shim.c, in the order lab1_check_mem() runs them. The checks that need
+ * the boot information of a real machine are left out.
+ *
+ * Usage: buddy_check [pages] [nodes]
+ */
+
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel/mem.h>
+
+#include "shim.h"
+
+void lab1_check_deferred_init(void);
+void lab1_check_free_list_avail(void);
+void lab1_check_free_list_order(void);
+void lab1_check_buddy_consistency(void);
+void lab1_check_split_and_merge(int flags);
+void lab1_check_pcp(void);
+void lab1_check_bulk(void);
+void lab1_check_lazy_merge(void);
+void lab1_check_zero_pool(void);
+void lab1_check_slab(void);
+void lab1_check_arena(void);
+void lab1_check_buddy_index(void);
+void lab1_check_zones(void);
+void lab1_check_numa(void);
+void lab1_check_huge_pool(void);
+void lab1_check_migrate_types(void);
+void lab1_check_spinlock(void);
+void lab1_check_mem_stats(void);
+void lab1_check_trace(void);
+void lab1_check_btree(void);
+void lab1_check_rb_pool(void);
+void lab1_check_rb_bulk(void);
+void lab1_check_rb_seq(void);
+void lab1_check_rb_hints(void);
+void lab1_check_rb_augment(void);
+void lab1_check_interval_tree(void);
+void lab1_check_os_tree(void);
+void lab1_check_timerq(void);
+void lab1_check_bench(void);
+
+int main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? strtol(argv[1], NULL, 0) : 2048;
+	size_t nnodes = argc > 2 ? strtol(argv[2], NULL, 0) : 1;
+
+	shim_init(n, nnodes);
+
+	lab1_check_deferred_init();
+	lab1_check_free_list_avail();
+	lab1_check_free_list_order();
+	lab1_check_buddy_consistency();
+	lab1_check_split_and_merge(0);
+	lab1_check_split_and_merge(ALLOC_HUGE);
+	lab1_check_pcp();
+	lab1_check_bulk();
+	lab1_check_lazy_merge();
+	lab1_check_zero_pool();
+	lab1_check_slab();
+	lab1_check_arena();
+	lab1_check_buddy_index();
+	lab1_check_zones();
+	lab1_check_numa();
+	lab1_check_huge_pool();
+	lab1_check_migrate_types();
+	lab1_check_spinlock();
+	lab1_check_mem_stats();
+	lab1_check_trace();
+	lab1_check_btree();
+	lab1_check_rb_pool();
+	lab1_check_rb_bulk();
+	lab1_check_rb_seq();
+	lab1_check_rb_hints();
+	lab1_check_rb_augment();
+	lab1_check_interval_tree();
+	lab1_check_os_tree();
+	lab1_check_timerq();
+	lab1_check_bench();
+	lab1_check_buddy_consistency();
+
+	return 0;
+}
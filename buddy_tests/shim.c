@@ -0,0 +1,224 @@
+/*
+ * Runs the page allocator of ../kernel/mem on the host. The physical memory
+ * is an anonymous mapping at KERNEL_VMA, such that KADDR() and PADDR() work
+ * unchanged, and the struct page_info array and the buddy bitmap come from
+ * mmap() rather than boot_alloc(). The console goes to the standard output.
+ *
+ * There is no firmware either: acpi_find_table() hands out an SRAT that splits
+ * the memory evenly over the number of nodes passed to shim_init(), such that
+ * numa_init() sets the nodes up like it would on real hardware.
+ */
+
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <kernel/acpi.h>
+#include <kernel/mem.h>
+
+#include "shim.h"
+
+/* From the host C library, which the kernel headers know nothing about. */
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define MAP_PRIVATE 0x02
+#define MAP_FIXED 0x10
+#define MAP_ANONYMOUS 0x20
+#define MAP_NORESERVE 0x4000
+#define MAP_FAILED ((void *)-1)
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, long off);
+long write(int fd, const void *buf, size_t n);
+void abort(void) __attribute__((noreturn));
+
+static struct {
+	struct acpi_srat srat;
+	struct acpi_srat_mem mem[MAX_NUMNODES];
+} __attribute__((packed)) shim_srat;
+
+static size_t shim_nnodes;
+
+static void *shim_mmap(void *addr, size_t len, int flags)
+{
+	void *p = mmap(addr, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | flags, -1, 0);
+
+	if (p == MAP_FAILED || (addr && p != addr))
+		panic("shim: cannot map %u bytes at %p", len, addr);
+
+	return p;
+}
+
+void cputs(const char *str, size_t len)
+{
+	write(1, str, len);
+}
+
+void _panic(const char *file, int line, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	cprintf("kernel panic at %s:%d: ", file, line);
+	vcprintf(fmt, ap);
+	cprintf("\n");
+	va_end(ap);
+
+	abort();
+}
+
+void _warn(const char *file, int line, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	cprintf("kernel warning at %s:%d: ", file, line);
+	vcprintf(fmt, ap);
+	cprintf("\n");
+	va_end(ap);
+}
+
+/* Builds an SRAT with one memory affinity entry per node. The nodes are sized
+ * in whole 2M chunks, as numa_init() rounds their boundaries down to those,
+ * and the last node takes what is left.
+ */
+void *acpi_find_table(const char *signature)
+{
+	physaddr_t size, chunk = (physaddr_t)PAGE_SIZE << BUDDY_2M_PAGE;
+	size_t i;
+
+	if (strcmp(signature, "SRAT") != 0 || shim_nnodes < 2)
+		return NULL;
+
+	size = ROUNDDOWN(npages * PAGE_SIZE / shim_nnodes, chunk);
+	memset(&shim_srat, 0, sizeof shim_srat);
+	memcpy(shim_srat.srat.header.signature, "SRAT", 4);
+	shim_srat.srat.header.length = sizeof shim_srat.srat +
+		shim_nnodes * sizeof shim_srat.mem[0];
+
+	for (i = 0; i < shim_nnodes; ++i) {
+		shim_srat.mem[i].type = SRAT_MEM_AFFINITY;
+		shim_srat.mem[i].length = sizeof shim_srat.mem[i];
+		shim_srat.mem[i].domain = i;
+		shim_srat.mem[i].base = i * size;
+		shim_srat.mem[i].len = i + 1 < shim_nnodes ? size :
+			npages * PAGE_SIZE - i * size;
+		shim_srat.mem[i].flags = SRAT_ENABLED;
+	}
+
+	return &shim_srat;
+}
+
+void acpi_unmap(void)
+{
+}
+
+void *boot_alloc(uint32_t n)
+{
+	panic("shim: boot_alloc() is not available");
+}
+
+size_t page_init_deferred(size_t n)
+{
+	return 0;
+}
+
+/* Sets up the allocator with npages of memory split over nnodes nodes, in the
+ * order mem_init() does. The first page stays reserved, as in the kernel.
+ */
+void shim_init(size_t n, size_t nnodes)
+{
+	size_t i;
+
+	if (nnodes == 0 || nnodes > MAX_NUMNODES || n < 2)
+		panic("shim: cannot set up %u pages over %u nodes", n, nnodes);
+
+	shim_mmap((void *)KERNEL_VMA, n * PAGE_SIZE, MAP_FIXED);
+	npages = n;
+	pages = shim_mmap(NULL, npages * sizeof *pages, 0);
+	shim_nnodes = nnodes;
+	numa_init();
+	buddy_map = shim_mmap(NULL, buddy_map_size(), 0);
+	buddy_init();
+
+	for (i = 0; i < npages; ++i) {
+		list_init(&pages[i].pp_node);
+		pages[i].pp_zone = buddy_zone_of(page2pa(pages + i));
+	}
+
+	page_pcp_init();
+	page_zero_init();
+	kmem_init();
+
+	buddy_free_range(PAGE_SIZE, npages * PAGE_SIZE);
+	buddy_zone_default_reserves();
+	page_huge_init();
+}
+
+/* Enables or disables the per-CPU caches, and sets the number of free chunks
+ * an order may accumulate before they get merged (zero to merge eagerly).
+ */
+void shim_tune(int pcp, size_t merge_threshold)
+{
+	page_pcp_enable(pcp);
+	buddy_set_merge_threshold(merge_threshold);
+}
+
+size_t shim_max_order(void)
+{
+	return BUDDY_MAX_ORDER - 1;
+}
+
+/* Single pages and SHIM_HUGE chunks go through page_alloc(), like they do in
+ * the kernel, whereas the other orders can only be had from the buddy
+ * allocator itself.
+ */
+struct page_info *shim_alloc(size_t order, int flags)
+{
+	int alloc_flags = (flags & SHIM_MOVABLE) ? ALLOC_MOVABLE : 0;
+
+	if (flags & SHIM_HUGE)
+		return page_alloc(alloc_flags | ALLOC_HUGE);
+
+	if (order == BUDDY_4K_PAGE)
+		return page_alloc(alloc_flags);
+
+	return buddy_find_flags(order, alloc_flags);
+}
+
+void shim_free(struct page_info *page)
+{
+	page_free(page);
+}
+
+size_t shim_free_pages(void)
+{
+	return count_total_free_pages();
+}
+
+/* Returns the order of the largest free chunk, or -1 if there is none. */
+size_t shim_largest_order(void)
+{
+	size_t order;
+
+	for (order = BUDDY_MAX_ORDER; order > 0; --order) {
+		if (count_free_pages(order - 1))
+			return order - 1;
+	}
+
+	return (size_t)-1;
+}
+
+int shim_fragmentation(size_t order)
+{
+	return buddy_fragmentation_index(order);
+}
+
+void shim_show(void)
+{
+	show_buddy_info();
+	show_mem_stats();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * Interface between the benchmark, which is built against the host libc, and
+ * the page allocator, which is built against the kernel headers by shim.c.
+ * Only plain C types cross it, and size_t has to be defined before this file
+ * is included.
+ */
+struct page_info;
+
+enum {
+	SHIM_HUGE = 1 << 0,
+	SHIM_MOVABLE = 1 << 1,
+};
+
+void shim_init(size_t npages, size_t nnodes);
+void shim_tune(int pcp, size_t merge_threshold);
+size_t shim_max_order(void);
+struct page_info *shim_alloc(size_t order, int flags);
+void shim_free(struct page_info *page);
+size_t shim_free_pages(void);
+size_t shim_largest_order(void);
+int shim_fragmentation(size_t order);
+void shim_show(void);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <types.h>
+
+/*
+ * B+-tree mapping 64-bit keys to non-NULL pointers. Unlike the red-black tree,
+ * where every level of a lookup is a dependent load of a node that sits in a
+ * cache line of its own, a node here packs BTREE_ORDER keys contiguously into
+ * BTREE_NODE_SIZE bytes, such that a lookup in a tree of n keys touches about
+ * log_16(n) nodes rather than log_2(n).
+ *
+ * The values are only kept in the leaves, which are linked from left to right
+ * for range scans. Inner nodes hold up to BTREE_ORDER separator keys and one
+ * more child, where all the keys in child[i] are smaller than keys[i] and all
+ * the keys in child[i + 1] are not. Except for the root, every node is at least
+ * half full.
+ *
+ * In the kernel the nodes come from a slab cache, on the host from the C
+ * library.
+ */
+#define BTREE_NODE_SIZE 256
+#define BTREE_ORDER 15
+#define BTREE_MIN_KEYS (BTREE_ORDER / 2)
+
+struct btree_node {
+	uint32_t nkeys;
+	uint32_t leaf;
+	uint64_t keys[BTREE_ORDER];
+	union {
+		/* Leaves: the values, followed by the next leaf. */
+		void *vals[BTREE_ORDER];
+		struct btree_node *child[BTREE_ORDER + 1];
+	};
+};
+
+/* Leaves keep the link to the next leaf in the slot of the last child. */
+#define btree_leaf_next(leaf) ((leaf)->child[BTREE_ORDER])
+
+struct btree {
+	struct btree_node *root;
+	size_t height;
+	size_t count;
+};
+
+/* Position in a range scan, see btree_iter_seek(). */
+struct btree_iter {
+	struct btree_node *leaf;
+	size_t pos;
+};
+
+static inline void btree_init(struct btree *tree)
+{
+	tree->root = NULL;
+	tree->height = 0;
+	tree->count = 0;
+}
+
+void *btree_find(struct btree *tree, uint64_t key);
+int btree_insert(struct btree *tree, uint64_t key, void *val);
+void *btree_remove(struct btree *tree, uint64_t key);
+int btree_build_sorted(struct btree *tree, const uint64_t *keys,
+	void * const *vals, size_t n);
+void btree_destroy(struct btree *tree);
+void btree_iter_seek(struct btree_iter *iter, struct btree *tree,
+	uint64_t key);
+int btree_iter_next(struct btree_iter *iter, uint64_t *key, void **val);
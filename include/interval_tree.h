@@ -0,0 +1,50 @@
+#pragma once
+
+#include <types.h>
+#include <rbtree.h>
+
+/*
+ * Interval tree on top of the augmented red-black tree. The nodes are ordered
+ * by their start address and every node tracks the largest end address in its
+ * subtree, such that the intervals overlapping [start, end) can be found in
+ * O(log n + k) for k matches.
+ *
+ * Intervals are half-open: a node covers the addresses start up to, but
+ * excluding, end.
+ */
+struct interval_node {
+	struct rb_node node;
+	uint64_t start;
+	uint64_t end;
+	uint64_t max_end;
+};
+
+struct interval_tree {
+	struct rb_tree tree;
+};
+
+static inline void interval_tree_init(struct interval_tree *itree)
+{
+	rb_init(&itree->tree);
+}
+
+void interval_tree_insert(struct interval_tree *itree,
+	struct interval_node *inode);
+void interval_tree_remove(struct interval_tree *itree,
+	struct interval_node *inode);
+struct interval_node *interval_tree_first(struct interval_tree *itree,
+	uint64_t start, uint64_t end);
+struct interval_node *interval_tree_next(struct interval_node *inode,
+	uint64_t start, uint64_t end);
+
+/* Returns the interval with the lowest start address that covers addr. */
+static inline struct interval_node *interval_tree_lookup(
+	struct interval_tree *itree, uint64_t addr)
+{
+	return interval_tree_first(itree, addr, addr + 1);
+}
+
+/* Iterates over all the intervals overlapping [start, end) in order. */
+#define interval_tree_foreach(itree, inode, start, end) \
+	for (inode = interval_tree_first(itree, start, end); inode; \
+		inode = interval_tree_next(inode, start, end))
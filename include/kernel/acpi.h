@@ -0,0 +1,96 @@
+#pragma once
+
+#include <types.h>
+
+/*
+ * Just enough of ACPI to look up the static tables the firmware provides.
+ * The tables usually live at the top of physical memory, which the direct map
+ * of the boot stub may not reach, in which case they are read through a
+ * temporary window instead (see acpi_find_table()).
+ */
+#define ACPI_RSDP_SIG "RSD PTR "
+
+/* Root System Description Pointer, found in the BIOS areas. */
+struct acpi_rsdp {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_addr;
+
+	/* ACPI 2.0 and later. */
+	uint32_t length;
+	uint64_t xsdt_addr;
+	uint8_t ext_checksum;
+	uint8_t reserved[3];
+} __attribute__((packed));
+
+/* The header every system description table starts with. */
+struct acpi_header {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed));
+
+/* System Resource Affinity Table, followed by a list of entries. */
+struct acpi_srat {
+	struct acpi_header header;
+	uint32_t reserved1;
+	uint64_t reserved2;
+} __attribute__((packed));
+
+enum {
+	SRAT_CPU_AFFINITY = 0,
+	SRAT_MEM_AFFINITY = 1,
+	SRAT_X2APIC_AFFINITY = 2,
+};
+
+#define SRAT_ENABLED (1 << 0)
+
+struct acpi_srat_entry {
+	uint8_t type;
+	uint8_t length;
+} __attribute__((packed));
+
+struct acpi_srat_cpu {
+	uint8_t type;
+	uint8_t length;
+	uint8_t domain_lo;
+	uint8_t apic_id;
+	uint32_t flags;
+	uint8_t sapic_eid;
+	uint8_t domain_hi[3];
+	uint32_t clock_domain;
+} __attribute__((packed));
+
+struct acpi_srat_mem {
+	uint8_t type;
+	uint8_t length;
+	uint32_t domain;
+	uint16_t reserved1;
+	uint64_t base;
+	uint64_t len;
+	uint32_t reserved2;
+	uint32_t flags;
+	uint64_t reserved3;
+} __attribute__((packed));
+
+struct acpi_srat_x2apic {
+	uint8_t type;
+	uint8_t length;
+	uint16_t reserved1;
+	uint32_t domain;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved2;
+} __attribute__((packed));
+
+void *acpi_find_table(const char *signature);
+void acpi_unmap(void);
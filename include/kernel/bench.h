@@ -0,0 +1,34 @@
+#pragma once
+
+#include <types.h>
+
+/* The largest number of timed runs of a benchmark. */
+#define BENCH_RUNS 256
+
+/*
+ * A micro-benchmark. setup() prepares the runs and returns how many of them
+ * there should be, at most BENCH_RUNS, or 0 to skip the benchmark. Then, for
+ * every run i in order, body(arg, i) is timed on its own, after which
+ * teardown() cleans up. setup() and teardown() may be NULL, in which case
+ * there are BENCH_RUNS runs.
+ */
+struct bench {
+	const char *name;
+	size_t (*setup)(uintptr_t arg);
+	void (*body)(uintptr_t arg, size_t i);
+	void (*teardown)(uintptr_t arg);
+	uintptr_t arg;
+};
+
+/* The number of runs and the distribution of their cycles, from which the
+ * cost of reading the TSC has been subtracted.
+ */
+struct bench_result {
+	size_t runs;
+	uint64_t min;
+	uint64_t median;
+	uint64_t p99;
+};
+
+int bench_run(const struct bench *bench, struct bench_result *result);
+size_t bench_run_all(const char *prefix);
@@ -17,6 +17,7 @@
 
 void cons_init(void);
 int cons_getc(void);
+void cons_flush(void);
 
 void kbd_intr(void);    /* irq 1 */
 void serial_intr(void); /* irq 4 */
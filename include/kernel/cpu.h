@@ -0,0 +1,15 @@
+#pragma once
+
+#include <types.h>
+
+/* The maximum number of CPUs supported by the kernel. OpenLSD does not bring
+ * up the application processors yet, so every per-CPU structure currently has
+ * a single instance.
+ */
+#define NCPUS 1
+
+/* Returns the index of the CPU we are running on. */
+static inline size_t cpu_id(void)
+{
+	return 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <x86-64/idt.h>
+
+void idt_init(void);
+int idt_ready(void);
+void int_handler(struct int_frame *frame);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <types.h>
+
+/*
+ * Local APIC in x2APIC mode, where every register is an MSR at
+ * X2APIC_MSR_BASE plus the xAPIC register offset divided by 16, rather than
+ * memory-mapped. We do not map the xAPIC page, so CPUs without x2APIC keep
+ * using the 8259 PIC alone.
+ *
+ * The 8259 stays the source of the device IRQs for now: LINT0 is wired up as
+ * ExtINT (virtual wire mode), such that its vectors are delivered through
+ * the local APIC as before and are still acknowledged with pic_eoi(). Only
+ * the interrupts that originate in the local APIC itself, i.e. its timer,
+ * its error interrupt and IPIs, are acknowledged with lapic_eoi().
+ */
+#define X2APIC_MSR_BASE   0x800
+
+/* Register offsets, in xAPIC units. */
+#define LAPIC_ID          0x020
+#define LAPIC_VERSION     0x030
+#define LAPIC_TPR         0x080
+#define LAPIC_EOI         0x0b0
+#define LAPIC_SVR         0x0f0
+#define LAPIC_ESR         0x280
+#define LAPIC_ICR         0x300
+#define LAPIC_LVT_TIMER   0x320
+#define LAPIC_LVT_LINT0   0x350
+#define LAPIC_LVT_LINT1   0x360
+#define LAPIC_LVT_ERROR   0x370
+#define LAPIC_TIMER_INIT  0x380
+#define LAPIC_TIMER_CUR   0x390
+#define LAPIC_TIMER_DIV   0x3e0
+
+#define APIC_BASE_EXTD    (1 << 10)
+#define APIC_BASE_EN      (1 << 11)
+
+#define APIC_SVR_ENABLE   (1 << 8)
+
+#define APIC_LVT_NMI      (4 << 8)
+#define APIC_LVT_EXTINT   (7 << 8)
+#define APIC_LVT_LEVEL    (1 << 15)
+#define APIC_LVT_MASKED   (1 << 16)
+#define APIC_LVT_PERIODIC (1 << 17)
+#define APIC_LVT_DEADLINE (2 << 17)
+
+#define APIC_ICR_ASSERT   (1 << 14)
+
+/* Divide the bus clock by 16 for the timer. */
+#define APIC_TIMER_DIV_16 0x3
+
+int lapic_init(void);
+int lapic_enabled(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+void lapic_timer_start(uint8_t vector, uint32_t count, int periodic);
+void lapic_timer_stop(void);
+uint32_t lapic_timer_current(void);
+int lapic_has_tsc_deadline(void);
+void lapic_timer_deadline(uint8_t vector, uint64_t deadline);
+void lapic_error_intr(void);
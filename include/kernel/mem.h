@@ -1,5 +1,11 @@
 #pragma once
 
+#include <kernel/mem/arena.h>
 #include <kernel/mem/boot.h>
 #include <kernel/mem/buddy.h>
+#include <kernel/mem/huge.h>
 #include <kernel/mem/init.h>
+#include <kernel/mem/pcp.h>
+#include <kernel/mem/rbpool.h>
+#include <kernel/mem/slab.h>
+#include <kernel/mem/zero.h>
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <types.h>
+#include <paging.h>
+
+/* The default order of the chunks backing an arena. */
+#define ARENA_CHUNK_ORDER 2
+
+/* Header at the start of every chunk, linking it to the previous chunk. */
+struct arena_chunk {
+	struct arena_chunk *prev;
+};
+
+/*
+ * Bump allocator backed by chunks taken from the buddy allocator. Objects are
+ * never freed individually: the arena is either rolled back to an earlier
+ * mark with arena_reset(), or released as a whole with arena_destroy().
+ *
+ * Allocations are carved out of the most recent chunk. A new chunk of at least
+ * 2^order pages is taken whenever an allocation does not fit in the space that
+ * is left, and the space left in the previous chunk is simply given up.
+ */
+struct arena {
+	struct arena_chunk *chunk;
+	char *cur;
+	char *end;
+	size_t order;
+	size_t nchunks;
+};
+
+/* A position in an arena, as saved by arena_mark(). */
+struct arena_mark {
+	struct arena_chunk *chunk;
+	char *cur;
+};
+
+void arena_init(struct arena *arena, size_t order);
+void *arena_alloc(struct arena *arena, size_t size, size_t align);
+void arena_mark(struct arena *arena, struct arena_mark *mark);
+void arena_reset(struct arena *arena, struct arena_mark *mark);
+void arena_destroy(struct arena *arena);
@@ -8,5 +8,10 @@
 
 extern char bootstacktop[], bootstack[];
 
+/* The physical memory the boot stub maps at KERNEL_VMA, and the size of the
+ * pages it uses for that.
+ */
+extern uint64_t boot_map_end, boot_map_page_size;
+
 void *boot_alloc(uint32_t n);
 void align_boot_info(struct boot_info *boot_info);
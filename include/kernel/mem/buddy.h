@@ -3,13 +3,18 @@
 #include <boot.h>
 #include <assert.h>
 #include <paging.h>
+#include <rbtree.h>
 
 #include <x86-64/memory.h>
 
+#include <kernel/spinlock.h>
+#include <kernel/mem/numa.h>
+
 #define BUDDY_MAX_ORDER (BUDDY_2M_PAGE + 1)
 
 extern struct page_info *pages;
 extern size_t npages;
+extern uint64_t *buddy_map;
 
 /*
  * This macro takes a kernel virtual address -- an address that points above
@@ -43,6 +48,16 @@ enum {
 	ALLOC_ZERO = 1 << 0,
 	ALLOC_HUGE = 1 << 1,
 	ALLOC_PREMAPPED = 1 << 2,
+	/* Prefer a page that is not expected to be in the CPU caches. */
+	ALLOC_COLD = 1 << 3,
+	/* Prefer the free page with the lowest physical address. */
+	ALLOC_LOW = 1 << 4,
+	/* Only use pages from the DMA zone. */
+	ALLOC_DMA = 1 << 5,
+	/* Prefer pages from the high zone. */
+	ALLOC_HIGH = 1 << 6,
+	/* The page can be moved or reclaimed, e.g. user memory. */
+	ALLOC_MOVABLE = 1 << 7,
 };
 
 /* The buddy allocator order for known page sizes. */
@@ -52,12 +67,136 @@ enum {
 	BUDDY_1G_PAGE = 18,
 };
 
+/*
+ * Free chunks are grouped by migrate type in pageblocks of 2M, such that
+ * short-lived movable allocations do not end up scattered across the
+ * pageblocks that hold long-lived kernel allocations, which would keep any of
+ * them from ever becoming a free 2M chunk again.
+ */
+enum {
+	MIGRATE_UNMOVABLE,
+	MIGRATE_MOVABLE,
+	NMIGRATE_TYPES,
+};
+
+#define PAGEBLOCK_ORDER BUDDY_2M_PAGE
+
+/* The memory zones, in order of increasing physical address. */
+enum {
+	ZONE_DMA,
+	ZONE_NORMAL,
+	ZONE_HIGH,
+	NZONES,
+};
+
+#define ZONE_DMA_LIM    (16ULL * 1024 * 1024)
+#define ZONE_NORMAL_LIM (4ULL * 1024 * 1024 * 1024)
+
+/* Every NUMA node has a zone of every type, the zone of type t on node n is
+ * buddy_zones[n * NZONES + t].
+ */
+#define NBUDDY_ZONES (MAX_NUMNODES * NZONES)
+
+/* The default number of pages a zone keeps back from fallback allocations. */
+#define ZONE_RESERVE 256
+
+/*
+ * Every zone has its own set of buddy free lists for the physical range
+ * [base, end), one for every migrate type. The zone boundaries are aligned to
+ * far more than the largest buddy order, such that buddies always share the
+ * same zone. The range of a zone is that of its type, cut down to its NUMA
+ * node, and may be empty.
+ *
+ * Allocations are served from a preferred zone first and fall back to the
+ * lower zones of the same node, and then to those of the other nodes (see
+ * page_alloc_node()). A zone only serves fallback allocations for as long as
+ * more than reserve pages remain free in it, to keep some memory available
+ * for the callers that can only use that zone.
+ *
+ * The free lists, the counters and the index of a zone are protected by the
+ * lock of the zone, which is only ever held for one zone at a time. Order 0
+ * pages mostly come from the per-CPU caches, which only take the lock to
+ * refill or drain a whole batch.
+ */
+struct buddy_zone {
+	struct spinlock lock;
+	const char *name;
+	size_t node;
+	physaddr_t base;
+	physaddr_t end;
+	struct list free_list[NMIGRATE_TYPES][BUDDY_MAX_ORDER];
+	size_t nfree[BUDDY_MAX_ORDER];
+	size_t nfree_pages;
+	uint32_t free_mask[NMIGRATE_TYPES];
+	struct rb_tree index[BUDDY_MAX_ORDER];
+	size_t npages;
+	size_t reserve;
+	size_t nfallbacks;
+	size_t nsteals;
+	size_t nclaims;
+	size_t nmerges_avoided;
+	size_t nmerges_coalesced;
+};
+
+extern struct buddy_zone buddy_zones[];
+
+/* Bucket i of the allocation latency histogram counts the allocations that
+ * took less than 2^(i + MEMSTAT_MIN_SHIFT + 1) cycles, but at least half that
+ * for every bucket but the first. The last bucket counts all slower ones.
+ */
+#define MEMSTAT_NBUCKETS  16
+#define MEMSTAT_MIN_SHIFT 6
+
+/* Counters of the page allocator, for the memstat monitor command. The counts
+ * and timings cover page_alloc() and page_free(), whereas the splits and
+ * merges cover the buddy allocator as a whole. Every CPU only updates its own
+ * counters, which are added up for display.
+ */
+struct buddy_stats {
+	size_t nallocs[BUDDY_MAX_ORDER];
+	size_t nfrees[BUDDY_MAX_ORDER];
+	size_t nfailed;
+	size_t nsplits;
+	size_t nmerges;
+	uint64_t alloc_cycles;
+	uint64_t alloc_max;
+	uint64_t free_cycles;
+	uint64_t free_max;
+	size_t alloc_hist[MEMSTAT_NBUCKETS];
+};
+
+extern struct buddy_stats buddy_stats[];
+
+void buddy_init(void);
+size_t buddy_map_size(void);
+int buddy_map_test(struct page_info *page, size_t order);
+size_t buddy_zone_of(physaddr_t pa);
+void buddy_zone_set_reserve(size_t zone, size_t reserve);
+void buddy_zone_default_reserves(void);
+size_t buddy_pageblock_type(struct page_info *page);
+int buddy_fragmentation_index(size_t order);
 size_t count_free_pages(size_t order);
 void show_buddy_info(void);
+void show_mem_stats(void);
+void reset_mem_stats(void);
 size_t count_total_free_pages(void);
 struct page_info *page_alloc(int alloc_flags);
+struct page_info *page_alloc_node(size_t node, int alloc_flags);
 struct page_info *buddy_find(size_t req_order);
+struct page_info *buddy_find_flags(size_t req_order, int alloc_flags);
+struct page_info *buddy_find_node(size_t req_order, int alloc_flags,
+	size_t node);
+int buddy_index_enable(int enable);
+struct page_info *buddy_find_lowest(size_t req_order, int alloc_flags);
+struct page_info *buddy_find_range(size_t req_order, physaddr_t lo,
+	physaddr_t hi);
+void buddy_free(struct page_info *pp);
+size_t buddy_free_range(physaddr_t start, physaddr_t end);
+size_t buddy_coalesce(size_t order);
+size_t buddy_set_merge_threshold(size_t threshold);
 void page_free(struct page_info *pp);
+size_t page_alloc_bulk(size_t order, size_t n, struct page_info **out);
+void page_free_bulk(struct page_info **pp, size_t n);
 void page_decref(struct page_info *pp);
 
 static inline physaddr_t page2pa(struct page_info *pp)
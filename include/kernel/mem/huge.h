@@ -0,0 +1,42 @@
+#pragma once
+
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+#include <kernel/spinlock.h>
+
+/* Default number of 2M chunks to reserve for ALLOC_HUGE, which can be set at
+ * build time with DEFS=-DHUGE_POOL_2M=n.
+ */
+#ifndef HUGE_POOL_2M
+#define HUGE_POOL_2M 0
+#endif
+
+/*
+ * Pool of 2M chunks reserved for ALLOC_HUGE. The chunks are kept off the buddy
+ * free lists, such that 4K allocations cannot split them, and are handed out
+ * and taken back in O(1). The chunks the pool has handed out are marked with
+ * pp_hout, and refill the pool up to its target once freed, before any go
+ * back to the buddy allocator. nallocated counts these chunks, which still
+ * count towards the target.
+ *
+ * The list and the counters are protected by the lock of the pool, which is
+ * taken before any zone lock.
+ */
+struct huge_pool {
+	struct spinlock lock;
+	struct list pages;
+	size_t count;
+	size_t nallocated;
+	size_t target;
+	size_t hits;
+	size_t misses;
+};
+
+void page_huge_init(void);
+size_t page_huge_reserve(size_t target);
+struct page_info *page_huge_alloc(void);
+int page_huge_free(struct page_info *page);
+size_t count_huge_pages(void);
+void show_huge_info(void);
@@ -6,5 +6,13 @@
 
 #include <x86-64/memory.h>
 
+/* The struct page_infos above this physical address are set up on demand, a
+ * section of PAGE_INIT_SECTION pages at a time. Both are multiples of the
+ * largest buddy chunk, such that buddies are always set up together.
+ */
+#define PAGE_INIT_EAGER_LIM (4 * 1024 * 1024)
+#define PAGE_INIT_SECTION   512
+
 void mem_init(struct boot_info *boot_info);
 void page_init(struct boot_info *boot_info);
+size_t page_init_deferred(size_t nsections);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <types.h>
+#include <paging.h>
+
+#define MAX_NUMNODES 4
+
+/*
+ * A NUMA node, i.e. a range of physical memory that is equally far from the
+ * CPUs of one proximity domain of the ACPI SRAT. The nodes are sorted by
+ * address and cover all of the physical address space between them, holes
+ * included, such that every address belongs to exactly one node. The node
+ * boundaries are aligned to the largest buddy chunk.
+ *
+ * Every node has its own slice of the struct page_info array and its own set
+ * of buddy zones (see struct buddy_zone). Without an SRAT, there is a single
+ * node covering everything.
+ */
+struct numa_node {
+	physaddr_t base;
+	physaddr_t end;
+	uint32_t domain;
+	struct page_info *pages;
+	size_t npages;
+};
+
+extern struct numa_node numa_nodes[];
+extern size_t nnuma_nodes;
+
+void numa_init(void);
+size_t numa_node_of(physaddr_t pa);
+size_t numa_local_node(void);
+void show_numa_info(void);
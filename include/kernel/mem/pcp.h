@@ -0,0 +1,37 @@
+#pragma once
+
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+/* Default watermarks for the per-CPU page caches. */
+#define PCP_LOW   32
+#define PCP_HIGH  64
+#define PCP_BATCH 16
+
+/*
+ * Per-CPU cache of order 0 pages sitting in front of the buddy allocator.
+ * Recently freed (cache-hot) pages are kept at the head of the list, whereas
+ * the tail holds the pages that have been sitting in the cache the longest.
+ *
+ * When the cache runs empty, batch pages are pulled from the buddy allocator
+ * at once. When more than high pages are cached, the coldest pages are handed
+ * back to the buddy allocator until only low pages remain.
+ */
+struct page_pcp {
+	struct list pages;
+	size_t count;
+	size_t low;
+	size_t high;
+	size_t batch;
+};
+
+extern struct page_pcp page_pcps[];
+
+void page_pcp_init(void);
+int page_pcp_enable(int enable);
+void page_pcp_set_watermarks(size_t low, size_t high, size_t batch);
+struct page_info *page_pcp_alloc(int alloc_flags);
+int page_pcp_free(struct page_info *page);
+size_t page_pcp_drain(void);
+size_t count_pcp_pages(void);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <types.h>
+#include <rbtree.h>
+
+#include <kernel/mem/arena.h>
+
+/*
+ * Pool of objects with an embedded struct rb_node, for trees whose nodes are
+ * allocated dynamically. New objects are carved out of arena chunks taken from
+ * the buddy allocator, such that the nodes of a tree that grows stay close to
+ * each other. Freed objects are pushed onto a free list that is threaded
+ * through the child pointers of their rb_node, and are handed out again before
+ * the arena is touched, which makes both rb_pool_alloc() and rb_pool_free()
+ * O(1).
+ *
+ * Trees that are mostly read from after they have been built can be moved
+ * into a single block in breadth-first order with rb_pool_compact().
+ *
+ * The memory only goes back to the buddy allocator once the whole pool is
+ * released with rb_pool_destroy().
+ */
+struct rb_pool {
+	struct arena arena;
+	struct rb_node *free;
+	size_t size;
+	size_t offset;
+	size_t nactive;
+};
+
+/* Initializes a pool of objects of the given type, embedding an rb_node as
+ * field.
+ */
+#define RB_POOL_INIT(pool, type, field) \
+	rb_pool_init(pool, sizeof(type), offsetof(type, field))
+
+void rb_pool_init(struct rb_pool *pool, size_t size, size_t offset);
+struct rb_node *rb_pool_alloc(struct rb_pool *pool);
+void rb_pool_free(struct rb_pool *pool, struct rb_node *node);
+int rb_pool_compact(struct rb_pool *pool, struct rb_tree *tree);
+void rb_pool_destroy(struct rb_pool *pool);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+/* Objects, and their colour offsets, are spread out in cache-line steps. */
+#define KMEM_CACHE_LINE 64
+
+/* The number of empty slabs a cache holds on to rather than freeing them. */
+#define KMEM_MAX_EMPTY 1
+
+/*
+ * Cache of equally sized objects carved out of 4K slab pages. A slab is on the
+ * partial list while it has both free and allocated objects, on the full list
+ * once all of its objects are allocated, and on the empty list otherwise, such
+ * that allocations are served from partial slabs first.
+ *
+ * The free objects of a slab form a list through their first word, of which
+ * the head and the number of allocated objects are kept in the struct
+ * page_info of the slab. Each new slab starts its objects at the next colour
+ * offset, to spread the objects of different slabs over the CPU cache sets.
+ * The struct page_info of a slab refers to its cache by the id of the cache,
+ * which is unique among the caches that exist at the same time.
+ */
+struct kmem_cache {
+	size_t size;
+	size_t align;
+	size_t nobjs;
+	size_t colour;
+	size_t colour_max;
+	size_t colour_step;
+	struct list partial;
+	struct list full;
+	struct list empty;
+	size_t nslabs;
+	size_t nempty;
+	size_t nactive;
+	struct list node;
+	uint16_t id;
+};
+
+void kmem_init(void);
+struct kmem_cache *kmem_cache_create(size_t size, size_t align);
+void kmem_cache_destroy(struct kmem_cache *cache);
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+size_t kmem_cache_shrink(struct kmem_cache *cache);
+void show_slab_info(void);
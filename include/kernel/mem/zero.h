@@ -0,0 +1,40 @@
+#pragma once
+
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+#include <kernel/spinlock.h>
+
+/* Default number of chunks to keep pre-zeroed for 4K and 2M allocations. */
+#define ZERO_POOL_4K 32
+#define ZERO_POOL_2M 1
+
+/* The maximum number of pages to clear each time the kernel is idle. */
+#define ZERO_FILL_BATCH 512
+
+/*
+ * Pool of free chunks that have already been cleared, such that ALLOC_ZERO
+ * requests do not have to wait for the memset(). The pool is filled up to
+ * target chunks whenever the kernel has nothing better to do.
+ *
+ * The list and the counters are protected by the lock of the pool, which is
+ * taken before any zone lock.
+ */
+struct zero_pool {
+	struct spinlock lock;
+	struct list pages;
+	size_t order;
+	size_t count;
+	size_t target;
+	size_t hits;
+	size_t misses;
+};
+
+void page_zero_init(void);
+void page_zero_set_target(size_t order, size_t target);
+size_t page_zero_fill(size_t max_pages);
+struct page_info *page_zero_alloc(size_t order);
+size_t page_zero_drain(void);
+size_t count_zero_pages(void);
+void show_zero_info(void);
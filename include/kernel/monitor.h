@@ -18,4 +18,9 @@ int mon_help(int argc, char **argv, struct int_frame *frame);
 int mon_kerninfo(int argc, char **argv, struct int_frame *frame);
 int mon_backtrace(int argc, char **argv, struct int_frame *frame);
 int mon_buddyinfo(int argc, char **argv, struct int_frame *frame);
+int mon_memstat(int argc, char **argv, struct int_frame *frame);
+int mon_slabinfo(int argc, char **argv, struct int_frame *frame);
+int mon_rbstats(int argc, char **argv, struct int_frame *frame);
+int mon_trace(int argc, char **argv, struct int_frame *frame);
 int mon_pageinfo(int argc, char **argv, struct int_frame *frame);
+int mon_bench(int argc, char **argv, struct int_frame *frame);
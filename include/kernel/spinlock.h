@@ -0,0 +1,29 @@
+#pragma once
+
+#include <types.h>
+
+/*
+ * Test-and-test-and-set spinlock. A CPU that finds the lock taken spins on
+ * plain reads until the lock looks free, and only then retries the atomic
+ * exchange, such that the waiters do not keep bouncing the cache line around.
+ *
+ * Every lock counts how often it has been taken and how often it had to be
+ * waited for, along with the cycles spent waiting and holding it. The counters
+ * are only updated by the holder of the lock.
+ */
+struct spinlock {
+	volatile uint32_t locked;
+	const char *name;
+	uint64_t acquired_at;
+	size_t nacquired;
+	size_t ncontended;
+	uint64_t spin_cycles;
+	uint64_t hold_cycles;
+	uint64_t hold_max;
+};
+
+void spin_init(struct spinlock *lock, const char *name);
+void spin_lock(struct spinlock *lock);
+int spin_trylock(struct spinlock *lock);
+void spin_unlock(struct spinlock *lock);
+void spin_reset_stats(struct spinlock *lock);
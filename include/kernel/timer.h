@@ -0,0 +1,30 @@
+#pragma once
+
+#include <types.h>
+#include <timerq.h>
+
+/*
+ * Kernel timers, with deadlines in TSC cycles. There is no periodic tick: the
+ * hardware is programmed in one-shot mode for the deadline of the first timer
+ * only, and reprogrammed whenever that changes. In order of preference, this
+ * uses the TSC-deadline mode of the local APIC, its one-shot mode, or
+ * channel 0 of the PIT.
+ *
+ * The timers expire from the timer interrupt, i.e. while the kernel waits
+ * with interrupts enabled (see getchar()), or from timer_poll(). As the
+ * kernel otherwise runs with interrupts disabled, the queue needs no lock.
+ */
+enum {
+	TIMER_NONE,
+	TIMER_PIT,
+	TIMER_APIC_ONESHOT,
+	TIMER_APIC_DEADLINE,
+};
+
+void timers_init(void);
+uint64_t timer_tsc_hz(void);
+void timer_arm(struct timer *timer, uint64_t deadline);
+void timer_arm_in(struct timer *timer, uint64_t cycles);
+void timer_cancel(struct timer *timer);
+size_t timer_poll(void);
+void timer_intr(void);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <types.h>
+
+/* The number of records in the trace ring of every CPU, a power of two. */
+#define TRACE_RING_SIZE 1024
+
+enum trace_event {
+	TRACE_NONE,
+	TRACE_PAGE_ALLOC,
+	TRACE_PAGE_FREE,
+	TRACE_BUDDY_SPLIT,
+	TRACE_BUDDY_MERGE,
+	TRACE_RB_BALANCE,
+	TRACE_RB_REMOVE,
+	NTRACE_EVENTS,
+};
+
+/* A single trace record: the event, the TSC at which it happened and two
+ * arguments of which the meaning depends on the event.
+ */
+struct trace_record {
+	uint64_t tsc;
+	uint32_t event;
+	uint32_t cpu;
+	uint64_t arg0;
+	uint64_t arg1;
+};
+
+/*
+ * Per-CPU ring of the most recent trace records. The ring is written without
+ * any locking, as only its own CPU writes to it, and old records are simply
+ * overwritten once the ring is full. head is the number of records that have
+ * been written in total.
+ */
+struct trace_ring {
+	struct trace_record records[TRACE_RING_SIZE];
+	size_t head;
+};
+
+extern int trace_enabled;
+
+void trace_log(uint32_t event, uint64_t arg0, uint64_t arg1);
+int trace_enable(int enable);
+void trace_clear(void);
+const char *trace_event_name(uint32_t event);
+uint32_t trace_event_of(const char *name);
+size_t trace_dump(uint32_t event, size_t max);
+
+/* Records the event in the trace ring of the current CPU. With tracing
+ * disabled this costs a single, predicted, branch.
+ */
+#define trace(event, arg0, arg1) \
+	do { \
+		if (unlikely(trace_enabled)) \
+			trace_log(event, (uint64_t)(arg0), (uint64_t)(arg1)); \
+	} while (0)
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <types.h>
+#include <rbtree.h>
+
+/*
+ * Order-statistic tree on top of the augmented red-black tree. Every node
+ * tracks the number of nodes in its subtree, such that the k-th node in order
+ * and the position of a node can both be found in O(log n), rather than by
+ * walking rb_next() k times.
+ *
+ * Positions start at 0. Nodes are ordered by the key that is passed to
+ * os_tree_insert() like to rb_insert(), and nodes with equal keys are kept in
+ * the order they were inserted in.
+ */
+struct os_node {
+	struct rb_node node;
+	size_t size;
+};
+
+struct os_tree {
+	struct rb_tree tree;
+};
+
+static inline void os_tree_init(struct os_tree *otree)
+{
+	rb_init(&otree->tree);
+}
+
+/* Returns the number of nodes in the tree. */
+static inline size_t os_tree_size(struct os_tree *otree)
+{
+	struct rb_node *root = otree->tree.root;
+
+	return root ? container_of(root, struct os_node, node)->size : 0;
+}
+
+void os_tree_insert(struct os_tree *otree, struct os_node *onode,
+	rb_cmp_t cmp, ptrdiff_t key_offset);
+void os_tree_remove(struct os_tree *otree, struct os_node *onode);
+struct os_node *os_tree_select(struct os_tree *otree, size_t k);
+size_t os_tree_rank(struct os_node *onode);
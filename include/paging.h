@@ -15,25 +15,69 @@
  * You can map a struct page_info * to the corresponding physical
  * address with page2pa() in kernel/mem.h.
  * FIXME: where?
+ *
+ * The fields are laid out such that the struct takes 24 bytes, i.e. eight
+ * descriptors per three cache lines: the flags fit in two bytes, and slab
+ * pages, which page tables never refer to, keep the id of their cache in place
+ * of the reference count rather than a pointer to it.
  */
 struct page_info {
 	/* Next page on the free list. */
 	struct list pp_node;
 
-	/* pp_ref is the count of pointers (usually in page table entries)
-	 * to this page, for pages allocated using page_alloc.
-	 * Pages allocated at boot time using pmap.c's
-	 * boot_alloc do not have valid reference count fields. */
-	uint16_t pp_ref;
+	union {
+		/* pp_ref is the count of pointers (usually in page table
+		 * entries) to this page, for pages allocated using page_alloc.
+		 * Pages allocated at boot time using pmap.c's
+		 * boot_alloc do not have valid reference count fields. */
+		uint16_t pp_ref;
+
+		/* The id of the cache a slab page belongs to, see struct
+		 * kmem_cache.
+		 */
+		uint16_t pp_cache;
+	};
 
-	/* The order of the page. */
-	uint8_t pp_order : 7;
+	/* The order of the page, at most BUDDY_2M_PAGE. */
+	uint8_t pp_order : 4;
 
 	/* Whether the page is actually free. */
 	uint8_t pp_free : 1;
 
-	/* Reserved. */
-	uint64_t pp_zero;
+	/* Whether the page has been handed out by the pool of reserved 2M
+	 * chunks, to which it returns once freed.
+	 */
+	uint8_t pp_hout : 1;
+
+	/* Whether the page is used as a slab. */
+	uint8_t pp_slab : 1;
+
+	/* Whether the page is held by a per-CPU page cache. */
+	uint8_t pp_pcp : 1;
+
+	/* Whether the page is held by the pool of pre-zeroed pages. */
+	uint8_t pp_zpool : 1;
+
+	/* Whether the page is held by the pool of reserved 2M chunks. */
+	uint8_t pp_hpool : 1;
+
+	/* The memory zone the page belongs to, see NBUDDY_ZONES. */
+	uint8_t pp_zone : 4;
+
+	/* For the first page of a pageblock, whether the pageblock groups
+	 * movable rather than unmovable allocations.
+	 */
+	uint8_t pp_movable : 1;
+
+	/* The number of objects handed out, for pages used as a slab. */
+	uint16_t pp_inuse;
+
+	/* The offset of the first free object within a slab page, or
+	 * PP_FREELIST_END if there is none.
+	 */
+	uint16_t pp_freelist;
 };
+
+#define PP_FREELIST_END 0xffff
 #endif /* !__ASSEMBLER__ */
 
@@ -2,6 +2,7 @@
 
 #include <types.h>
 #include <string.h>
+#include <seqcount.h>
 
 enum rb_dir {
 	RB_LEFT,
@@ -13,33 +14,495 @@ enum rb_color {
 	RB_RED,
 };
 
+/*
+ * Nodes are aligned to at least 4 bytes, so the color is kept in the lowest
+ * bit of the parent pointer. Use rb_parent() and rb_color() to access them.
+ */
 struct rb_node {
-	struct rb_node *parent;
+	uintptr_t parent_color;
 	struct rb_node *child[2];
-	enum rb_color color;
 };
 
 struct rb_tree {
 	struct rb_node *root;
 };
 
+/*
+ * Tree that additionally keeps track of its leftmost and rightmost nodes, such
+ * that rb_first_cached() and rb_last_cached() run in constant time. Use the
+ * _cached variants of the functions to modify it, the plain functions can be
+ * used on the embedded tree for everything else.
+ */
+struct rb_tree_cached {
+	struct rb_tree tree;
+	struct rb_node *leftmost;
+	struct rb_node *rightmost;
+};
+
+/*
+ * Callbacks for augmented trees, i.e. trees in which every node caches an
+ * aggregate of its subtree, such as the maximum end of an interval tree or the
+ * size of the subtree for an order-statistic tree:
+ *  - propagate() recomputes the aggregates of node and its ancestors up to,
+ *    but excluding, stop (NULL meaning all the way up to the root).
+ *  - copy() gives new the aggregate of old, when new takes over the place of
+ *    old in the tree.
+ *  - rotate() is called after new has been rotated into the place of old: new
+ *    should take over the aggregate of old, which should be recomputed.
+ */
+struct rb_augment {
+	void (*propagate)(struct rb_node *node, struct rb_node *stop);
+	void (*copy)(struct rb_node *old, struct rb_node *new);
+	void (*rotate)(struct rb_node *old, struct rb_node *new);
+};
+
+#ifdef RB_STATS
+/*
+ * Global counters for the rebalancing work done by all trees, only kept when
+ * building with -DRB_STATS. The loop counters count the iterations of the
+ * fixup loops of rb_balance() and rb_remove(), max_depth is the deepest level
+ * (the root being at depth 1) a node has been inserted at.
+ */
+struct rb_stats {
+	size_t rotations;
+	size_t recolors;
+	size_t balance_loops;
+	size_t remove_loops;
+	size_t max_depth;
+};
+
+extern struct rb_stats rb_stats;
+#endif
+
+/*
+ * Concurrency: all the functions modifying a tree must be serialized by the
+ * caller, e.g. using a lock. Lookups through rb_find_seq(), or custom lookups
+ * built on _rb_find_lockless() in the same way, may run concurrently with the
+ * writer without taking the lock, provided that the writer brackets every
+ * modification with write_seqcount_begin() and write_seqcount_end(). The
+ * iterators, the bound lookups and anything else that follows parent pointers
+ * are only safe while holding the lock, as are rb_build_sorted(), rb_join()
+ * and rb_split(), which relink the tree wholesale.
+ */
+
+/*
+ * In-order iterator over a tree. The iterator always looks up the node to
+ * return next up front and prefetches it, such that the cache miss overlaps
+ * with whatever the caller does with the current node. As a result the
+ * current node may be removed from the tree while iterating.
+ */
+struct rb_iter {
+	struct rb_node *next;
+	enum rb_dir dir;
+};
+
+#define rb_foreach(tree, node) \
+	for (node = rb_first(tree); node; node = rb_next(node))
+#define rb_foreach_rev(tree, node) \
+	for (node = rb_last(tree); node; node = rb_prev(node))
+#define rb_foreach_safe(tree, node, next) \
+	for (node = rb_first(tree), next = rb_next(node); node; node = next, \
+		next = rb_next(node))
+#define rb_foreach_safe_rev(tree, node, prev) \
+	for (node = rb_last(tree), prev = rb_prev(node); node; node = prev, \
+		prev = rb_prev(node))
+
+static inline struct rb_node *rb_parent(struct rb_node *node)
+{
+	return (struct rb_node *)(node->parent_color & ~(uintptr_t)1);
+}
+
+static inline enum rb_color rb_color(struct rb_node *node)
+{
+	return node->parent_color & 1;
+}
+
+static inline void rb_set_parent(struct rb_node *node, struct rb_node *parent)
+{
+	node->parent_color = (uintptr_t)parent | rb_color(node);
+}
+
+static inline void rb_set_color(struct rb_node *node, enum rb_color color)
+{
+	node->parent_color = (node->parent_color & ~(uintptr_t)1) | color;
+}
+
 struct rb_node *rb_first(struct rb_tree *tree);
 struct rb_node *rb_last(struct rb_tree *tree);
 struct rb_node *rb_next(struct rb_node *node);
 struct rb_node *rb_prev(struct rb_node *node);
+void rb_iter_init(struct rb_iter *iter, struct rb_tree *tree, enum rb_dir dir);
+void rb_iter_init_at(struct rb_iter *iter, struct rb_node *node,
+	enum rb_dir dir);
+struct rb_node *rb_iter_next(struct rb_iter *iter);
 
 static inline void rb_init(struct rb_tree *tree)
 {
 	tree->root = NULL;
 }
 
+static inline void rb_init_cached(struct rb_tree_cached *ctree)
+{
+	rb_init(&ctree->tree);
+	ctree->leftmost = NULL;
+	ctree->rightmost = NULL;
+}
+
+static inline struct rb_node *rb_first_cached(struct rb_tree_cached *ctree)
+{
+	return ctree->leftmost;
+}
+
+static inline struct rb_node *rb_last_cached(struct rb_tree_cached *ctree)
+{
+	return ctree->rightmost;
+}
+
 static inline void rb_node_init(struct rb_node *node)
 {
 	memset(node, 0, sizeof *node);
 }
 
+/*
+ * Comparator for keyed lookups: returns a negative value, zero or a positive
+ * value if the key lhs is smaller than, equal to or larger than the key rhs.
+ */
+typedef int (*rb_cmp_t)(const void *lhs, const void *rhs);
+
+/*
+ * The keyed functions find the key of a node at key_offset bytes from the
+ * struct rb_node, which may be negative if the key precedes the node in the
+ * containing struct. Use RB_KEY_OFFSET() to compute it.
+ */
+#define RB_KEY_OFFSET(type, member, key) \
+	((ptrdiff_t)offsetof(type, key) - (ptrdiff_t)offsetof(type, member))
+#define RB_KEY(node, key_offset) \
+	((const void *)((const char *)(node) + (key_offset)))
+
+struct rb_node *rb_find(struct rb_tree *tree, const void *key, rb_cmp_t cmp,
+	ptrdiff_t key_offset);
+struct rb_node *rb_find_seq(struct rb_tree *tree, struct seqcount *seq,
+	const void *key, rb_cmp_t cmp, ptrdiff_t key_offset);
+struct rb_node *rb_lower_bound(struct rb_tree *tree, const void *key,
+	rb_cmp_t cmp, ptrdiff_t key_offset);
+struct rb_node *rb_upper_bound(struct rb_tree *tree, const void *key,
+	rb_cmp_t cmp, ptrdiff_t key_offset);
+int rb_insert(struct rb_tree *tree, struct rb_node *node, rb_cmp_t cmp,
+	ptrdiff_t key_offset);
+int rb_insert_cached(struct rb_tree_cached *ctree, struct rb_node *node,
+	rb_cmp_t cmp, ptrdiff_t key_offset);
+int rb_insert_after(struct rb_tree *tree, struct rb_node *hint,
+	struct rb_node *node);
+int rb_insert_before(struct rb_tree *tree, struct rb_node *hint,
+	struct rb_node *node);
+int rb_insert_after_cached(struct rb_tree_cached *ctree, struct rb_node *hint,
+	struct rb_node *node);
+int rb_insert_before_cached(struct rb_tree_cached *ctree,
+	struct rb_node *hint, struct rb_node *node);
+struct rb_node *rb_pop_first(struct rb_tree *tree);
+struct rb_node *rb_pop_last(struct rb_tree *tree);
+struct rb_node *rb_pop_first_cached(struct rb_tree_cached *ctree);
+struct rb_node *rb_pop_last_cached(struct rb_tree_cached *ctree);
+
 int rb_balance(struct rb_tree *tree, struct rb_node *node);
 int rb_remove(struct rb_tree *tree, struct rb_node *node);
+int rb_build_sorted(struct rb_tree *tree, struct rb_node **nodes, size_t n);
+int rb_join(struct rb_tree *tree, struct rb_tree *right);
+int rb_split(struct rb_tree *tree, const void *key, rb_cmp_t cmp,
+	ptrdiff_t key_offset, struct rb_tree *right);
+int rb_balance_augmented(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug);
+int rb_remove_augmented(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug);
 int rb_replace(struct rb_tree *tree, struct rb_node *node,
 	struct rb_node *new_node);
+int rb_balance_cached(struct rb_tree_cached *ctree, struct rb_node *node);
+int rb_remove_cached(struct rb_tree_cached *ctree, struct rb_node *node);
+int rb_replace_cached(struct rb_tree_cached *ctree, struct rb_node *node,
+	struct rb_node *new_node);
+
+
+/*
+ * The descents behind the keyed functions. These are always inlined, such
+ * that a constant comparator turns into a direct call that the compiler may
+ * inline in turn. Use RB_DEFINE_KEYED() rather than calling them directly.
+ */
+static __always_inline
+struct rb_node *_rb_find(struct rb_tree *tree, const void *key, rb_cmp_t cmp,
+	ptrdiff_t key_offset)
+{
+	struct rb_node *node = tree->root;
+	int ret;
+
+	while (node) {
+		ret = cmp(key, RB_KEY(node, key_offset));
 
+		if (ret == 0)
+			return node;
+
+		node = node->child[ret > 0];
+	}
+
+	return NULL;
+}
+
+/*
+ * The maximum depth of a red-black tree that fits in memory. A lockless reader
+ * racing with rotations may briefly be led astray, so it gives up after this
+ * many steps and leaves it to the retry to find the node.
+ */
+#define RB_MAX_DEPTH 128
+
+/* Like _rb_find(), but safe against a concurrent writer. The result is only
+ * meaningful if the read has been validated, see rb_find_seq().
+ */
+static __always_inline
+struct rb_node *_rb_find_lockless(struct rb_tree *tree, const void *key,
+	rb_cmp_t cmp, ptrdiff_t key_offset)
+{
+	struct rb_node *node = READ_ONCE(tree->root);
+	size_t depth;
+	int ret;
+
+	for (depth = 0; node && depth < RB_MAX_DEPTH; ++depth) {
+		ret = cmp(key, RB_KEY(node, key_offset));
+
+		if (ret == 0)
+			return node;
+
+		node = READ_ONCE(node->child[ret > 0]);
+	}
+
+	return NULL;
+}
+
+/* Returns the first node with a key larger than key if upper is set, or the
+ * first node with a key that is not smaller than key otherwise.
+ */
+static __always_inline
+struct rb_node *_rb_bound(struct rb_tree *tree, const void *key, rb_cmp_t cmp,
+	ptrdiff_t key_offset, int upper)
+{
+	struct rb_node *node = tree->root;
+	struct rb_node *bound = NULL;
+	int ret;
+
+	while (node) {
+		ret = cmp(key, RB_KEY(node, key_offset));
+
+		if (ret < 0 || (ret == 0 && !upper)) {
+			bound = node;
+			node = node->child[RB_LEFT];
+		} else {
+			node = node->child[RB_RIGHT];
+		}
+	}
+
+	return bound;
+}
+
+/* Sets up the node as the child of parent that link points to. */
+static __always_inline
+void _rb_link_node(struct rb_node **link, struct rb_node *parent,
+	struct rb_node *node)
+{
+	rb_node_init(node);
+	rb_set_parent(node, parent);
+
+	/* Publish the node only once it has been set up. */
+	smp_wmb();
+	WRITE_ONCE(*link, node);
+}
+
+/* Links the node into the tree without rebalancing. Nodes with equal keys are
+ * linked after the existing ones.
+ */
+static __always_inline
+void _rb_link(struct rb_tree *tree, struct rb_node *node, rb_cmp_t cmp,
+	ptrdiff_t key_offset)
+{
+	struct rb_node **link = &tree->root;
+	struct rb_node *parent = NULL;
+	const void *key = RB_KEY(node, key_offset);
+
+	while (*link) {
+		parent = *link;
+		link = parent->child + (cmp(key, RB_KEY(parent, key_offset)) >= 0);
+	}
+
+	_rb_link_node(link, parent, node);
+}
+
+static __always_inline
+int _rb_insert(struct rb_tree *tree, struct rb_node *node, rb_cmp_t cmp,
+	ptrdiff_t key_offset)
+{
+	_rb_link(tree, node, cmp, key_offset);
+
+	return rb_balance(tree, node);
+}
+
+static __always_inline
+int _rb_insert_cached(struct rb_tree_cached *ctree, struct rb_node *node,
+	rb_cmp_t cmp, ptrdiff_t key_offset)
+{
+	_rb_link(&ctree->tree, node, cmp, key_offset);
+
+	return rb_balance_cached(ctree, node);
+}
+
+/*
+ * Defines name_find(), name_lower_bound(), name_upper_bound(), name_insert()
+ * and name_insert_cached() for a tree of type, linked through member and
+ * ordered by key using cmp, without going through an indirect call for every
+ * comparison.
+ */
+#define RB_DEFINE_KEYED(name, type, member, key, cmp) \
+static inline struct rb_node *name##_find(struct rb_tree *tree, \
+	const void *k) \
+{ \
+	return _rb_find(tree, k, cmp, RB_KEY_OFFSET(type, member, key)); \
+} \
+\
+static inline struct rb_node *name##_lower_bound(struct rb_tree *tree, \
+	const void *k) \
+{ \
+	return _rb_bound(tree, k, cmp, RB_KEY_OFFSET(type, member, key), 0); \
+} \
+\
+static inline struct rb_node *name##_upper_bound(struct rb_tree *tree, \
+	const void *k) \
+{ \
+	return _rb_bound(tree, k, cmp, RB_KEY_OFFSET(type, member, key), 1); \
+} \
+\
+static inline int name##_insert(struct rb_tree *tree, type *obj) \
+{ \
+	return _rb_insert(tree, &obj->member, cmp, \
+		RB_KEY_OFFSET(type, member, key)); \
+} \
+\
+static inline int name##_insert_cached(struct rb_tree_cached *ctree, \
+	type *obj) \
+{ \
+	return _rb_insert_cached(ctree, &obj->member, cmp, \
+		RB_KEY_OFFSET(type, member, key)); \
+}
+
+/* Three-way comparison of two numbers, for use as the cmp of RB_GENERATE(). */
+#define RB_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+/*
+ * Generates functions specialized for a tree of type, linked through field and
+ * ordered by the value of keyfield. Unlike RB_DEFINE_KEYED(), keys are passed
+ * and compared by value and the functions deal in type rather than struct
+ * rb_node: cmp(a, b) is called with two key values and returns like rb_cmp_t.
+ * It may be a macro such as RB_CMP_NUM(), in which case both the load of the
+ * key and the comparison end up in the descent loop itself. Defines:
+ *  - name_find(), name_lower_bound() and name_upper_bound(), which take a tree
+ *    and a key and return the object or NULL,
+ *  - name_insert() and name_remove(), which take a tree and an object and
+ *    return like rb_balance() and rb_remove(),
+ *  - name_first(), name_last(), name_next() and name_prev().
+ * Objects with equal keys are inserted after the existing ones.
+ */
+#define RB_GENERATE(name, type, field, keyfield, cmp) \
+static inline type *name##_entry(struct rb_node *node) \
+{ \
+	return node ? container_of(node, type, field) : NULL; \
+} \
+\
+static inline type *name##_find(struct rb_tree *tree, \
+	typeof(((type *)0)->keyfield) key) \
+{ \
+	struct rb_node *node = tree->root; \
+	type *obj; \
+	int ret; \
+\
+	while (node) { \
+		obj = container_of(node, type, field); \
+		ret = cmp(key, obj->keyfield); \
+\
+		if (ret == 0) \
+			return obj; \
+\
+		node = node->child[ret > 0]; \
+	} \
+\
+	return NULL; \
+} \
+\
+static inline type *name##_bound(struct rb_tree *tree, \
+	typeof(((type *)0)->keyfield) key, int upper) \
+{ \
+	struct rb_node *node = tree->root; \
+	type *obj, *bound = NULL; \
+	int ret; \
+\
+	while (node) { \
+		obj = container_of(node, type, field); \
+		ret = cmp(key, obj->keyfield); \
+\
+		if (ret < 0 || (ret == 0 && !upper)) { \
+			bound = obj; \
+			node = node->child[RB_LEFT]; \
+		} else { \
+			node = node->child[RB_RIGHT]; \
+		} \
+	} \
+\
+	return bound; \
+} \
+\
+static inline type *name##_lower_bound(struct rb_tree *tree, \
+	typeof(((type *)0)->keyfield) key) \
+{ \
+	return name##_bound(tree, key, 0); \
+} \
+\
+static inline type *name##_upper_bound(struct rb_tree *tree, \
+	typeof(((type *)0)->keyfield) key) \
+{ \
+	return name##_bound(tree, key, 1); \
+} \
+\
+static inline int name##_insert(struct rb_tree *tree, type *new) \
+{ \
+	struct rb_node **link = &tree->root; \
+	struct rb_node *parent = NULL; \
+\
+	while (*link) { \
+		parent = *link; \
+		link = parent->child + (cmp(new->keyfield, \
+			container_of(parent, type, field)->keyfield) >= 0); \
+	} \
+\
+	_rb_link_node(link, parent, &new->field); \
+\
+	return rb_balance(tree, &new->field); \
+} \
+\
+static inline int name##_remove(struct rb_tree *tree, type *obj) \
+{ \
+	return rb_remove(tree, &obj->field); \
+} \
+\
+static inline type *name##_first(struct rb_tree *tree) \
+{ \
+	return name##_entry(rb_first(tree)); \
+} \
+\
+static inline type *name##_last(struct rb_tree *tree) \
+{ \
+	return name##_entry(rb_last(tree)); \
+} \
+\
+static inline type *name##_next(type *obj) \
+{ \
+	return name##_entry(rb_next(&obj->field)); \
+} \
+\
+static inline type *name##_prev(type *obj) \
+{ \
+	return name##_entry(rb_prev(&obj->field)); \
+}
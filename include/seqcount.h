@@ -0,0 +1,63 @@
+#pragma once
+
+#include <types.h>
+
+#include <x86-64/asm.h>
+
+/*
+ * Sequence counter for data that is read far more often than it is written.
+ * The writer, serialized by whatever lock protects the data, makes the count
+ * odd for the duration of an update. Readers take no locks at all: they note
+ * the count before reading and retry if it was odd or has changed since.
+ *
+ *	do {
+ *		seq = read_seqcount_begin(&sc);
+ *		... read the data ...
+ *	} while (read_seqcount_retry(&sc, seq));
+ *
+ * Readers may observe the data halfway through an update, so they must cope
+ * with inconsistent values until the retry check has passed, and memory they
+ * might look at must not be freed while they could still be reading it.
+ */
+struct seqcount {
+	uint32_t sequence;
+};
+
+static inline void seqcount_init(struct seqcount *sc)
+{
+	sc->sequence = 0;
+}
+
+static inline uint32_t read_seqcount_begin(struct seqcount *sc)
+{
+	uint32_t seq;
+
+	while ((seq = READ_ONCE(sc->sequence)) & 1)
+		asm volatile("pause");
+
+	smp_rmb();
+
+	return seq;
+}
+
+/* Returns non-zero if the data read since read_seqcount_begin() returned seq
+ * may be inconsistent.
+ */
+static inline int read_seqcount_retry(struct seqcount *sc, uint32_t seq)
+{
+	smp_rmb();
+
+	return READ_ONCE(sc->sequence) != seq;
+}
+
+static inline void write_seqcount_begin(struct seqcount *sc)
+{
+	WRITE_ONCE(sc->sequence, sc->sequence + 1);
+	smp_wmb();
+}
+
+static inline void write_seqcount_end(struct seqcount *sc)
+{
+	smp_wmb();
+	WRITE_ONCE(sc->sequence, sc->sequence + 1);
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <types.h>
 #include <stdarg.h>
 
 #ifndef NULL
@@ -8,6 +9,7 @@
 
 /* lib/stdio.c */
 void cputchar(int c);
+void cputs(const char *str, size_t len);
 int getchar(void);
 int iscons(int fd);
 
@@ -15,6 +17,8 @@ int iscons(int fd);
 void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
 void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
 	va_list);
+void vprintfmt_write(void (*write)(const char *, size_t, void*), void *putdat,
+	const char *fmt, va_list);
 int snprintf(char *str, int size, const char *fmt, ...);
 int vsnprintf(char *str, int size, const char *fmt, va_list);
 
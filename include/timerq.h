@@ -0,0 +1,60 @@
+#pragma once
+
+#include <types.h>
+#include <rbtree.h>
+
+/*
+ * Queue of timers ordered by deadline, on top of the red-black tree with a
+ * cached leftmost node: the next timer to expire is found in O(1), whereas
+ * arming and cancelling a timer take O(log n). Timers with the same deadline
+ * expire in the order they were armed in.
+ *
+ * The queue does not know about time itself: deadlines are in whatever unit
+ * the caller uses (TSC cycles in the kernel, see kernel/timer.c), and the
+ * caller decides when to expire the timers that are due.
+ */
+struct timer;
+
+typedef void (*timer_fn_t)(struct timer *timer);
+
+struct timer {
+	struct rb_node node;
+	uint64_t deadline;
+	timer_fn_t fn;
+	int armed;
+};
+
+struct timerq {
+	struct rb_tree_cached tree;
+	size_t count;
+};
+
+static inline void timerq_init(struct timerq *q)
+{
+	rb_init_cached(&q->tree);
+	q->count = 0;
+}
+
+/* Sets up the timer to call fn when it expires. */
+static inline void timer_setup(struct timer *timer, timer_fn_t fn)
+{
+	timer->fn = fn;
+	timer->armed = 0;
+}
+
+static inline int timer_armed(struct timer *timer)
+{
+	return timer->armed;
+}
+
+/* Returns the timer to expire next, or NULL if the queue is empty. */
+static inline struct timer *timerq_first(struct timerq *q)
+{
+	struct rb_node *node = rb_first_cached(&q->tree);
+
+	return node ? container_of(node, struct timer, node) : NULL;
+}
+
+int timerq_arm(struct timerq *q, struct timer *timer, uint64_t deadline);
+int timerq_cancel(struct timerq *q, struct timer *timer);
+size_t timerq_expire(struct timerq *q, uint64_t now);
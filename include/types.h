@@ -48,4 +48,12 @@ enum { false, true };
 
 #define __always_inline         inline __attribute__((always_inline))
 
+/* Branch prediction hints. */
+#define likely(x)               __builtin_expect(!!(x), 1)
+#define unlikely(x)             __builtin_expect(!!(x), 0)
+
+/* Single, untorn accesses the compiler may neither merge, split nor omit. */
+#define READ_ONCE(x)            (*(const volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, val)      (*(volatile typeof(x) *)&(x) = (val))
+
 #define SIZE_MAX (~(size_t)0)
@@ -25,7 +25,12 @@
 #define FLAGS_VIP     (1 << 20)
 #define FLAGS_ID      (1 << 21)
 
+/* CPUID leaf 0x80000001 feature bits. */
+#define CPUID_EXT_EDX_PDPE1GB (1 << 26)
+#define CPUID_EXT_EDX_RDTSCP  (1 << 27)
+
 #define MSR_APIC_BASE      0x0000001b
+#define MSR_TSC_DEADLINE   0x000006e0
 
 #define MSR_EFER           0xc0000080
 #define MSR_STAR           0xc0000081
@@ -53,6 +58,17 @@ union star_reg {
 	};
 };
 
+/* Prevents the compiler from reordering memory accesses across the barrier. */
+#define barrier() asm volatile("" ::: "memory")
+
+/*
+ * x86-64 only reorders stores with later loads, so ordering loads with loads
+ * and stores with stores only requires a compiler barrier.
+ */
+#define smp_rmb() barrier()
+#define smp_wmb() barrier()
+#define smp_mb()  asm volatile("mfence" ::: "memory")
+
 static inline uint64_t read_msr(unsigned int reg)
 {
 	uint32_t lo, hi;
@@ -252,24 +268,64 @@ static inline void outsl(uint16_t port, const void *addr, size_t n)
 
 static inline uint64_t read_tsc(void)
 {
-	uint64_t ret;
-	asm volatile("rdtsc" : "=A" (ret));
-	return ret;
+	uint32_t lo, hi;
+
+	/* "=A" only means edx:eax in 32-bit mode. */
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/* Like read_tsc(), but only reads the TSC once all the earlier instructions
+ * have executed. Later instructions may still start before it.
+ */
+static inline uint64_t read_tscp(void)
+{
+	uint32_t lo, hi;
+
+	asm volatile("rdtscp" : "=a" (lo), "=d" (hi) :: "ecx");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/* Returns the index of the least significant set bit. Undefined if word is 0. */
+static inline unsigned long bsf(unsigned long word)
+{
+	asm("bsfq %1, %0" : "=r" (word) : "rm" (word) : "cc");
+
+	return word;
+}
+
+/* Returns the index of the most significant set bit. Undefined if word is 0. */
+static inline unsigned long bsr(unsigned long word)
+{
+	asm("bsrq %1, %0" : "=r" (word) : "rm" (word) : "cc");
+
+	return word;
 }
 
 static inline uint32_t xchg(volatile uint32_t *addr, uint32_t newval)
 {
 	uint32_t ret;
 
-	/* The + in "+m" denotes a read-modify-write operand. */
+	/* The + in "+m" denotes a read-modify-write operand. The memory
+	 * clobber keeps the compiler from moving other loads and stores across
+	 * the xchg, such that it can be used to take a lock.
+	 */
 	asm volatile(
 		"lock; xchgl %0, %1" :
 		"+m" (*addr), "=a" (ret) :
 		"1" (newval) :
-		"cc");
+		"memory", "cc");
 	return ret;
 }
 
+/* Tells the CPU that we are spinning, which saves power and avoids the memory
+ * order violation when leaving the loop.
+ */
+static inline void pause(void)
+{
+	asm volatile("pause" ::: "memory");
+}
+
 static inline void cpuid(unsigned long fn, uint32_t *eaxp, uint32_t *ebxp,
 	uint32_t *ecxp, uint32_t *edxp)
 {
@@ -292,5 +348,28 @@ static inline void cpuid(unsigned long fn, uint32_t *eaxp, uint32_t *ebxp,
 		*edxp = edx;
 }
 
+/* Like cpuid(), but for leaves that take a sub-leaf in %ecx. */
+static inline void cpuid_count(unsigned long fn, unsigned long subfn,
+	uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	asm volatile("cpuid" :
+		"=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) :
+		"a" (fn), "c" (subfn));
+
+	if (eaxp)
+		*eaxp = eax;
+
+	if (ebxp)
+		*ebxp = ebx;
+
+	if (ecxp)
+		*ecxp = ecx;
+
+	if (edxp)
+		*edxp = edx;
+}
+
 #endif /* !defined(__ASSEMBLER__) */
 
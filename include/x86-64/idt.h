@@ -52,6 +52,7 @@
 #define IRQ_SERIAL         36
 #define IRQ_SPURIOUS       39
 #define IRQ_IDE            46
+#define IRQ_APIC_TIMER     48
 #define IRQ_ERROR          51
 
 /* Software interrupt. */
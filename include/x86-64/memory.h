@@ -50,5 +50,14 @@
 #define UXSTACK_TOP USER_TOP
 #define USTACK_TOP (UXSTACK_TOP - 2 * PAGE_SIZE)
 
-/* The amount of memory mapped in the boot stub. */
+/* The amount of memory the kernel uses until lab 2. The boot stub maps at
+ * least this much, see boot_map_end.
+ */
 #define BOOT_MAP_LIM (8 * 1024 * 1024)
+
+/* The boot stub maps up to this many GiB with 2M pages, or up to
+ * BOOT_MAP_MAX_1G GiB with 1G pages. The last PDPT slot is left free for the
+ * ACPI window (see kernel/acpi.c).
+ */
+#define BOOT_PAGE_DIRS  4
+#define BOOT_MAP_MAX_1G 511
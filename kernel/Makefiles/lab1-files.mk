@@ -1,17 +1,46 @@
 # LAB 1 code
+
+# The rebalancing code of the red-black trees: lib for lib/rbtree_lib.c or
+# linux for lib/rbtree_linux.c, see lib/rbtree_impl.h.
+RBTREE_IMPL ?= lib
+
+ifeq ($(filter lib linux,$(RBTREE_IMPL)),)
+$(error RBTREE_IMPL must be lib or linux)
+endif
+
 KERNEL_SRCFILES := \
+	kernel/acpi.c \
+	kernel/bench.c \
 	kernel/boot.S \
 	kernel/console.c \
+	kernel/idt.c \
+	kernel/isr.S \
+	kernel/lapic.c \
 	kernel/main.c \
 	kernel/monitor.c \
 	kernel/pic.c \
 	kernel/printf.c \
+	kernel/spinlock.c \
+	kernel/timer.c \
+	kernel/trace.c \
+	kernel/mem/arena.c \
 	kernel/mem/boot.c \
 	kernel/mem/buddy.c \
+	kernel/mem/huge.c \
 	kernel/mem/init.c \
+	kernel/mem/numa.c \
+	kernel/mem/pcp.c \
+	kernel/mem/rbpool.c \
+	kernel/mem/slab.c \
+	kernel/mem/zero.c \
 	kernel/tests/lab1.c \
+	lib/btree.c \
+	lib/interval_tree.c \
 	lib/list.c \
+	lib/os_tree.c \
 	lib/printfmt.c \
 	lib/rbtree.c \
+	lib/rbtree_$(RBTREE_IMPL).c \
 	lib/readline.c \
-	lib/string.c
+	lib/string.c \
+	lib/timerq.c
@@ -0,0 +1,167 @@
+#include <types.h>
+#include <paging.h>
+#include <string.h>
+
+#include <x86-64/asm.h>
+
+#include <kernel/acpi.h>
+#include <kernel/mem.h>
+
+/* The RSDP sits on a 16-byte boundary in the first kiB of the EBDA, the
+ * segment of which is stored at EBDA_SEG, or in the BIOS ROM area.
+ */
+#define EBDA_SEG      0x40e
+#define EBDA_LEN      1024
+#define BIOS_ROM_BASE 0x0e0000
+#define BIOS_ROM_END  0x100000
+
+/*
+ * Tables outside of the direct map are read through a window of 1G mapped
+ * with 2M pages in the last slot of the PDPT the boot stub set up for the
+ * kernel. The window starts at the 2M page of the address that was last
+ * mapped.
+ */
+#define ACPI_WINDOW_SLOT PDPT_MASK
+#define ACPI_WINDOW ((char *)KERNEL_VMA + ACPI_WINDOW_SLOT * PAGE_DIR_SPAN)
+
+extern struct page_table pml4;
+
+static struct page_table acpi_dir;
+static physaddr_t rsdp_addr;
+
+static struct page_table *kernel_pdpt(void)
+{
+	return KADDR(PAGE_ADDR(pml4.entries[PML4_INDEX(KERNEL_VMA)]));
+}
+
+/* Returns the address the physical address is mapped at, which is in the
+ * direct map of the boot stub if possible. Otherwise the window is mapped at
+ * the physical address, and anything mapped through it before is no longer
+ * accessible.
+ */
+static void *acpi_map(physaddr_t pa)
+{
+	physaddr_t base = ROUNDDOWN(pa, HPAGE_SIZE);
+	size_t i;
+
+	/* Tables are far smaller than a page of the direct map. */
+	if (pa + boot_map_page_size <= boot_map_end)
+		return (char *)KERNEL_VMA + pa;
+
+	for (i = 0; i < PAGE_TABLE_ENTRIES; ++i)
+		acpi_dir.entries[i] = (base + i * HPAGE_SIZE) | PAGE_PRESENT |
+			PAGE_HUGE | PAGE_NO_EXEC;
+
+	kernel_pdpt()->entries[ACPI_WINDOW_SLOT] = PADDR(&acpi_dir) |
+		PAGE_PRESENT | PAGE_WRITE;
+	write_cr3(read_cr3());
+
+	return ACPI_WINDOW + (pa - base);
+}
+
+/* Removes the window. */
+void acpi_unmap(void)
+{
+	kernel_pdpt()->entries[ACPI_WINDOW_SLOT] = 0;
+	write_cr3(read_cr3());
+}
+
+static uint8_t checksum(const void *p, size_t len)
+{
+	const uint8_t *bytes = p;
+	uint8_t sum = 0;
+
+	while (len--)
+		sum += *bytes++;
+
+	return sum;
+}
+
+/* Scans [base, end) for the RSDP and returns its physical address, or 0 if
+ * it cannot be found.
+ */
+static physaddr_t scan_rsdp(char *low, physaddr_t base, physaddr_t end)
+{
+	struct acpi_rsdp *rsdp;
+
+	for (; base + sizeof *rsdp <= end; base += 16) {
+		rsdp = (struct acpi_rsdp *)(low + base);
+
+		if (memcmp(rsdp->signature, ACPI_RSDP_SIG, 8) == 0 &&
+		    checksum(rsdp, 20) == 0)
+			return base;
+	}
+
+	return 0;
+}
+
+/* Finds the RSDP and copies it. Returns 0 on success, or -1 if there is none. */
+static int find_rsdp(struct acpi_rsdp *rsdp)
+{
+	char *low = acpi_map(0);
+	physaddr_t ebda;
+
+	if (!rsdp_addr) {
+		ebda = (physaddr_t)*(uint16_t *)(low + EBDA_SEG) << 4;
+
+		if (ebda)
+			rsdp_addr = scan_rsdp(low, ebda, ebda + EBDA_LEN);
+
+		if (!rsdp_addr)
+			rsdp_addr = scan_rsdp(low, BIOS_ROM_BASE, BIOS_ROM_END);
+	}
+
+	if (!rsdp_addr)
+		return -1;
+
+	memcpy(rsdp, low + rsdp_addr, sizeof *rsdp);
+
+	/* Only ACPI 2.0 and later have the XSDT. */
+	if (rsdp->revision < 2 || checksum(rsdp, sizeof *rsdp) != 0)
+		rsdp->xsdt_addr = 0;
+
+	return 0;
+}
+
+/*
+ * Looks up the table with the given signature through the XSDT, or through
+ * the RSDT for ACPI 1.0.
+ *
+ * Returns the table, which stays accessible until the next call to
+ * acpi_find_table() or acpi_unmap(), or NULL if there is no such table.
+ */
+void *acpi_find_table(const char *signature)
+{
+	struct acpi_rsdp rsdp;
+	struct acpi_header *hdr;
+	physaddr_t root, pa;
+	size_t i, n, entry_size;
+
+	if (find_rsdp(&rsdp) < 0)
+		return NULL;
+
+	root = rsdp.xsdt_addr ? rsdp.xsdt_addr : rsdp.rsdt_addr;
+	entry_size = rsdp.xsdt_addr ? sizeof(uint64_t) : sizeof(uint32_t);
+	hdr = acpi_map(root);
+
+	if (checksum(hdr, hdr->length) != 0)
+		return NULL;
+
+	n = (hdr->length - sizeof *hdr) / entry_size;
+
+	/* Every table needs the window, so map the root again for every
+	 * entry.
+	 */
+	for (i = 0; i < n; ++i) {
+		hdr = acpi_map(root);
+		pa = 0;
+		memcpy(&pa, (char *)(hdr + 1) + i * entry_size, entry_size);
+		hdr = acpi_map(pa);
+
+		if (memcmp(hdr->signature, signature, 4) == 0 &&
+		    checksum(hdr, hdr->length) == 0)
+			return hdr;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,391 @@
+/*
+ * In-kernel micro-benchmarks, run from the bench command of the monitor.
+ *
+ * Every run of a benchmark is timed on its own between two reads of the TSC
+ * that are kept from being reordered with the code they surround: lfence
+ * waits for the earlier instructions to finish before the first read, and the
+ * second read is rdtscp, which waits for the body to finish, followed by
+ * another lfence to keep the code after it from starting early. Without
+ * rdtscp, the second read is an lfence-serialized rdtsc as well.
+ *
+ * The cost of these reads around an empty body is measured first and
+ * subtracted from every run, and the runs are reported as the minimum, the
+ * median and the 99th percentile of their cycles. The runs are not shielded
+ * from interrupts, which show up in the 99th percentile.
+ */
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <rbtree.h>
+
+#include <x86-64/asm.h>
+
+#include <kernel/bench.h>
+#include <kernel/mem.h>
+
+/* The pages the page_alloc benchmarks may have outstanding at any time. */
+#define BENCH_PAGES 4096
+
+/* The largest buffer of the memset and memcpy benchmarks. */
+#define BENCH_MEM_MAX (64 * 1024)
+
+/* The number of nodes in the tree of the rbtree benchmarks. */
+#define BENCH_RB_NODES 1024
+
+enum {
+	BENCH_RB_INSERT,
+	BENCH_RB_LOOKUP,
+	BENCH_RB_REMOVE,
+};
+
+struct bench_node {
+	struct rb_node node;
+	uint64_t key;
+};
+
+static int have_rdtscp = -1;
+static uint64_t samples[BENCH_RUNS];
+
+static struct page_info *bench_pages[BENCH_RUNS];
+static size_t bench_npages;
+static struct page_info *bench_chunk;
+static struct rb_tree bench_tree;
+
+static inline uint64_t bench_start(void)
+{
+	asm volatile("lfence" ::: "memory");
+	return read_tsc();
+}
+
+static inline uint64_t bench_stop(void)
+{
+	uint64_t tsc;
+
+	if (have_rdtscp) {
+		tsc = read_tscp();
+	} else {
+		asm volatile("lfence" ::: "memory");
+		tsc = read_tsc();
+	}
+
+	asm volatile("lfence" ::: "memory");
+	return tsc;
+}
+
+static void bench_detect(void)
+{
+	uint32_t max, edx = 0;
+
+	cpuid(0x80000000, &max, NULL, NULL, NULL);
+
+	if (max >= 0x80000001)
+		cpuid(0x80000001, NULL, NULL, NULL, &edx);
+
+	have_rdtscp = !!(edx & CPUID_EXT_EDX_RDTSCP);
+}
+
+static void bench_nop(uintptr_t arg, size_t i)
+{
+}
+
+/* Times body(arg, i) for every run, subtracting overhead cycles. */
+static void bench_time(void (*body)(uintptr_t, size_t), uintptr_t arg,
+	size_t runs, uint64_t overhead)
+{
+	uint64_t start, cycles;
+	size_t i;
+
+	for (i = 0; i < runs; ++i) {
+		start = bench_start();
+		body(arg, i);
+		cycles = bench_stop() - start;
+		samples[i] = cycles > overhead ? cycles - overhead : 0;
+	}
+}
+
+static void sort_samples(size_t n)
+{
+	uint64_t sample;
+	size_t i, j;
+
+	for (i = 1; i < n; ++i) {
+		sample = samples[i];
+
+		for (j = i; j > 0 && samples[j - 1] > sample; --j)
+			samples[j] = samples[j - 1];
+
+		samples[j] = sample;
+	}
+}
+
+/* Returns the fewest cycles it takes to time an empty body. */
+static uint64_t bench_overhead(void)
+{
+	bench_time(bench_nop, 0, BENCH_RUNS, 0);
+	sort_samples(BENCH_RUNS);
+
+	return samples[0];
+}
+
+/*
+ * Runs the benchmark and fills in the result. Returns 0 on success, or -1 if
+ * the benchmark has been skipped, in which case result->runs is 0.
+ */
+int bench_run(const struct bench *bench, struct bench_result *result)
+{
+	uint64_t overhead;
+	size_t runs = BENCH_RUNS;
+
+	if (have_rdtscp < 0)
+		bench_detect();
+
+	result->runs = 0;
+	overhead = bench_overhead();
+
+	if (bench->setup)
+		runs = MIN(bench->setup(bench->arg), BENCH_RUNS);
+
+	if (runs == 0) {
+		if (bench->teardown)
+			bench->teardown(bench->arg);
+
+		return -1;
+	}
+
+	bench_time(bench->body, bench->arg, runs, overhead);
+
+	if (bench->teardown)
+		bench->teardown(bench->arg);
+
+	sort_samples(runs);
+	result->runs = runs;
+	result->min = samples[0];
+	result->median = samples[runs / 2];
+	result->p99 = samples[runs * 99 / 100];
+
+	return 0;
+}
+
+static struct page_info *alloc_order(size_t order)
+{
+	if (order == BUDDY_4K_PAGE)
+		return page_alloc(0);
+
+	if (order == BUDDY_2M_PAGE)
+		return page_alloc(ALLOC_HUGE);
+
+	return buddy_find_flags(order, 0);
+}
+
+/* The number of chunks of the order the page benchmarks may keep at once. */
+static size_t page_runs(size_t order)
+{
+	size_t n = MIN(BENCH_PAGES, count_total_free_pages() / 2) >> order;
+
+	return MIN(n, BENCH_RUNS);
+}
+
+static void free_pages(uintptr_t order)
+{
+	size_t i;
+
+	for (i = 0; i < bench_npages; ++i) {
+		if (bench_pages[i])
+			page_free(bench_pages[i]);
+	}
+
+	bench_npages = 0;
+}
+
+static size_t page_alloc_setup(uintptr_t order)
+{
+	bench_npages = page_runs(order);
+	memset(bench_pages, 0, sizeof bench_pages);
+
+	return bench_npages;
+}
+
+static void page_alloc_body(uintptr_t order, size_t i)
+{
+	bench_pages[i] = alloc_order(order);
+}
+
+static size_t page_free_setup(uintptr_t order)
+{
+	size_t n = page_runs(order);
+
+	for (bench_npages = 0; bench_npages < n; ++bench_npages) {
+		bench_pages[bench_npages] = alloc_order(order);
+
+		if (!bench_pages[bench_npages])
+			break;
+	}
+
+	return bench_npages;
+}
+
+static void page_free_body(uintptr_t order, size_t i)
+{
+	page_free(bench_pages[i]);
+	bench_pages[i] = NULL;
+}
+
+/* Allocates the chunk of the smallest order that holds size bytes. */
+static void *chunk_alloc(size_t size)
+{
+	size_t order = 0;
+
+	while ((PAGE_SIZE << order) < size)
+		++order;
+
+	bench_chunk = alloc_order(order);
+
+	return bench_chunk ? page2kva(bench_chunk) : NULL;
+}
+
+static void chunk_free(uintptr_t arg)
+{
+	if (bench_chunk)
+		page_free(bench_chunk);
+
+	bench_chunk = NULL;
+}
+
+static size_t mem_setup(uintptr_t size)
+{
+	return chunk_alloc(2 * BENCH_MEM_MAX) ? BENCH_RUNS : 0;
+}
+
+static void memset_body(uintptr_t size, size_t i)
+{
+	memset(page2kva(bench_chunk), i, size);
+}
+
+static void memcpy_body(uintptr_t size, size_t i)
+{
+	char *buf = page2kva(bench_chunk);
+
+	memcpy(buf + BENCH_MEM_MAX, buf, size);
+}
+
+static int key_cmp(const void *lhs, const void *rhs)
+{
+	uint64_t a = *(const uint64_t *)lhs;
+	uint64_t b = *(const uint64_t *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+#define BENCH_RB_KEY RB_KEY_OFFSET(struct bench_node, node, key)
+
+/*
+ * Builds a tree of BENCH_RB_NODES nodes for the insertions, or of all the
+ * nodes for the lookups and removals. Multiplying by a large odd constant
+ * spreads the keys of consecutive nodes all over the tree.
+ */
+static size_t rb_setup(uintptr_t op)
+{
+	struct bench_node *nodes;
+	size_t i, n = BENCH_RB_NODES + BENCH_RUNS;
+
+	nodes = chunk_alloc(n * sizeof *nodes);
+
+	if (!nodes)
+		return 0;
+
+	rb_init(&bench_tree);
+
+	if (op == BENCH_RB_INSERT)
+		n = BENCH_RB_NODES;
+
+	for (i = 0; i < BENCH_RB_NODES + BENCH_RUNS; ++i) {
+		rb_node_init(&nodes[i].node);
+		nodes[i].key = (uint32_t)(i * 2654435761U);
+
+		if (i < n)
+			rb_insert(&bench_tree, &nodes[i].node, key_cmp,
+				BENCH_RB_KEY);
+	}
+
+	return BENCH_RUNS;
+}
+
+static void rb_body(uintptr_t op, size_t i)
+{
+	struct bench_node *nodes = page2kva(bench_chunk);
+
+	switch (op) {
+	case BENCH_RB_INSERT:
+		i += BENCH_RB_NODES;
+		rb_insert(&bench_tree, &nodes[i].node, key_cmp, BENCH_RB_KEY);
+		break;
+	case BENCH_RB_LOOKUP:
+		rb_find(&bench_tree, &nodes[i].key, key_cmp, BENCH_RB_KEY);
+		break;
+	case BENCH_RB_REMOVE:
+		rb_remove(&bench_tree, &nodes[i].node);
+		break;
+	}
+}
+
+#define BENCH_PAGE(order) \
+	{ "page_alloc/" #order, page_alloc_setup, page_alloc_body, \
+	  free_pages, order }, \
+	{ "page_free/" #order, page_free_setup, page_free_body, \
+	  free_pages, order }
+
+#define BENCH_MEM(size) \
+	{ "memset/" #size, mem_setup, memset_body, chunk_free, size }, \
+	{ "memcpy/" #size, mem_setup, memcpy_body, chunk_free, size }
+
+static const struct bench benches[] = {
+	BENCH_PAGE(0),
+	BENCH_PAGE(1),
+	BENCH_PAGE(2),
+	BENCH_PAGE(3),
+	BENCH_PAGE(4),
+	BENCH_PAGE(5),
+	BENCH_PAGE(6),
+	BENCH_PAGE(7),
+	BENCH_PAGE(8),
+	BENCH_PAGE(9),
+	BENCH_MEM(64),
+	BENCH_MEM(512),
+	BENCH_MEM(4096),
+	BENCH_MEM(65536),
+	{ "rb_insert", rb_setup, rb_body, chunk_free, BENCH_RB_INSERT },
+	{ "rb_lookup", rb_setup, rb_body, chunk_free, BENCH_RB_LOOKUP },
+	{ "rb_remove", rb_setup, rb_body, chunk_free, BENCH_RB_REMOVE },
+};
+
+#define NBENCHES (sizeof benches / sizeof *benches)
+
+/* Runs the benchmarks of which the name starts with prefix, all of them if
+ * prefix is NULL, and shows their cycles. Returns the number of benchmarks
+ * that matched.
+ */
+size_t bench_run_all(const char *prefix)
+{
+	struct bench_result result;
+	size_t i, n = 0;
+
+	for (i = 0; i < NBENCHES; ++i) {
+		if (prefix && strncmp(benches[i].name, prefix,
+		    strlen(prefix)) != 0)
+			continue;
+
+		if (n++ == 0)
+			cprintf("%-16s %5s %10s %10s %10s\n", "benchmark", "runs",
+				"min", "median", "p99");
+
+		if (bench_run(benches + i, &result) < 0) {
+			cprintf("%-16s skipped\n", benches[i].name);
+			continue;
+		}
+
+		cprintf("%-16s %5u %10llu %10llu %10llu\n", benches[i].name,
+			result.runs, result.min, result.median, result.p99);
+	}
+
+	return n;
+}
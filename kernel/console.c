@@ -4,10 +4,10 @@
 #include <assert.h>
 
 #include <kernel/console.h>
+#include <kernel/idt.h>
 #include <kernel/pic.h>
 
 static void cons_intr(int (*proc)(void));
-static void cons_putc(int c);
 
 /* Stupid I/O delay routine necessitated by historical PC design flaws */
 static void delay(void)
@@ -28,8 +28,12 @@ static void delay(void)
 #define COM_DLM         1   /* Out: Divisor Latch High (DLAB=1) */
 #define COM_IER         1   /* Out: Interrupt Enable Register */
 #define   COM_IER_RDI   0x01    /*   Enable receiver data interrupt */
+#define   COM_IER_TXRI  0x02    /*   Enable transmitter empty interrupt */
 #define COM_IIR         2   /* In:  Interrupt ID Register */
+#define   COM_IIR_NOPEND 0x01   /*   No interrupt pending */
 #define COM_FCR         2   /* Out: FIFO Control Register */
+#define   COM_FCR_ENABLE 0x01   /*   Enable the FIFOs */
+#define   COM_FCR_CLEAR 0x06    /*   Clear the RX and TX FIFOs */
 #define COM_LCR         3   /* Out: Line Control Register */
 #define   COM_LCR_DLAB  0x80    /*   Divisor latch access bit */
 #define   COM_LCR_WLEN8 0x03    /*   Wordlength: 8 bits */
@@ -42,7 +46,24 @@ static void delay(void)
 #define   COM_LSR_TXRDY 0x20    /*   Transmit buffer avail */
 #define   COM_LSR_TSRE  0x40    /*   Transmitter off */
 
+/* The number of bytes the 16550 TX FIFO takes once it reports being empty. */
+#define COM_TX_FIFO     16
+
+/* The divisor latch divides this clock down to the baud rate. */
+#define COM_BAUD_BASE   115200
+
+/* The baud rate can be set at build time with make SERIAL_BAUD=... */
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD     115200
+#endif
+
+#if SERIAL_BAUD <= 0 || SERIAL_BAUD > COM_BAUD_BASE || \
+    COM_BAUD_BASE % SERIAL_BAUD != 0
+#error "SERIAL_BAUD has to divide 115200"
+#endif
+
 static bool serial_exists;
+static bool cons_drain(bool wait);
 
 static int serial_proc_data(void)
 {
@@ -51,41 +72,69 @@ static int serial_proc_data(void)
     return inb(COM1+COM_RX);
 }
 
+/* Handles both the receiver data and the transmitter empty interrupts: the
+ * latter pushes out the next batch of buffered output. */
 void serial_intr(void)
 {
-    if (serial_exists)
+    uint8_t iir;
+
+    if (!serial_exists)
+        return;
+
+    /* The UART keeps its IRQ line raised until every pending condition has
+     * been dealt with, and the PIC only sees the next edge after that.
+     * Reading the IIR clears a pending TX empty interrupt. */
+    do {
+        iir = inb(COM1+COM_IIR);
         cons_intr(serial_proc_data);
+        cons_drain(false);
+    } while (!(iir & COM_IIR_NOPEND));
 }
 
-static void serial_putc(int c)
+/* Waits for the transmitter to be ready, or gives up after a while if wait is
+ * set. Returns whether the transmitter is ready. */
+static bool serial_txrdy(bool wait)
 {
     int i;
 
     for (i = 0;
          !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY) && i < 12800;
-         i++)
+         i++) {
+        if (!wait)
+            return false;
         delay();
+    }
 
-    outb(COM1 + COM_TX, c);
+    return true;
+}
+
+/* Writes up to COM_TX_FIFO bytes, the transmitter must be ready. */
+static void serial_write(const uint8_t *buf, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        outb(COM1 + COM_TX, buf[i]);
 }
 
 static void serial_init(void)
 {
-    /* Turn off the FIFO */
-    outb(COM1+COM_FCR, 0);
+    /* Turn on and clear the FIFOs, such that output goes out in batches */
+    outb(COM1+COM_FCR, COM_FCR_ENABLE | COM_FCR_CLEAR);
 
     /* Set speed; requires DLAB latch */
     outb(COM1+COM_LCR, COM_LCR_DLAB);
-    outb(COM1+COM_DLL, (uint8_t) (115200 / 9600));
-    outb(COM1+COM_DLM, 0);
+    outb(COM1+COM_DLL, (uint8_t) (COM_BAUD_BASE / SERIAL_BAUD));
+    outb(COM1+COM_DLM, (uint8_t) ((COM_BAUD_BASE / SERIAL_BAUD) >> 8));
 
     /* 8 data bits, 1 stop bit, parity off; turn off DLAB latch */
     outb(COM1+COM_LCR, COM_LCR_WLEN8 & ~COM_LCR_DLAB);
 
-    /* No modem controls */
-    outb(COM1+COM_MCR, 0);
-    /* Enable rcv interrupts */
-    outb(COM1+COM_IER, COM_IER_RDI);
+    /* No modem controls, but OUT2 gates the IRQ line to the PIC */
+    outb(COM1+COM_MCR, COM_MCR_OUT2);
+    /* Enable rcv and xmit empty interrupts; they are only delivered once IRQ 4
+     * is unmasked */
+    outb(COM1+COM_IER, COM_IER_RDI | COM_IER_TXRI);
 
     /* Clear any preexisting overrun indications and interrupts
      * Serial port doesn't exist if COM_LSR returns 0xFF */
@@ -93,6 +142,8 @@ static void serial_init(void)
     (void) inb(COM1+COM_IIR);
     (void) inb(COM1+COM_RX);
 
+    if (serial_exists)
+        pic_enable_irq(IRQ_SERIAL - IRQ_OFFSET);
 }
 
 
@@ -150,47 +201,80 @@ static void cga_init(void)
 
 
 
-static void cga_putc(int c)
+/* Returns where the character c leaves the cursor if it is at pos. */
+static int cga_advance(int pos, int c)
 {
-    /* If no attribute given, then use black on white. */
-    if (!(c & ~0xFF))
-        c |= 0x0700;
-
-    switch (c & 0xff) {
+    switch (c) {
     case '\b':
-        if (crt_pos > 0) {
-            crt_pos--;
-            crt_buf[crt_pos] = (c & ~0xff) | ' ';
-        }
-        break;
+        return pos > 0 ? pos - 1 : pos;
     case '\n':
-        crt_pos += CRT_COLS;
+        pos += CRT_COLS;
         /* fallthru */
     case '\r':
-        crt_pos -= (crt_pos % CRT_COLS);
-        break;
+        return pos - pos % CRT_COLS;
     case '\t':
-        cons_putc(' ');
-        cons_putc(' ');
-        cons_putc(' ');
-        cons_putc(' ');
-        cons_putc(' ');
-        break;
+        return pos + 5;
     default:
-        crt_buf[crt_pos++] = c;     /* write the character */
-        break;
+        return pos + 1;
+    }
+}
+
+/* Writes a run of characters to the screen. Positions are tracked as if the
+ * screen were unbounded, such that we know up front how many lines the run
+ * scrolls by: the screen is then scrolled once, the characters that are still
+ * visible are stored into crt_buf and the cursor is moved once at the end. */
+static void cga_write(const char *buf, size_t n)
+{
+    size_t i;
+    int pos, next, end, base, lines;
+
+    end = pos = crt_pos;
+
+    for (i = 0; i < n; i++) {
+        pos = cga_advance(pos, buf[i]);
+        end = MAX(end, pos);
     }
 
-    /* What is the purpose of this? */
-    if (crt_pos >= CRT_SIZE) {
-        int i;
+    lines = end >= CRT_SIZE ? (end - CRT_SIZE) / CRT_COLS + 1 : 0;
+    base = lines * CRT_COLS;
+
+    if (lines >= CRT_ROWS) {
+        for (pos = 0; pos < CRT_SIZE; pos++)
+            crt_buf[pos] = 0x0700 | ' ';
+    } else if (lines > 0) {
+        memmove(crt_buf, crt_buf + base,
+                (CRT_SIZE - base) * sizeof(uint16_t));
+        for (pos = CRT_SIZE - base; pos < CRT_SIZE; pos++)
+            crt_buf[pos] = 0x0700 | ' ';
+    }
+
+    pos = crt_pos;
+
+    for (i = 0; i < n; i++) {
+        next = cga_advance(pos, buf[i]);
+
+        switch (buf[i]) {
+        case '\b':
+            if (next < pos && next >= base)
+                crt_buf[next - base] = 0x0700 | ' ';
+            break;
+        case '\n':
+        case '\r':
+            break;
+        default:
+            /* Tabs are expanded to spaces. */
+            for (; pos < next; pos++)
+                if (pos >= base)
+                    crt_buf[pos - base] = 0x0700 |
+                        (buf[i] == '\t' ? ' ' : (uint8_t)buf[i]);
+            break;
+        }
 
-        memmove(crt_buf, crt_buf + CRT_COLS, (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
-        for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++)
-            crt_buf[i] = 0x0700 | ' ';
-        crt_pos -= CRT_COLS;
+        pos = next;
     }
 
+    crt_pos = MAX(pos - base, 0);
+
     /* move that little blinky thing */
     outb(addr_6845, 14);
     outb(addr_6845 + 1, crt_pos >> 8);
@@ -199,6 +283,7 @@ static void cga_putc(int c)
 }
 
 
+
 /***** Keyboard input code *****/
 
 #define NO          0
@@ -358,7 +443,7 @@ static void kbd_init(void)
 {
     /* Drain the kbd buffer so that Bochs generates interrupts. */
     kbd_intr();
-    pic_enable_irq(1);
+    pic_enable_irq(IRQ_KBD - IRQ_OFFSET);
 }
 
 
@@ -402,6 +487,9 @@ int cons_getc(void)
     serial_intr();
     kbd_intr();
 
+    /* Push out buffered output while the caller waits for input. */
+    cons_drain(false);
+
     /* grab the next character from the input buffer. */
     if (cons.rpos != cons.wpos) {
         c = cons.buf[cons.rpos++];
@@ -412,12 +500,68 @@ int cons_getc(void)
     return 0;
 }
 
-/* Output a character to the console. */
-static void cons_putc(int c)
+/* Here we manage the console output buffer. CGA is memory-mapped and written
+ * right away, while the characters for the serial and parallel ports are
+ * stashed in the buffer and drained in batches of COM_TX_FIFO whenever the
+ * UART is ready for more: from cons_write(), from the TX empty interrupt, and
+ * while polling for input. cons_flush() drains it synchronously. */
+
+#define CONSOUTSIZE 4096
+
+static struct {
+    uint8_t buf[CONSOUTSIZE];
+    uint32_t rpos;
+    uint32_t wpos;
+} cons_out;
+
+/* Sends the next batch of buffered output to the serial and parallel ports.
+ * Without wait this gives up if the UART is still busy. Returns whether a
+ * batch went out. */
+static bool cons_drain(bool wait)
+{
+    uint32_t n, i;
+
+    n = MIN(cons_out.wpos - cons_out.rpos, COM_TX_FIFO);
+    n = MIN(n, CONSOUTSIZE - cons_out.rpos % CONSOUTSIZE);
+
+    if (n == 0 || !serial_txrdy(wait))
+        return false;
+
+    serial_write(cons_out.buf + cons_out.rpos % CONSOUTSIZE, n);
+
+    for (i = 0; i < n; i++)
+        lpt_putc(cons_out.buf[(cons_out.rpos + i) % CONSOUTSIZE]);
+
+    cons_out.rpos += n;
+    return true;
+}
+
+/* Writes out all buffered output, e.g. before we panic. */
+void cons_flush(void)
+{
+    while (cons_out.rpos != cons_out.wpos)
+        cons_drain(true);
+}
+
+/* Output a run of characters to the console. */
+static void cons_write(const char *buf, size_t n)
 {
-    serial_putc(c);
-    lpt_putc(c);
-    cga_putc(c);
+    size_t i;
+
+    cga_write(buf, n);
+
+    for (i = 0; i < n; i++) {
+        if (cons_out.wpos - cons_out.rpos == CONSOUTSIZE)
+            cons_drain(true);
+
+        cons_out.buf[cons_out.wpos++ % CONSOUTSIZE] = buf[i];
+    }
+
+    /* The TX empty interrupt only comes in while we wait for input, so keep
+     * the UART busy for as long as it takes more rather than letting the
+     * output pile up behind CGA. */
+    while (cons_drain(false))
+        ;
 }
 
 /* Initialize the console devices. */
@@ -436,7 +580,26 @@ void cons_init(void)
 
 void cputchar(int c)
 {
-    cons_putc(c);
+    char ch = c;
+
+    cons_write(&ch, 1);
+}
+
+void cputs(const char *str, size_t len)
+{
+    cons_write(str, len);
+}
+
+/* Sleeps until the next interrupt, once the IDT has been set up, rather than
+ * spinning while nobody types. Interrupts are only enabled for the hlt: sti
+ * takes effect after the next instruction, so an IRQ that came in after
+ * cons_getc() polled the devices wakes up the hlt rather than being missed. */
+static void cons_wait(void)
+{
+    if (idt_ready())
+        __asm __volatile("sti; hlt; cli" ::: "memory");
+    else
+        pause();
 }
 
 int getchar(void)
@@ -444,7 +607,7 @@ int getchar(void)
     int c;
 
     while ((c = cons_getc()) == 0)
-        /* do nothing */;
+        cons_wait();
     return c;
 }
 
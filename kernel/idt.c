@@ -0,0 +1,137 @@
+#include <types.h>
+#include <assert.h>
+#include <pic.h>
+
+#include <x86-64/asm.h>
+#include <x86-64/gdt.h>
+#include <x86-64/idt.h>
+
+#include <kernel/console.h>
+#include <kernel/idt.h>
+#include <kernel/lapic.h>
+#include <kernel/pic.h>
+#include <kernel/timer.h>
+
+extern void isr_divide(void), isr_debug(void), isr_nmi(void),
+	isr_break(void), isr_overflow(void), isr_bound(void),
+	isr_invalid_op(void), isr_device(void), isr_double_fault(void),
+	isr_tss(void), isr_no_seg_present(void), isr_ss(void), isr_gpf(void),
+	isr_page_fault(void), isr_fpu(void), isr_alignment(void),
+	isr_mce(void), isr_simd(void), isr_security(void);
+
+extern void isr_irq0(void), isr_irq1(void), isr_irq2(void), isr_irq3(void),
+	isr_irq4(void), isr_irq5(void), isr_irq6(void), isr_irq7(void),
+	isr_irq8(void), isr_irq9(void), isr_irq10(void), isr_irq11(void),
+	isr_irq12(void), isr_irq13(void), isr_irq14(void), isr_irq15(void);
+
+extern void isr_apic_timer(void), isr_apic_error(void);
+
+static void (*const isr_exceptions[])(void) = {
+	[INT_DIVIDE] = isr_divide,
+	[INT_DEBUG] = isr_debug,
+	[INT_NMI] = isr_nmi,
+	[INT_BREAK] = isr_break,
+	[INT_OVERFLOW] = isr_overflow,
+	[INT_BOUND] = isr_bound,
+	[INT_INVALID_OP] = isr_invalid_op,
+	[INT_DEVICE] = isr_device,
+	[INT_DOUBLE_FAULT] = isr_double_fault,
+	[INT_TSS] = isr_tss,
+	[INT_NO_SEG_PRESENT] = isr_no_seg_present,
+	[INT_SS] = isr_ss,
+	[INT_GPF] = isr_gpf,
+	[INT_PAGE_FAULT] = isr_page_fault,
+	[INT_FPU] = isr_fpu,
+	[INT_ALIGNMENT] = isr_alignment,
+	[INT_MCE] = isr_mce,
+	[INT_SIMD] = isr_simd,
+	[INT_SECURITY] = isr_security,
+};
+
+static void (*const isr_irqs[16])(void) = {
+	isr_irq0, isr_irq1, isr_irq2, isr_irq3,
+	isr_irq4, isr_irq5, isr_irq6, isr_irq7,
+	isr_irq8, isr_irq9, isr_irq10, isr_irq11,
+	isr_irq12, isr_irq13, isr_irq14, isr_irq15,
+};
+
+static struct idt_entry idt[256] __attribute__((aligned(16)));
+
+static struct idtr idtr = {
+	.limit = sizeof idt - 1,
+	.entries = idt,
+};
+
+static int idt_loaded;
+
+/* Installs the handlers of the exceptions and of the PIC lines, and loads the
+ * IDT. Interrupts stay disabled: the kernel only enables them while it waits
+ * for input, see getchar().
+ */
+void idt_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < length_of(isr_exceptions); ++i) {
+		if (isr_exceptions[i])
+			set_idt_entry(idt + i, isr_exceptions[i],
+				IDT_PRESENT | IDT_INT_GATE32, GDT_KCODE);
+	}
+
+	for (i = 0; i < length_of(isr_irqs); ++i)
+		set_idt_entry(idt + IRQ_OFFSET + i, isr_irqs[i],
+			IDT_PRESENT | IDT_INT_GATE32, GDT_KCODE);
+
+	set_idt_entry(idt + IRQ_APIC_TIMER, isr_apic_timer,
+		IDT_PRESENT | IDT_INT_GATE32, GDT_KCODE);
+	set_idt_entry(idt + IRQ_ERROR, isr_apic_error,
+		IDT_PRESENT | IDT_INT_GATE32, GDT_KCODE);
+
+	load_idt(&idtr);
+	idt_loaded = 1;
+}
+
+/* Returns whether interrupts can be taken. */
+int idt_ready(void)
+{
+	return idt_loaded;
+}
+
+/* Called from isr_common with the frame of the interrupt. Device interrupts
+ * feed the console, whereas exceptions are fatal for now. The vectors above
+ * the PIC lines come from the local APIC, see lapic.h.
+ */
+void int_handler(struct int_frame *frame)
+{
+	int irq = frame->int_no - IRQ_OFFSET;
+
+	if (frame->int_no < IRQ_OFFSET)
+		panic("unhandled exception %lu (error %lx) at rip %p",
+			frame->int_no, frame->err_code, frame->rip);
+
+	switch (frame->int_no) {
+	case IRQ_TIMER:
+		timer_intr();
+		break;
+	case IRQ_KBD:
+		kbd_intr();
+		break;
+	case IRQ_SERIAL:
+		serial_intr();
+		break;
+	case IRQ_APIC_TIMER:
+		timer_intr();
+		lapic_eoi();
+		return;
+	case IRQ_ERROR:
+		lapic_error_intr();
+		return;
+	default:
+		/* Spurious or stray IRQs, which are masked anyway. */
+		break;
+	}
+
+	/* The master PIC acknowledges its IRQs by itself, see pic_remap(). */
+	if (irq >= 8 && irq < 16)
+		pic_eoi(irq);
+}
@@ -0,0 +1,172 @@
+#include <types.h>
+
+#include <x86-64/asm.h>
+#include <x86-64/idt.h>
+
+#include <kernel/lapic.h>
+
+/* CPUID leaf 1 feature bits. */
+#define CPUID_1_EDX_APIC   (1 << 9)
+#define CPUID_1_ECX_X2APIC (1 << 21)
+#define CPUID_1_ECX_TSC_DEADLINE (1 << 24)
+
+static int x2apic;
+static int tsc_deadline;
+
+static uint64_t lapic_read(uint32_t reg)
+{
+	return read_msr(X2APIC_MSR_BASE + (reg >> 4));
+}
+
+static void lapic_write(uint32_t reg, uint64_t val)
+{
+	write_msr(X2APIC_MSR_BASE + (reg >> 4), val);
+}
+
+/*
+ * Switches the local APIC to x2APIC mode and sets it up for virtual wire
+ * mode on top of the 8259 PIC, which pic_init() must have set up already.
+ * The timer starts out masked.
+ *
+ * Returns 0 on success, or -1 if the CPU has no x2APIC, in which case the
+ * PIC is left to deliver the interrupts directly.
+ */
+int lapic_init(void)
+{
+	uint32_t max_leaf, ecx, edx;
+	uint64_t base;
+
+	cpuid(0, &max_leaf, NULL, NULL, NULL);
+
+	if (max_leaf < 1)
+		return -1;
+
+	cpuid(1, NULL, NULL, &ecx, &edx);
+
+	if (!(edx & CPUID_1_EDX_APIC) || !(ecx & CPUID_1_ECX_X2APIC))
+		return -1;
+
+	/* A disabled APIC has to be enabled in xAPIC mode before it can be
+	 * switched to x2APIC mode.
+	 */
+	base = read_msr(MSR_APIC_BASE);
+
+	if (!(base & APIC_BASE_EN)) {
+		base |= APIC_BASE_EN;
+		write_msr(MSR_APIC_BASE, base);
+	}
+
+	write_msr(MSR_APIC_BASE, base | APIC_BASE_EXTD);
+	x2apic = 1;
+	tsc_deadline = !!(ecx & CPUID_1_ECX_TSC_DEADLINE);
+
+	lapic_write(LAPIC_SVR, APIC_SVR_ENABLE | IRQ_SPURIOUS);
+	lapic_write(LAPIC_LVT_TIMER, APIC_LVT_MASKED);
+	lapic_write(LAPIC_LVT_LINT0, APIC_LVT_EXTINT);
+	lapic_write(LAPIC_LVT_LINT1, APIC_LVT_NMI);
+	lapic_write(LAPIC_LVT_ERROR, IRQ_ERROR);
+
+	/* Clear the error status, which takes two writes, and accept every
+	 * priority.
+	 */
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_TPR, 0);
+
+	/* Acknowledge anything that may still be outstanding. */
+	lapic_eoi();
+
+	return 0;
+}
+
+/* Returns whether the local APIC is in use. */
+int lapic_enabled(void)
+{
+	return x2apic;
+}
+
+/* Returns the x2APIC ID of the CPU we are running on, or 0 without x2APIC. */
+uint32_t lapic_id(void)
+{
+	return x2apic ? lapic_read(LAPIC_ID) : 0;
+}
+
+/* Acknowledges the interrupt the local APIC is serving. A single MSR write,
+ * as opposed to port I/O to the PIC.
+ */
+void lapic_eoi(void)
+{
+	if (x2apic)
+		lapic_write(LAPIC_EOI, 0);
+}
+
+/* Sends a fixed interrupt with the vector to the CPU with the given x2APIC ID.
+ * The ICR is a single 64-bit register in x2APIC mode, so there is no need to
+ * wait for the delivery status.
+ */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector)
+{
+	if (x2apic)
+		lapic_write(LAPIC_ICR, (uint64_t)apic_id << 32 |
+			APIC_ICR_ASSERT | vector);
+}
+
+/* Starts the timer of the local APIC to raise the vector after count ticks of
+ * the bus clock divided by 16, and every count ticks thereafter if periodic.
+ */
+void lapic_timer_start(uint8_t vector, uint32_t count, int periodic)
+{
+	if (!x2apic)
+		return;
+
+	lapic_write(LAPIC_TIMER_DIV, APIC_TIMER_DIV_16);
+	lapic_write(LAPIC_LVT_TIMER, vector |
+		(periodic ? APIC_LVT_PERIODIC : 0));
+	lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+void lapic_timer_stop(void)
+{
+	if (!x2apic)
+		return;
+
+	lapic_write(LAPIC_LVT_TIMER, APIC_LVT_MASKED);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/* Returns the number of ticks left until the timer fires. */
+uint32_t lapic_timer_current(void)
+{
+	return x2apic ? lapic_read(LAPIC_TIMER_CUR) : 0;
+}
+
+/* Returns whether the timer can fire at a TSC value, see
+ * lapic_timer_deadline().
+ */
+int lapic_has_tsc_deadline(void)
+{
+	return tsc_deadline;
+}
+
+/* Has the timer raise the vector once the TSC reaches the deadline, or
+ * disarms it if the deadline is 0. There is nothing to convert between clocks
+ * in this mode.
+ */
+void lapic_timer_deadline(uint8_t vector, uint64_t deadline)
+{
+	if (!tsc_deadline)
+		return;
+
+	lapic_write(LAPIC_LVT_TIMER, vector | APIC_LVT_DEADLINE);
+
+	/* Order the mode switch before the deadline write. */
+	smp_mb();
+	write_msr(MSR_TSC_DEADLINE, deadline);
+}
+
+/* Handles the error interrupt by clearing the error status. */
+void lapic_error_intr(void)
+{
+	lapic_write(LAPIC_ESR, 0);
+	lapic_eoi();
+}
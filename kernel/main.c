@@ -1,6 +1,10 @@
 #include <kernel/console.h>
+#include <kernel/idt.h>
+#include <kernel/lapic.h>
 #include <kernel/mem.h>
 #include <kernel/monitor.h>
+#include <kernel/pic.h>
+#include <kernel/timer.h>
 
 #include <boot.h>
 #include <stdio.h>
@@ -22,28 +26,14 @@ unsigned int BlumBlumShub(unsigned int n) {
     return res;
 }
 
-void insert(struct rb_tree *tree, struct cont *new)
-{
-
-    struct rb_node *parent = NULL;
-    struct rb_node *node2 = tree->root;
-    int dir = 0;
+/* Orders the values from large to small, the order the demo has always used. */
+#define cont_cmp(a, b) RB_CMP_NUM(b, a)
 
-    while (node2) {
-        parent = node2;
-        int cur = container_of(node2, struct cont, node)->val;
-        dir = cur > new->val;
-        node2 = node2->child[dir];
-    }
-
-    if (!parent) {
-        tree->root = &new->node;
-    } else {
-        parent->child[dir] = &new->node;
-        new->node.parent = parent;
-    }
+RB_GENERATE(cont, struct cont, node, val, cont_cmp)
 
-    rb_balance(tree, &new->node);
+void insert(struct rb_tree *tree, struct cont *new)
+{
+    cont_insert(tree, new);
 }
 
 void test_rand()
@@ -72,7 +62,7 @@ void test_rand()
     }
 
     for (int i = 0; i < LEN; i++) {
-        rb_remove(&rb, &data[i].node);
+        cont_remove(&rb, data + i);
     }
 }
 
@@ -86,11 +76,21 @@ void kmain(struct boot_info *boot_info)
 	 */
 	memset(edata, 0, end - edata);
 
+	/* Set up the interrupt handlers, the PIC and the local APIC, if there
+	 * is an x2APIC, before the console, which unmasks the keyboard and
+	 * serial IRQs. */
+	idt_init();
+	pic_init();
+	lapic_init();
+
 	/* Initialize the console.
 	 * Can't call cprintf until after we do this! */
 	cons_init();
 	cprintf("\n");
 
+	/* Calibrate the TSC and set up the one-shot timer hardware. */
+	timers_init();
+
 	// GDB steps to get into the offending function:
 	// b main.c:75
 	// c
@@ -133,6 +133,9 @@ void _panic(const char *file, int line, const char *fmt,...)
 	cprintf("\n");
 	va_end(ap);
 
+	/* Don't leave the message sitting in the console output buffer. */
+	cons_flush();
+
 dead:
 	/* Break into the kernel monitor */
 	while (1)
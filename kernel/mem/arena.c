@@ -0,0 +1,119 @@
+#include <types.h>
+#include <paging.h>
+
+#include <kernel/mem.h>
+
+void arena_init(struct arena *arena, size_t order)
+{
+	arena->chunk = NULL;
+	arena->cur = NULL;
+	arena->end = NULL;
+	arena->order = order;
+	arena->nchunks = 0;
+}
+
+/* Takes a new chunk from the buddy allocator that is large enough to hold an
+ * object of the given size and alignment after the chunk header. As chunks
+ * are naturally aligned, this covers alignments up to the chunk size.
+ */
+static int arena_grow(struct arena *arena, size_t size, size_t align)
+{
+	struct arena_chunk *chunk;
+	struct page_info *page;
+	size_t need = ROUNDUP(sizeof *chunk, align) + size;
+	size_t order = arena->order;
+
+	while (order < BUDDY_MAX_ORDER && (PAGE_SIZE << order) < need)
+		++order;
+
+	if (order >= BUDDY_MAX_ORDER)
+		return -1;
+
+	page = buddy_find(order);
+
+	if (!page && page_pcp_drain() + page_zero_drain() > 0)
+		page = buddy_find(order);
+
+	if (!page)
+		return -1;
+
+	chunk = page2kva(page);
+	chunk->prev = arena->chunk;
+
+	arena->chunk = chunk;
+	arena->cur = (char *)(chunk + 1);
+	arena->end = (char *)chunk + (PAGE_SIZE << order);
+	++arena->nchunks;
+
+	return 0;
+}
+
+/* Allocates size bytes aligned to align bytes, which has to be a power of two
+ * (0 meaning pointer-sized). The memory is not initialized.
+ *
+ * Returns NULL if the alignment is invalid or if we are out of memory.
+ */
+void *arena_alloc(struct arena *arena, size_t size, size_t align)
+{
+	char *p;
+
+	if (align == 0)
+		align = sizeof(void *);
+
+	if (align & (align - 1))
+		return NULL;
+
+	p = ROUNDUP(arena->cur, align);
+
+	if (!arena->chunk || p > arena->end || size > arena->end - p) {
+		if (arena_grow(arena, size, align) < 0)
+			return NULL;
+
+		p = ROUNDUP(arena->cur, align);
+	}
+
+	arena->cur = p + size;
+
+	return p;
+}
+
+/* Saves the current position of the arena. */
+void arena_mark(struct arena *arena, struct arena_mark *mark)
+{
+	mark->chunk = arena->chunk;
+	mark->cur = arena->cur;
+}
+
+/* Frees everything that has been allocated since the mark was taken, handing
+ * the chunks taken since back to the buddy allocator.
+ */
+void arena_reset(struct arena *arena, struct arena_mark *mark)
+{
+	struct arena_chunk *chunk;
+	struct page_info *page;
+
+	while (arena->chunk != mark->chunk) {
+		chunk = arena->chunk;
+		page = pa2page(PADDR(chunk));
+		arena->chunk = chunk->prev;
+		--arena->nchunks;
+
+		page_free(page);
+	}
+
+	arena->cur = mark->cur;
+	arena->end = NULL;
+
+	if (arena->chunk) {
+		page = pa2page(PADDR(arena->chunk));
+		arena->end = (char *)arena->chunk + (PAGE_SIZE << page->pp_order);
+	}
+}
+
+/* Frees everything that has been allocated from the arena. */
+void arena_destroy(struct arena *arena)
+{
+	struct arena_mark mark = { NULL, NULL };
+
+	arena_reset(arena, &mark);
+}
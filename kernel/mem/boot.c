@@ -14,7 +14,8 @@
  *
  * IF we're out of memory, boot_alloc() should panic.
  * This function may ONLY be used during initialization, before the buddy
- * allocator has been set up.
+ * allocator has been set up. Use an arena (see kernel/mem/arena.c) for
+ * temporary allocations after that.
  */
 void *boot_alloc(uint32_t n)
 {
@@ -35,10 +36,14 @@ void *boot_alloc(uint32_t n)
 	/* Allocate a chunk large enough to hold 'n' bytes, then update
 	 * next_free. Make sure next_free is kept aligned to a multiple of
 	 * PAGE_SIZE.
-	 *
-	 * LAB 1: your code here.
 	 */
-	return NULL;
+	result = next_free;
+	next_free = ROUNDUP(next_free + n, PAGE_SIZE);
+
+	if (PADDR(next_free) > BOOT_MAP_LIM)
+		panic("boot_alloc: out of memory");
+
+	return result;
 }
 
 /* The addresses and lengths in the memory map provided by the boot loader may
@@ -2,79 +2,601 @@
 #include <list.h>
 #include <paging.h>
 #include <string.h>
+#include <rbtree.h>
 
+#include <x86-64/asm.h>
+
+#include <kernel/cpu.h>
 #include <kernel/mem.h>
+#include <kernel/trace.h>
 
 /* Physical page metadata. */
 size_t npages;
 struct page_info *pages;
 
 /*
- * List of free buddy chunks (often also referred to as buddy pages or simply
- * pages). Each order has a list containing all free buddy chunks of the
- * specific buddy order. Buddy orders go from 0 to BUDDY_MAX_ORDER - 1
+ * The memory zones. Each zone has a list of free buddy chunks (often also
+ * referred to as buddy pages or simply pages) for every migrate type and every
+ * buddy order from 0 to BUDDY_MAX_ORDER - 1, along with the number of free
+ * chunks of each order and the total number of free pages, such that the
+ * amount of free memory can be queried in constant time. Bit i of
+ * free_mask[t] is set if and only if free_list[t][i] is not empty, such that
+ * the smallest usable order can be found with a single bit scan.
+ *
+ * A free chunk is on the lists of the migrate type of its pageblock. The type
+ * of a pageblock only changes while the whole pageblock is taken off the free
+ * lists as a single chunk (see zone_find()).
+ *
+ * Every NUMA node has a zone of each type, see buddy_init().
+ */
+struct buddy_zone buddy_zones[NBUDDY_ZONES];
+
+/* The name and the physical range of every type of zone. */
+static const struct {
+	const char *name;
+	physaddr_t base;
+	physaddr_t end;
+} zone_types[NZONES] = {
+	[ZONE_DMA] = {
+		.name = "DMA",
+		.base = 0,
+		.end = ZONE_DMA_LIM,
+	},
+	[ZONE_NORMAL] = {
+		.name = "Normal",
+		.base = ZONE_DMA_LIM,
+		.end = ZONE_NORMAL_LIM,
+	},
+	[ZONE_HIGH] = {
+		.name = "High",
+		.base = ZONE_NORMAL_LIM,
+		.end = ~(physaddr_t)0,
+	},
+};
+
+/*
+ * With lazy merging enabled, freed chunks stay on the free list of their own
+ * order until that free list holds buddy_merge_threshold chunks or until an
+ * allocation cannot be satisfied, at which point the free lists are coalesced
+ * in one go. A threshold of zero means that chunks are merged eagerly.
+ */
+size_t buddy_merge_threshold;
+
+struct buddy_stats buddy_stats[NCPUS];
+
+static struct buddy_stats *this_stats(void)
+{
+	return buddy_stats + cpu_id();
+}
+
+/*
+ * Optional index of the free chunks of every zone and order by address, used
+ * to find the lowest free chunk or a free chunk within a given physical range
+ * in O(log n). The free chunks themselves hold the struct rb_node, such that
+ * the in-order position of a node follows from its (kernel virtual) address.
+ */
+static int buddy_index_enabled;
+
+/*
+ * Bitmap of the free buddies, with one bit for every pair of buddies at every
+ * order below the largest, stored in XOR form: the bit of a pair is set if
+ * exactly one of the two chunks is free at that order. Whether the buddy of a
+ * chunk is free then follows from the bit and the state of the chunk itself,
+ * without loading the struct page_info of the buddy, which is a cache miss at
+ * every level of a merge. The bitmaps take about one bit per page in total
+ * and are kept up to date by buddy_add_free() and buddy_del_free().
+ *
+ * mem_init() allocates the memory, see buddy_map_size().
+ */
+uint64_t *buddy_map;
+static size_t buddy_map_offset[BUDDY_MAX_ORDER - 1];
+
+/* The number of words of the bitmap of the given order. */
+static size_t map_words(size_t order)
+{
+	return (npages >> (order + 1)) / 64 + 1;
+}
+
+/* Returns the number of bytes the bitmaps of the free buddies take. */
+size_t buddy_map_size(void)
+{
+	size_t order, nwords = 0;
+
+	for (order = 0; order < BUDDY_MAX_ORDER - 1; ++order)
+		nwords += map_words(order);
+
+	return nwords * sizeof *buddy_map;
+}
+
+/* Returns the bit of the pair the chunk belongs to at the given order. */
+int buddy_map_test(struct page_info *page, size_t order)
+{
+	size_t bit = (page - pages) >> (order + 1);
+
+	if (order >= BUDDY_MAX_ORDER - 1)
+		return 0;
+
+	return (buddy_map[buddy_map_offset[order] + bit / 64] >> (bit % 64)) & 1;
+}
+
+static void map_toggle(struct page_info *page, size_t order)
+{
+	size_t bit = (page - pages) >> (order + 1);
+
+	if (order < BUDDY_MAX_ORDER - 1)
+		buddy_map[buddy_map_offset[order] + bit / 64] ^=
+			UINT64_C(1) << (bit % 64);
+}
+
+/* Whether the buddy of the chunk is free at the given order, given whether
+ * the chunk itself is.
+ */
+static int buddy_is_free(struct page_info *page, size_t order, int free)
+{
+	return buddy_map_test(page, order) != free;
+}
+
+static struct buddy_zone *zone_of(struct page_info *page)
+{
+	return buddy_zones + page->pp_zone;
+}
+
+/* Returns the first page of the pageblock the page belongs to, which holds the
+ * migrate type of the pageblock.
+ */
+static struct page_info *pageblock_of(struct page_info *page)
+{
+	return pages + ((page - pages) & ~(((size_t)1 << PAGEBLOCK_ORDER) - 1));
+}
+
+/* Returns the migrate type of the pageblock the page belongs to. */
+size_t buddy_pageblock_type(struct page_info *page)
+{
+	return pageblock_of(page)->pp_movable ? MIGRATE_MOVABLE :
+		MIGRATE_UNMOVABLE;
+}
+
+static void set_pageblock_type(struct page_info *page, size_t type)
+{
+	pageblock_of(page)->pp_movable = type == MIGRATE_MOVABLE;
+}
+
+/* Returns the migrate type to serve the allocation flags from. */
+static size_t migrate_type(int alloc_flags)
+{
+	return (alloc_flags & ALLOC_MOVABLE) ? MIGRATE_MOVABLE :
+		MIGRATE_UNMOVABLE;
+}
+
+static int index_cmp(const void *lhs, const void *rhs)
+{
+	return (lhs > rhs) - (lhs < rhs);
+}
+
+/* Returns the key the index uses for the chunk at the physical address. */
+static void *index_key(physaddr_t pa)
+{
+	return (void *)(pa + KERNEL_VMA);
+}
+
+static void index_add(struct page_info *page, size_t order)
+{
+	rb_insert(zone_of(page)->index + order, page2kva(page), index_cmp, 0);
+}
+
+static void index_del(struct page_info *page)
+{
+	rb_remove(zone_of(page)->index + page->pp_order, page2kva(page));
+}
+
+static struct page_info *index_page(struct rb_node *node)
+{
+	return pa2page(PADDR(node));
+}
+
+/* Marks the chunk as free and adds it to the free list of the given order. */
+static void buddy_add_free(struct page_info *page, size_t order)
+{
+	struct buddy_zone *zone = zone_of(page);
+	size_t type = buddy_pageblock_type(page);
+
+	page->pp_order = order;
+	page->pp_free = 1;
+	map_toggle(page, order);
+	list_add(zone->free_list[type] + order, &page->pp_node);
+	zone->free_mask[type] |= 1 << order;
+
+	if (buddy_index_enabled)
+		index_add(page, order);
+
+	++zone->nfree[order];
+	zone->nfree_pages += 1 << order;
+}
+
+/* Removes the chunk from the free list and marks it as in use. */
+static void buddy_del_free(struct page_info *page)
+{
+	struct buddy_zone *zone = zone_of(page);
+	size_t type = buddy_pageblock_type(page);
+
+	if (buddy_index_enabled)
+		index_del(page);
+
+	list_del(&page->pp_node);
+	page->pp_free = 0;
+	map_toggle(page, page->pp_order);
+	--zone->nfree[page->pp_order];
+
+	if (list_is_empty(zone->free_list[type] + page->pp_order))
+		zone->free_mask[type] &= ~(1 << page->pp_order);
+
+	zone->nfree_pages -= 1 << page->pp_order;
+}
+
+/* Returns the buddy of the chunk at the given order, or NULL if the buddy lies
+ * outside of the physical memory that is being tracked.
+ */
+static struct page_info *buddy_of(struct page_info *page, size_t order)
+{
+	size_t idx = (page - pages) ^ (1 << order);
+
+	if (idx >= npages)
+		return NULL;
+
+	return pages + idx;
+}
+
+/* Sets up the zones of every NUMA node along with their free lists, see
+ * numa_init(). The zones of the nodes that do not exist are left empty. The
+ * bitmaps of the free buddies must have been allocated for npages pages.
+ */
+void buddy_init(void)
+{
+	struct buddy_zone *zone;
+	struct numa_node *node;
+	size_t order, type, offset = 0;
+
+	/* The index of the zone has to fit in pp_zone. */
+	static_assert(NBUDDY_ZONES <= 16);
+
+	for (order = 0; order < BUDDY_MAX_ORDER - 1; ++order) {
+		buddy_map_offset[order] = offset;
+		offset += map_words(order);
+	}
+
+	memset(buddy_map, 0, buddy_map_size());
+
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		type = (zone - buddy_zones) % NZONES;
+		zone->node = (zone - buddy_zones) / NZONES;
+		zone->name = zone_types[type].name;
+		zone->base = 0;
+		zone->end = 0;
+
+		if (zone->node < nnuma_nodes) {
+			node = numa_nodes + zone->node;
+			zone->base = MAX(zone_types[type].base, node->base);
+			zone->end = MIN(zone_types[type].end, node->end);
+			zone->end = MAX(zone->base, zone->end);
+		}
+
+		spin_init(&zone->lock, zone->name);
+
+		for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
+			for (type = 0; type < NMIGRATE_TYPES; ++type)
+				list_init(zone->free_list[type] + order);
+
+			rb_init(zone->index + order);
+			zone->nfree[order] = 0;
+		}
+
+		for (type = 0; type < NMIGRATE_TYPES; ++type)
+			zone->free_mask[type] = 0;
+
+		zone->nfree_pages = 0;
+		zone->npages = 0;
+		zone->reserve = 0;
+		zone->nfallbacks = 0;
+		zone->nsteals = 0;
+		zone->nclaims = 0;
+	}
+}
+
+/* Returns the zone the physical address belongs to. */
+size_t buddy_zone_of(physaddr_t pa)
+{
+	size_t i;
+
+	for (i = 0; i < NZONES - 1; ++i) {
+		if (pa < zone_types[i].end)
+			break;
+	}
+
+	return numa_node_of(pa) * NZONES + i;
+}
+
+/* Sets the number of pages the zone keeps back from fallback allocations. */
+void buddy_zone_set_reserve(size_t zone, size_t reserve)
+{
+	if (zone < NBUDDY_ZONES)
+		buddy_zones[zone].reserve = reserve;
+}
+
+/* Gives every zone that higher zones with memory on the same node fall back
+ * to the default reserve, capped at an eighth of its memory. Zones that are
+ * not a fallback for anything keep nothing back.
+ */
+void buddy_zone_default_reserves(void)
+{
+	size_t i, j, lim;
+
+	for (i = 0; i < NBUDDY_ZONES; ++i) {
+		buddy_zones[i].reserve = 0;
+		lim = ROUNDUP(i + 1, NZONES);
+
+		for (j = i + 1; j < lim; ++j) {
+			if (buddy_zones[j].npages)
+				break;
+		}
+
+		if (j < lim)
+			buddy_zones[i].reserve = MIN((size_t)ZONE_RESERVE,
+				buddy_zones[i].npages / 8);
+	}
+}
+
+/*
+ * Fills in the zones to try for the allocation flags, starting with the
+ * preferred zone on the preferred node, followed by the lower zones of that
+ * node and then by the same zones of every other node in turn.
+ *
+ * Returns the number of zones.
+ */
+static size_t zonelist(int alloc_flags, size_t node, struct buddy_zone **zones)
+{
+	size_t top = ZONE_NORMAL, zone, i, n = 0;
+
+	if (alloc_flags & ALLOC_DMA)
+		top = ZONE_DMA;
+	else if (alloc_flags & ALLOC_HIGH)
+		top = ZONE_HIGH;
+
+	for (i = 0; i < nnuma_nodes; ++i, node = (node + 1) % nnuma_nodes) {
+		zone = top;
+
+		do {
+			zones[n++] = buddy_zones + node * NZONES + zone;
+		} while (zone-- > ZONE_DMA);
+	}
+
+	return n;
+}
+
+/* Whether the zone may serve an allocation of the given order, which is only
+ * the case for fallback allocations while the zone is above its reserve.
  */
-struct list buddy_free_list[BUDDY_MAX_ORDER];
+static int zone_allowed(struct buddy_zone *zone, size_t order, int fallback)
+{
+	return !fallback || zone->nfree_pages >= zone->reserve + (1 << order);
+}
 
 /* Counts the number of free pages for the given order.
  */
 size_t count_free_pages(size_t order)
 {
-	struct list *node;
-	size_t nfree_pages = 0;
+	size_t i, nfree = 0;
 
 	if (order >= BUDDY_MAX_ORDER) {
 		return 0;
 	}
 
-	list_foreach(buddy_free_list + order, node) {
-		++nfree_pages;
+	for (i = 0; i < NBUDDY_ZONES; ++i)
+		nfree += buddy_zones[i].nfree[order];
+
+	return nfree;
+}
+
+/*
+ * Returns the fragmentation index of the given order in thousandths, i.e. to
+ * what extent an allocation of that order would fail because the free memory
+ * is fragmented rather than because there is too little of it: values towards
+ * 0 mean there is too little free memory, values towards 1000 that it is
+ * spread over too many small chunks. Returns -1000 if there is a free chunk of
+ * at least the given order, as an allocation would not fail at all.
+ */
+int buddy_fragmentation_index(size_t order)
+{
+	size_t i, n, nchunks = 0, nfree_pages = 0;
+	int frag;
+
+	for (i = 0; i < BUDDY_MAX_ORDER; ++i) {
+		n = count_free_pages(i);
+
+		if (n && i >= order)
+			return -1000;
+
+		nchunks += n;
+		nfree_pages += n << i;
 	}
 
-	return nfree_pages;
+	if (!nchunks)
+		return 0;
+
+	frag = 1000 - (int)((1000 + nfree_pages * 1000 / (1 << order)) /
+		nchunks);
+
+	return MAX(frag, 0);
 }
 
 /* Shows the number of free pages in the buddy allocator as well as the amount
- * of free memory in kiB.
+ * of free memory in kiB, along with the fragmentation index of every order
+ * that cannot be allocated right now.
  *
  * Use this function to diagnose your buddy allocator.
  */
 void show_buddy_info(void)
 {
-	struct page_info *page;
-	struct list *node;
+	struct buddy_zone *zone;
 	size_t order;
 	size_t nfree_pages;
 	size_t nfree = 0;
+	size_t navoided = 0, ncoalesced = 0;
+
+	int frag;
 
 	cprintf("Buddy allocator:\n");
 
 	for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
 		nfree_pages = count_free_pages(order);
+		frag = buddy_fragmentation_index(order);
 
-		cprintf("  order #%u pages=%u\n", order, nfree_pages);
+		if (frag < 0)
+			cprintf("  order #%u pages=%u\n", order, nfree_pages);
+		else
+			cprintf("  order #%u pages=%u frag=%u.%03u\n", order,
+				nfree_pages, frag / 1000, frag % 1000);
 
 		nfree += nfree_pages * (1 << (order + 12));
 	}
 
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		if (!zone->npages)
+			continue;
+
+		cprintf("  node %u zone %s pages=%u free=%u reserve=%u "
+			"fallbacks=%u claims=%u steals=%u\n", zone->node,
+			zone->name, zone->npages,
+			zone->nfree_pages, zone->reserve, zone->nfallbacks,
+			zone->nclaims, zone->nsteals);
+	}
+
+	cprintf("  per-CPU cached pages=%u\n", count_pcp_pages());
+	show_zero_info();
+	show_huge_info();
+
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		navoided += zone->nmerges_avoided;
+		ncoalesced += zone->nmerges_coalesced;
+	}
+
+	if (buddy_merge_threshold)
+		cprintf("  lazy merge threshold=%u avoided=%u coalesced=%u\n",
+			buddy_merge_threshold, navoided, ncoalesced);
+
 	cprintf("  free: %u kiB\n", nfree / 1024);
 }
 
-/* Gets the total amount of free pages. */
-size_t count_total_free_pages(void)
+/* Adds up the counters of all the CPUs. */
+static void sum_stats(struct buddy_stats *sum)
 {
-	struct page_info *page;
-	struct list *node;
-	size_t order;
-	size_t nfree_pages;
-	size_t nfree = 0;
+	struct buddy_stats *stats;
+	size_t cpu, i;
+
+	memset(sum, 0, sizeof *sum);
+
+	for (cpu = 0; cpu < NCPUS; ++cpu) {
+		stats = buddy_stats + cpu;
+
+		for (i = 0; i < BUDDY_MAX_ORDER; ++i) {
+			sum->nallocs[i] += stats->nallocs[i];
+			sum->nfrees[i] += stats->nfrees[i];
+		}
+
+		for (i = 0; i < MEMSTAT_NBUCKETS; ++i)
+			sum->alloc_hist[i] += stats->alloc_hist[i];
+
+		sum->nfailed += stats->nfailed;
+		sum->nsplits += stats->nsplits;
+		sum->nmerges += stats->nmerges;
+		sum->alloc_cycles += stats->alloc_cycles;
+		sum->alloc_max = MAX(sum->alloc_max, stats->alloc_max);
+		sum->free_cycles += stats->free_cycles;
+		sum->free_max = MAX(sum->free_max, stats->free_max);
+	}
+}
+
+/* Shows the allocation and free counts of every order, along with the average
+ * and maximum number of cycles spent in page_alloc() and page_free(), a
+ * histogram of the allocation latencies and the usage of the zone locks.
+ */
+void show_mem_stats(void)
+{
+	struct buddy_stats sum, *stats = &sum;
+	struct buddy_zone *zone;
+	struct spinlock *lock;
+	size_t order, i, nallocs = 0, nfrees = 0;
+
+	sum_stats(&sum);
+
+	cprintf("Page allocator:\n");
 
 	for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
-		nfree_pages = count_free_pages(order);
-		nfree += nfree_pages * (1 << order);
+		nallocs += stats->nallocs[order];
+		nfrees += stats->nfrees[order];
+
+		if (!stats->nallocs[order] && !stats->nfrees[order])
+			continue;
+
+		cprintf("  order #%u allocs=%u frees=%u\n", order,
+			stats->nallocs[order], stats->nfrees[order]);
 	}
 
-	return nfree;
+	cprintf("  failed allocs=%u splits=%u merges=%u\n", stats->nfailed,
+		stats->nsplits, stats->nmerges);
+	cprintf("  page_alloc cycles avg=%lu max=%lu\n",
+		nallocs ? stats->alloc_cycles / nallocs : 0, stats->alloc_max);
+	cprintf("  page_free cycles avg=%lu max=%lu\n",
+		nfrees ? stats->free_cycles / nfrees : 0, stats->free_max);
+	cprintf("  page_alloc latency (cycles):\n");
+
+	for (i = 0; i < MEMSTAT_NBUCKETS; ++i) {
+		if (!stats->alloc_hist[i])
+			continue;
+
+		if (i == MEMSTAT_NBUCKETS - 1)
+			cprintf("    >= %8lu: %u\n",
+				1ul << (i + MEMSTAT_MIN_SHIFT), stats->alloc_hist[i]);
+		else
+			cprintf("    < %9lu: %u\n",
+				1ul << (i + MEMSTAT_MIN_SHIFT + 1),
+				stats->alloc_hist[i]);
+	}
+
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		lock = &zone->lock;
+
+		if (!lock->nacquired)
+			continue;
+
+		cprintf("  node %u zone %s lock acquired=%u contended=%u "
+			"spin avg=%lu hold avg=%lu max=%lu\n", zone->node,
+			zone->name,
+			lock->nacquired, lock->ncontended,
+			lock->ncontended ? lock->spin_cycles / lock->ncontended : 0,
+			lock->hold_cycles / lock->nacquired, lock->hold_max);
+	}
+}
+
+/* Clears the counters shown by show_mem_stats(). */
+void reset_mem_stats(void)
+{
+	size_t i;
+
+	memset(buddy_stats, 0, sizeof buddy_stats);
+
+	for (i = 0; i < NBUDDY_ZONES; ++i)
+		spin_reset_stats(&buddy_zones[i].lock);
+}
+
+/* Gets the total amount of free pages. */
+size_t count_total_free_pages(void)
+{
+	size_t i, nfree_pages = 0;
+
+	for (i = 0; i < NBUDDY_ZONES; ++i)
+		nfree_pages += buddy_zones[i].nfree_pages;
+
+	return nfree_pages;
 }
 
 /* Splits lhs into free pages until the order of the page is the requested
@@ -88,10 +610,21 @@ size_t count_total_free_pages(void)
  *
  * Returns a page of the requested order.
  */
- struct page_info *buddy_split(struct page_info *lhs, size_t req_order)
+struct page_info *buddy_split(struct page_info *lhs, size_t req_order)
 {
-	/* LAB 1: your code here. */
-	return NULL;
+	struct page_info *rhs;
+	size_t order = lhs->pp_order;
+
+	while (order > req_order) {
+		--order;
+		rhs = buddy_of(lhs, order);
+		lhs->pp_order = order;
+		buddy_add_free(rhs, order);
+		++this_stats()->nsplits;
+		trace(TRACE_BUDDY_SPLIT, page2pa(lhs), order);
+	}
+
+	return lhs;
 }
 
 /* Merges the buddy of the page with the page if the buddy is free to form
@@ -101,8 +634,8 @@ size_t count_total_free_pages(void)
  * The algorithm to merge pages is as follows:
  *  - Given the page of order k, locate the page with the lowest address
  *    and its buddy of order k.
- *  - Check if both the page and the buddy are free and whether the order
- *    matches.
+ *  - Check if the buddy is free at order k, which the bitmap of free buddies
+ *    tells without touching the struct page_info of the buddy.
  *  - Remove the page and its buddy from the free list.
  *  - Increment the order of the page.
  *  - Repeat until the maximum order has been reached or until the buddy is not
@@ -112,54 +645,938 @@ size_t count_total_free_pages(void)
  */
 struct page_info *buddy_merge(struct page_info *page)
 {
-	/* LAB 1: your code here. */
-	return NULL;
+	struct page_info *buddy;
+	size_t order = page->pp_order;
+
+	while (order < BUDDY_MAX_ORDER - 1) {
+		buddy = buddy_of(page, order);
+
+		if (!buddy || !buddy_is_free(page, order, 0))
+			break;
+
+		buddy_del_free(buddy);
+
+		if (buddy < page)
+			page = buddy;
+
+		page->pp_order = ++order;
+		++this_stats()->nmerges;
+		trace(TRACE_BUDDY_MERGE, page2pa(page), order);
+	}
+
+	return page;
 }
 
-/* Given the order req_order, attempts to find a page of that order or a larger
- * order in the free list. In case the order of the free page is larger than the
- * requested order, the page is split down to the requested order using
- * buddy_split().
+/* Merges all pairs of free buddies found on the free lists of the zone,
+ * starting at the given order and working upwards, such that chunks merged at
+ * one order are considered again at the next order.
  *
- * Returns a page of the requested order or NULL if no such page can be found.
+ * Returns the number of merges performed.
  */
-struct page_info *buddy_find(size_t req_order)
+static size_t zone_coalesce(struct buddy_zone *zone, size_t order)
 {
-	/* LAB 1: your code here. */
-	return NULL;
+	struct page_info *page, *buddy;
+	struct list *head, *node, *next;
+	size_t type, nmerged = 0;
+
+	/* Buddies share their pageblock and thus their free list. */
+	for (; order < BUDDY_MAX_ORDER - 1; ++order) {
+		for (type = 0; type < NMIGRATE_TYPES; ++type) {
+			head = zone->free_list[type] + order;
+
+			for (node = list_head(head); node; node = next) {
+				next = list_next(head, node);
+				page = container_of(node, struct page_info,
+					pp_node);
+				buddy = buddy_of(page, order);
+
+				if (!buddy || !buddy_is_free(page, order, 1))
+					continue;
+
+				if (next == &buddy->pp_node)
+					next = list_next(head, next);
+
+				buddy_del_free(page);
+				buddy_del_free(buddy);
+				buddy_add_free(buddy < page ? buddy : page,
+					order + 1);
+				trace(TRACE_BUDDY_MERGE,
+					page2pa(buddy < page ? buddy : page), order + 1);
+				++nmerged;
+			}
+		}
+	}
+
+	zone->nmerges_coalesced += nmerged;
+	this_stats()->nmerges += nmerged;
+
+	return nmerged;
 }
 
-/*
- * Allocates a physical page.
- *
- * if (alloc_flags & ALLOC_ZERO), fills the entire returned physical page with
- * '\0' bytes.
- * if (alloc_flags & ALLOC_HUGE), returns a huge physical 2M page.
- *
- * Beware: this function does NOT increment the reference count of the page -
- * this is the caller's responsibility.
- *
- * Returns NULL if out of free memory.
+/* Coalesces the free lists of all zones, see zone_coalesce().
  *
- * Hint: use buddy_find() to find a free page of the right order.
- * Hint: use page2kva() and memset() to clear the page.
+ * Returns the number of merges performed.
  */
-struct page_info *page_alloc(int alloc_flags)
+size_t buddy_coalesce(size_t order)
 {
-	/* LAB 1: your code here. */
-	return NULL;
+	size_t i, nmerged = 0;
+
+	for (i = 0; i < NBUDDY_ZONES; ++i) {
+		spin_lock(&buddy_zones[i].lock);
+		nmerged += zone_coalesce(buddy_zones + i, order);
+		spin_unlock(&buddy_zones[i].lock);
+	}
+
+	return nmerged;
 }
 
-/*
- * Return a page to the free list.
- * (This function should only be called when pp->pp_ref reaches 0.)
+/* Sets the number of free chunks an order may accumulate before the free
+ * lists get coalesced, or zero to merge chunks eagerly on every free. Leaving
+ * lazy merging coalesces the free lists completely.
  *
- * Hint: mark the page as free and use buddy_merge() to merge the free page
- * with its buddies before returning the page to the free list.
+ * Returns the previous threshold.
  */
-void page_free(struct page_info *pp)
+size_t buddy_set_merge_threshold(size_t threshold)
 {
-	/* LAB 1: your code here. */
+	size_t old = buddy_merge_threshold;
+
+	buddy_merge_threshold = threshold;
+
+	if (!threshold)
+		buddy_coalesce(0);
+
+	return old;
+}
+
+/* Takes the first chunk off the free list of the given type and order. */
+static struct page_info *zone_take(struct buddy_zone *zone, size_t type,
+	size_t order)
+{
+	struct page_info *page;
+
+	page = container_of(list_head(zone->free_list[type] + order),
+		struct page_info, pp_node);
+	buddy_del_free(page);
+
+	return page;
+}
+
+/* Given the order req_order, attempts to find a page of that order or a larger
+ * order in the free lists of the zone. In case the order of the free page is
+ * larger than the requested order, the page is split down to the requested
+ * order using buddy_split().
+ *
+ * The page is taken from the free lists of the given migrate type if possible.
+ * Otherwise a whole free pageblock of another type is claimed for the type,
+ * and as a last resort the largest free chunk of another type is stolen,
+ * leaving the type of its pageblock as it is.
+ *
+ * Returns a page of the requested order or NULL if no such page can be found.
+ */
+static struct page_info *zone_find(struct buddy_zone *zone, size_t req_order,
+	size_t type)
+{
+	struct page_info *page;
+	uint32_t mask, req_mask = ~((1 << req_order) - 1);
+	size_t other;
+
+	/* Find the smallest non-empty order that is at least req_order. */
+	mask = zone->free_mask[type] & req_mask;
+
+	/* Free chunks that have not been merged yet may add up to a large
+	 * enough chunk.
+	 */
+	if (!mask && buddy_merge_threshold && zone_coalesce(zone, 0) > 0)
+		mask = zone->free_mask[type] & req_mask;
+
+	if (mask)
+		return buddy_split(zone_take(zone, type, bsf(mask)), req_order);
+
+	for (other = 0; other < NMIGRATE_TYPES; ++other) {
+		if (other == type ||
+		    !(zone->free_mask[other] & (1 << PAGEBLOCK_ORDER)))
+			continue;
+
+		page = zone_take(zone, other, PAGEBLOCK_ORDER);
+		set_pageblock_type(page, type);
+		++zone->nclaims;
+
+		return buddy_split(page, req_order);
+	}
+
+	for (other = 0; other < NMIGRATE_TYPES; ++other) {
+		mask = zone->free_mask[other] & req_mask;
+
+		if (other == type || !mask)
+			continue;
+
+		page = zone_take(zone, other, bsr(mask));
+		++zone->nsteals;
+
+		return buddy_split(page, req_order);
+	}
+
+	return NULL;
+}
+
+/* Finds a page of the requested order in the zones the allocation flags
+ * allow, starting on the given node, see zonelist().
+ *
+ * Returns a page of the requested order or NULL if no such page can be found.
+ */
+struct page_info *buddy_find_node(size_t req_order, int alloc_flags,
+	size_t node)
+{
+	struct buddy_zone *zones[NBUDDY_ZONES];
+	struct page_info *page;
+	size_t i, n;
+
+	if (req_order >= BUDDY_MAX_ORDER)
+		return NULL;
+
+	n = zonelist(alloc_flags, node, zones);
+
+	for (i = 0; i < n; ++i) {
+		spin_lock(&zones[i]->lock);
+		page = NULL;
+
+		if (zone_allowed(zones[i], req_order, i > 0))
+			page = zone_find(zones[i], req_order,
+				migrate_type(alloc_flags));
+
+		zones[i]->nfallbacks += page && i > 0;
+		spin_unlock(&zones[i]->lock);
+
+		if (page)
+			return page;
+	}
+
+	return NULL;
+}
+
+/* Like buddy_find_node(), starting on the node of the current CPU. */
+struct page_info *buddy_find_flags(size_t req_order, int alloc_flags)
+{
+	return buddy_find_node(req_order, alloc_flags, numa_local_node());
+}
+
+/* Given the order req_order, attempts to find a page of that order or a larger
+ * order in the free lists of the normal zone, falling back to the DMA zone.
+ *
+ * Returns a page of the requested order or NULL if no such page can be found.
+ */
+struct page_info *buddy_find(size_t req_order)
+{
+	return buddy_find_flags(req_order, 0);
+}
+
+/*
+ * Enables or disables the address index of the free chunks. The index is
+ * built from the free lists when it is enabled.
+ *
+ * Returns whether the index was enabled before.
+ */
+int buddy_index_enable(int enable)
+{
+	int was_enabled = buddy_index_enabled;
+	struct buddy_zone *zone;
+	struct page_info *page;
+	struct list *node;
+	size_t order, type;
+
+	if (!enable == !was_enabled)
+		return was_enabled;
+
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		spin_lock(&zone->lock);
+
+		for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
+			rb_init(zone->index + order);
+
+			if (!enable)
+				continue;
+
+			for (type = 0; type < NMIGRATE_TYPES; ++type) {
+				list_foreach(zone->free_list[type] + order, node) {
+					page = container_of(node, struct page_info,
+						pp_node);
+					index_add(page, order);
+				}
+			}
+		}
+
+		spin_unlock(&zone->lock);
+	}
+
+	buddy_index_enabled = enable;
+
+	return was_enabled;
+}
+
+/* Splits the free chunk, which must have been taken off the free lists, down
+ * to the requested order, keeping the piece that contains target and putting
+ * the other halves back on the free lists.
+ *
+ * Returns the piece that contains target.
+ */
+static struct page_info *buddy_split_at(struct page_info *page,
+	size_t req_order, struct page_info *target)
+{
+	struct page_info *rhs;
+	size_t order = page->pp_order;
+
+	while (order > req_order) {
+		--order;
+		rhs = page + (1 << order);
+
+		if (target >= rhs) {
+			buddy_add_free(page, order);
+			page = rhs;
+		} else {
+			buddy_add_free(rhs, order);
+		}
+
+		page->pp_order = order;
+		++this_stats()->nsplits;
+		trace(TRACE_BUDDY_SPLIT, page2pa(page), order);
+	}
+
+	return page;
+}
+
+/*
+ * Finds the free chunk with the lowest address that is at least of the given
+ * order and splits off its lowest piece of the requested order. This keeps
+ * allocations packed towards the bottom of every zone, which makes it more
+ * likely for large free chunks to form at the top. The zones are tried in the
+ * same order as for buddy_find_flags(). Requires the address index.
+ *
+ * Returns a page of the requested order or NULL if no such page can be found.
+ */
+struct page_info *buddy_find_lowest(size_t req_order, int alloc_flags)
+{
+	struct buddy_zone *zones[NBUDDY_ZONES];
+	struct rb_node *node, *lowest;
+	struct page_info *page;
+	size_t i, n, order;
+
+	if (!buddy_index_enabled || req_order >= BUDDY_MAX_ORDER)
+		return NULL;
+
+	n = zonelist(alloc_flags, numa_local_node(), zones);
+
+	for (i = 0; i < n; ++i) {
+		spin_lock(&zones[i]->lock);
+
+		if (!zone_allowed(zones[i], req_order, i > 0)) {
+			spin_unlock(&zones[i]->lock);
+			continue;
+		}
+
+		lowest = NULL;
+
+		for (order = req_order; order < BUDDY_MAX_ORDER; ++order) {
+			node = rb_first(zones[i]->index + order);
+
+			if (node && (!lowest || node < lowest))
+				lowest = node;
+		}
+
+		/* Free chunks that have not been merged yet may add up to a
+		 * large enough chunk.
+		 */
+		if (!lowest && buddy_merge_threshold &&
+		    zone_coalesce(zones[i], 0) > 0) {
+			spin_unlock(&zones[i]->lock);
+			return buddy_find_lowest(req_order, alloc_flags);
+		}
+
+		if (lowest) {
+			zones[i]->nfallbacks += i > 0;
+			page = index_page(lowest);
+			buddy_del_free(page);
+			page = buddy_split(page, req_order);
+			spin_unlock(&zones[i]->lock);
+
+			return page;
+		}
+
+		spin_unlock(&zones[i]->lock);
+	}
+
+	return NULL;
+}
+
+/* Finds a free chunk of the requested order within [lo, hi) in the zone, see
+ * buddy_find_range().
+ */
+static struct page_info *zone_find_range(struct buddy_zone *zone,
+	size_t req_order, physaddr_t lo, physaddr_t hi)
+{
+	struct rb_node *node;
+	struct page_info *page;
+	physaddr_t pa, start;
+	size_t order, size = PAGE_SIZE << req_order, chunk_size;
+
+	for (order = req_order; order < BUDDY_MAX_ORDER; ++order) {
+		chunk_size = PAGE_SIZE << order;
+
+		/* The first chunk that ends after lo, if any, either contains lo
+		 * or starts after it, and so does the one after that.
+		 */
+		node = rb_lower_bound(zone->index + order,
+			index_key(ROUNDDOWN(lo, chunk_size)), index_cmp, 0);
+
+		for (; node; node = rb_next(node)) {
+			pa = PADDR(node);
+			start = MAX(pa, lo);
+
+			if (start >= hi || hi - start < size)
+				break;
+
+			if (start + size <= pa + chunk_size) {
+				page = index_page(node);
+				buddy_del_free(page);
+
+				return buddy_split_at(page, req_order, pa2page(start));
+			}
+		}
+	}
+
+	if (buddy_merge_threshold && zone_coalesce(zone, 0) > 0)
+		return zone_find_range(zone, req_order, lo, hi);
+
+	return NULL;
+}
+
+/*
+ * Finds a free chunk of the requested order that lies entirely within the
+ * physical range [lo, hi), preferring the lowest address at every order.
+ * Zone reserves do not apply, as the caller asks for specific memory.
+ * Requires the address index.
+ *
+ * Returns a page of the requested order or NULL if no such page can be found.
+ */
+struct page_info *buddy_find_range(size_t req_order, physaddr_t lo,
+	physaddr_t hi)
+{
+	struct buddy_zone *zone;
+	struct page_info *page;
+
+	if (!buddy_index_enabled || req_order >= BUDDY_MAX_ORDER)
+		return NULL;
+
+	lo = ROUNDUP(lo, PAGE_SIZE << req_order);
+
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		if (zone->end <= lo || zone->base >= hi)
+			continue;
+
+		spin_lock(&zone->lock);
+		page = zone_find_range(zone, req_order, MAX(lo, zone->base),
+			MIN(hi, zone->end));
+		spin_unlock(&zone->lock);
+
+		if (page)
+			return page;
+	}
+
+	return NULL;
+}
+
+static void stats_alloc(size_t order, int success, uint64_t cycles)
+{
+	struct buddy_stats *stats = this_stats();
+	size_t bucket = 0;
+
+	if (!success) {
+		++stats->nfailed;
+		return;
+	}
+
+	if (cycles >> (MEMSTAT_MIN_SHIFT + 1))
+		bucket = MIN(bsr(cycles) - MEMSTAT_MIN_SHIFT,
+			(size_t)MEMSTAT_NBUCKETS - 1);
+
+	++stats->nallocs[order];
+	++stats->alloc_hist[bucket];
+	stats->alloc_cycles += cycles;
+	stats->alloc_max = MAX(stats->alloc_max, cycles);
+}
+
+static void stats_free(size_t order, uint64_t cycles)
+{
+	struct buddy_stats *stats = this_stats();
+
+	++stats->nfrees[order];
+	stats->free_cycles += cycles;
+	stats->free_max = MAX(stats->free_max, cycles);
+}
+
+/* Serves page_alloc_node(), see below. */
+static struct page_info *do_page_alloc(size_t node, int alloc_flags)
+{
+	struct page_info *page;
+	size_t order = (alloc_flags & ALLOC_HUGE) ? BUDDY_2M_PAGE : BUDDY_4K_PAGE;
+	int local = node == numa_local_node();
+
+	/* Serve ALLOC_ZERO requests from the pre-zeroed pool if possible. The
+	 * pools and the per-CPU caches may hold pages from any zone, so they
+	 * only serve allocations that prefer the local node.
+	 */
+	if (local && (alloc_flags & ALLOC_ZERO) && !(alloc_flags & ALLOC_DMA)) {
+		page = page_zero_alloc(order);
+
+		if (page)
+			return page;
+	}
+
+	page = NULL;
+
+	/* Serve ALLOC_HUGE requests from the reserved 2M chunks first. */
+	if (local && (alloc_flags & ALLOC_HUGE) && !(alloc_flags & ALLOC_DMA))
+		page = page_huge_alloc();
+
+	if (local && !page && (alloc_flags & ALLOC_LOW))
+		page = buddy_find_lowest(order, alloc_flags);
+
+	/* The per-CPU caches only hold pages of unmovable pageblocks. */
+	if (local && !page && order == BUDDY_4K_PAGE &&
+	    !(alloc_flags & (ALLOC_DMA | ALLOC_MOVABLE)))
+		page = page_pcp_alloc(alloc_flags);
+
+	if (!page)
+		page = buddy_find_node(order, alloc_flags, node);
+
+	/* The pages sitting in the per-CPU caches may be what keeps us from
+	 * finding a large enough chunk.
+	 */
+	if (!page && page_pcp_drain() + page_zero_drain() > 0)
+		page = buddy_find_node(order, alloc_flags, node);
+
+	/* Set up more of the memory that page_init() left for later. */
+	while (!page && page_init_deferred(1) > 0)
+		page = buddy_find_node(order, alloc_flags, node);
+
+	if (!page)
+		return NULL;
+
+	if (alloc_flags & ALLOC_ZERO)
+		memset(page2kva(page), 0, PAGE_SIZE << order);
+
+	return page;
+}
+
+/*
+ * Allocates a physical page.
+ *
+ * if (alloc_flags & ALLOC_ZERO), fills the entire returned physical page with
+ * '\0' bytes.
+ * if (alloc_flags & ALLOC_HUGE), returns a huge physical 2M page.
+ *
+ * Normal pages are served from the per-CPU page cache, which is refilled from
+ * the buddy allocator in batches. ALLOC_ZERO requests are served from the pool
+ * of pre-zeroed chunks first. ALLOC_LOW requests are served from the lowest
+ * free address if the address index is enabled (see buddy_find_lowest()).
+ *
+ * ALLOC_HUGE requests are served from the reserved 2M chunks if there are any
+ * left (see page_huge_reserve()).
+ *
+ * ALLOC_MOVABLE requests are grouped into their own pageblocks, apart from the
+ * unmovable kernel allocations (see zone_find()).
+ *
+ * Pages are taken from the normal zone, falling back to the DMA zone. With
+ * ALLOC_HIGH, the high zone is tried first, whereas ALLOC_DMA restricts the
+ * allocation to the DMA zone. The zones of the node of the current CPU are
+ * tried first, see page_alloc_node().
+ *
+ * Beware: this function does NOT increment the reference count of the page -
+ * this is the caller's responsibility.
+ *
+ * Returns NULL if out of free memory.
+ *
+ * Hint: use buddy_find() to find a free page of the right order.
+ * Hint: use page2kva() and memset() to clear the page.
+ */
+struct page_info *page_alloc(int alloc_flags)
+{
+	return page_alloc_node(numa_local_node(), alloc_flags);
+}
+
+/*
+ * Allocates a physical page like page_alloc(), preferring memory of the given
+ * NUMA node. The zones of that node are tried first, falling back to the
+ * other nodes in turn once the node runs out of memory. Only allocations for
+ * the local node are served from the per-CPU caches and the page pools.
+ */
+struct page_info *page_alloc_node(size_t node, int alloc_flags)
+{
+	struct page_info *page;
+	size_t order = (alloc_flags & ALLOC_HUGE) ? BUDDY_2M_PAGE : BUDDY_4K_PAGE;
+	uint64_t start;
+
+	if (node >= nnuma_nodes)
+		node = numa_local_node();
+
+	start = read_tsc();
+	page = do_page_alloc(node, alloc_flags);
+	stats_alloc(order, page != NULL, read_tsc() - start);
+	trace(TRACE_PAGE_ALLOC, page ? page2pa(page) : 0, alloc_flags);
+
+	return page;
+}
+
+/* Serves buddy_free() with the lock of the zone held. */
+static void zone_free(struct page_info *pp)
+{
+	struct page_info *buddy;
+	size_t order = pp->pp_order;
+
+	if (!buddy_merge_threshold) {
+		pp = buddy_merge(pp);
+		buddy_add_free(pp, pp->pp_order);
+		return;
+	}
+
+	buddy = buddy_of(pp, order);
+
+	buddy_add_free(pp, order);
+
+	if (!buddy || !buddy_is_free(pp, order, 1))
+		return;
+
+	/* Only coalesce once there is at least one pair of free buddies. */
+	if (zone_of(pp)->nfree[order] >= buddy_merge_threshold)
+		zone_coalesce(zone_of(pp), order);
+	else
+		++zone_of(pp)->nmerges_avoided;
+}
+
+/*
+ * Return a chunk to the buddy free lists, bypassing the per-CPU page caches.
+ * The chunk is merged with its buddies before it is put on the free list,
+ * unless lazy merging is enabled.
+ */
+void buddy_free(struct page_info *pp)
+{
+	struct buddy_zone *zone = zone_of(pp);
+
+	/* Only check under the lock, or two racing frees could both pass. */
+	spin_lock(&zone->lock);
+
+	if (pp->pp_free)
+		panic("buddy_free: double free of page %p", page2pa(pp));
+
+	zone_free(pp);
+	spin_unlock(&zone->lock);
+}
+
+/*
+ * Hands the pages of the physical range [start, end) to the buddy allocator
+ * as the largest naturally aligned chunks that fit, rather than one page at a
+ * time: at every address the chunk takes the largest order the address is
+ * aligned to that still fits in the range. Only the chunks at either end of the
+ * range can have a free buddy outside of the range, so the cost of merging is
+ * limited to O(log n) chunks rather than every single page.
+ *
+ * The pages must be in use and of order 0, i.e. freshly initialized.
+ *
+ * Returns the number of chunks freed.
+ */
+size_t buddy_free_range(physaddr_t start, physaddr_t end)
+{
+	struct page_info *page;
+	size_t order, nchunks = 0;
+
+	start = ROUNDUP(start, PAGE_SIZE);
+	end = ROUNDDOWN(end, PAGE_SIZE);
+
+	while (start < end) {
+		order = start ? MIN(bsf(start / PAGE_SIZE),
+			BUDDY_MAX_ORDER - 1) : BUDDY_MAX_ORDER - 1;
+
+		while ((PAGE_SIZE << order) > end - start)
+			--order;
+
+		page = pa2page(start);
+		page->pp_order = order;
+		buddy_free(page);
+
+		buddy_zones[page->pp_zone].npages += 1 << order;
+		start += PAGE_SIZE << order;
+		++nchunks;
+	}
+
+	return nchunks;
+}
+
+/* Serves page_free(), see below. */
+static void do_page_free(struct page_info *pp)
+{
+	if (pp->pp_free || pp->pp_pcp || pp->pp_zpool || pp->pp_hpool ||
+	    pp->pp_slab)
+		panic("page_free: double free of page %p", page2pa(pp));
+
+	if (page_huge_free(pp) == 0)
+		return;
+
+	if (buddy_pageblock_type(pp) == MIGRATE_UNMOVABLE &&
+	    page_pcp_free(pp) == 0)
+		return;
+
+	buddy_free(pp);
+}
+
+/*
+ * Return a page to the free list.
+ * (This function should only be called when pp->pp_ref reaches 0.)
+ *
+ * 2M chunks refill the pool of reserved huge pages first, and normal pages
+ * are put into the per-CPU page cache. Everything else goes straight back to
+ * the buddy allocator.
+ */
+void page_free(struct page_info *pp)
+{
+	size_t order = pp->pp_order;
+	uint64_t start;
+
+	trace(TRACE_PAGE_FREE, page2pa(pp), order);
+	start = read_tsc();
+	do_page_free(pp);
+	stats_free(order, read_tsc() - start);
+}
+
+/* Hands out up to n pieces of the given order from the front of the chunk and
+ * returns whatever remains of the chunk to the free lists. The chunk must have
+ * been taken off the free lists already.
+ *
+ * Returns the number of pieces stored in out.
+ */
+static size_t buddy_carve(struct page_info *chunk, size_t order, size_t n,
+	struct page_info **out)
+{
+	struct page_info *rhs;
+	size_t chunk_order = chunk->pp_order;
+	size_t npieces, i, nout = 0;
+
+	while (nout < n) {
+		npieces = 1 << (chunk_order - order);
+
+		/* Hand out the whole chunk if all of it is needed. */
+		if (n - nout >= npieces) {
+			for (i = 0; i < npieces; ++i) {
+				chunk[i << order].pp_order = order;
+				out[nout++] = chunk + (i << order);
+			}
+
+			break;
+		}
+
+		/* Otherwise split the chunk in half. */
+		--chunk_order;
+		rhs = chunk + (1 << chunk_order);
+
+		if (n - nout < npieces / 2) {
+			/* The left half suffices: free the right half. */
+			buddy_add_free(rhs, chunk_order);
+			continue;
+		}
+
+		/* Hand out the left half and carry on with the right half. */
+		for (i = 0; i < npieces / 2; ++i) {
+			chunk[i << order].pp_order = order;
+			out[nout++] = chunk + (i << order);
+		}
+
+		chunk = rhs;
+
+		if (nout == n)
+			buddy_add_free(rhs, chunk_order);
+	}
+
+	return nout;
+}
+
+/* Allocates up to n chunks of the given order from the zone, see
+ * page_alloc_bulk().
+ */
+static size_t zone_alloc_bulk(struct buddy_zone *zone, size_t order, size_t n,
+	struct page_info **out)
+{
+	struct page_info *chunk;
+	uint32_t mask, fit_mask;
+	size_t want, chunk_order, type, nalloc = 0;
+
+	while (nalloc < n) {
+		/* Determine the order of a chunk that fits all remaining pieces. */
+		for (want = order; want < BUDDY_MAX_ORDER - 1 &&
+		     (1 << (want - order)) < n - nalloc; ++want)
+			;
+
+		/* Bulk allocations are unmovable, but take from the other
+		 * migrate types rather than failing.
+		 */
+		type = MIGRATE_UNMOVABLE;
+		mask = zone->free_mask[type] & ~((1 << order) - 1);
+
+		if (!mask && buddy_merge_threshold && zone_coalesce(zone, 0) > 0)
+			mask = zone->free_mask[type] & ~((1 << order) - 1);
+
+		while (!mask && ++type < NMIGRATE_TYPES)
+			mask = zone->free_mask[type] & ~((1 << order) - 1);
+
+		if (!mask)
+			break;
+
+		zone->nsteals += type != MIGRATE_UNMOVABLE;
+
+		/* Prefer the smallest chunk that fits all remaining pieces and
+		 * fall back to the largest chunk there is otherwise.
+		 */
+		fit_mask = mask & ~((1 << want) - 1);
+		chunk_order = fit_mask ? bsf(fit_mask) : bsr(mask);
+
+		chunk = zone_take(zone, type, chunk_order);
+
+		if (chunk_order > want)
+			chunk = buddy_split(chunk, want);
+
+		nalloc += buddy_carve(chunk, order, n - nalloc, out + nalloc);
+	}
+
+	return nalloc;
+}
+
+/*
+ * Allocates n chunks of the given order and stores them in out. Rather than
+ * looking up and splitting a chunk for every single allocation, a chunk large
+ * enough to hold all of the requested chunks is split once and carved up.
+ * The zones are tried in the same order as for page_alloc(), where only the
+ * pages above its reserve are taken from a fallback zone.
+ *
+ * Beware: like page_alloc(), this function does NOT increment the reference
+ * count of the pages, nor does it clear them.
+ *
+ * Returns the number of chunks allocated, which is less than n if out of free
+ * memory.
+ */
+size_t page_alloc_bulk(size_t order, size_t n, struct page_info **out)
+{
+	struct buddy_zone *zones[NBUDDY_ZONES];
+	size_t i, nzones, want, nalloc = 0;
+
+	if (order >= BUDDY_MAX_ORDER)
+		return 0;
+
+	nzones = zonelist(0, numa_local_node(), zones);
+
+	for (;;) {
+		for (i = 0; i < nzones && nalloc < n; ++i) {
+			want = n - nalloc;
+			spin_lock(&zones[i]->lock);
+
+			if (i > 0) {
+				if (zones[i]->nfree_pages <= zones[i]->reserve)
+					want = 0;
+				else
+					want = MIN(want, (zones[i]->nfree_pages -
+						zones[i]->reserve) >> order);
+			}
+
+			nalloc += zone_alloc_bulk(zones[i], order, want,
+				out + nalloc);
+			spin_unlock(&zones[i]->lock);
+		}
+
+		/* Set up more of the memory that page_init() left for later. */
+		if (nalloc == n || page_init_deferred(1) == 0)
+			break;
+	}
+
+	return nalloc;
+}
+
+/* Sorts the array of pages by physical address (Shell sort). */
+static void sort_pages(struct page_info **pp, size_t n)
+{
+	struct page_info *page;
+	size_t gap, i, j;
+
+	for (gap = n / 2; gap > 0; gap /= 2) {
+		for (i = gap; i < n; ++i) {
+			page = pp[i];
+
+			for (j = i; j >= gap && pp[j - gap] > page; j -= gap)
+				pp[j] = pp[j - gap];
+
+			pp[j] = page;
+		}
+	}
+}
+
+/*
+ * Returns n chunks to the buddy allocator. The chunks are sorted by address
+ * first, such that runs of contiguous chunks that make up a naturally aligned
+ * chunk of a larger order are coalesced up front and handed to the buddy
+ * allocator as a single chunk, rather than merging them one by one. The lock
+ * of a zone is taken once for all of the chunks that fall into it.
+ *
+ * Note that the array is reordered in the process.
+ */
+void page_free_bulk(struct page_info **pp, size_t n)
+{
+	struct buddy_zone *zone = NULL;
+	struct page_info *page;
+	size_t i, j, order, run;
+
+	for (i = 0; i < n; ++i) {
+		if (pp[i]->pp_free || pp[i]->pp_pcp || pp[i]->pp_zpool ||
+		    pp[i]->pp_hpool || pp[i]->pp_slab)
+			panic("page_free_bulk: double free of page %p",
+				page2pa(pp[i]));
+	}
+
+	sort_pages(pp, n);
+
+	for (i = 0; i < n; i += run) {
+		page = pp[i];
+		order = page->pp_order;
+
+		/* Try to double the run of chunks for as long as the run stays
+		 * naturally aligned and contiguous.
+		 */
+		for (run = 1; order < BUDDY_MAX_ORDER - 1 && i + 2 * run <= n &&
+		     !((page - pages) & ((1 << (order + 1)) - 1)); run *= 2) {
+			for (j = run; j < 2 * run; ++j) {
+				if (pp[i + j] != page + ((j << page->pp_order)) ||
+				    pp[i + j]->pp_order != page->pp_order)
+					break;
+			}
+
+			if (j < 2 * run)
+				break;
+
+			++order;
+		}
+
+		page->pp_order = order;
+
+		/* Sorted by address, the chunks of a zone are next to each
+		 * other.
+		 */
+		if (zone != zone_of(page)) {
+			if (zone)
+				spin_unlock(&zone->lock);
+
+			zone = zone_of(page);
+			spin_lock(&zone->lock);
+		}
+
+		zone_free(page);
+	}
+
+	if (zone)
+		spin_unlock(&zone->lock);
 }
 
 /*
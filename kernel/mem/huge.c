@@ -0,0 +1,137 @@
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+#include <kernel/mem.h>
+
+static struct huge_pool huge_pool = {
+	.pages = LIST_INIT(huge_pool.pages),
+};
+
+/* Puts the 2M chunk, which must be in use, into the pool. The lock of the pool
+ * must be held.
+ */
+static void huge_add(struct page_info *page)
+{
+	page->pp_hpool = 1;
+	list_add(&huge_pool.pages, &page->pp_node);
+	++huge_pool.count;
+}
+
+void page_huge_init(void)
+{
+	spin_init(&huge_pool.lock, "huge");
+	page_huge_reserve(HUGE_POOL_2M);
+}
+
+/*
+ * Sets the number of 2M chunks to reserve for ALLOC_HUGE, taking chunks from
+ * the buddy allocator or handing them back until the pool holds target chunks.
+ * Chunks that have been handed out by the pool still count towards the target,
+ * as they return to the pool once freed.
+ *
+ * Returns the number of chunks reserved, in the pool or handed out, which is
+ * less than target if we are out of 2M chunks.
+ */
+size_t page_huge_reserve(size_t target)
+{
+	struct page_info *page;
+	size_t count;
+
+	spin_lock(&huge_pool.lock);
+	huge_pool.target = target;
+
+	while (huge_pool.count > 0 &&
+	       huge_pool.count + huge_pool.nallocated > target) {
+		page = container_of(list_pop(&huge_pool.pages), struct page_info,
+			pp_node);
+		page->pp_hpool = 0;
+		--huge_pool.count;
+
+		buddy_free(page);
+	}
+
+	while (huge_pool.count + huge_pool.nallocated < target) {
+		page = buddy_find(BUDDY_2M_PAGE);
+
+		/* The 2M chunks may still be waiting to be set up. */
+		if (!page && page_init_deferred(1) > 0)
+			continue;
+
+		if (!page)
+			break;
+
+		huge_add(page);
+	}
+
+	count = huge_pool.count + huge_pool.nallocated;
+	spin_unlock(&huge_pool.lock);
+
+	return count;
+}
+
+/* Takes a 2M chunk from the pool. Returns NULL if the pool has run dry. */
+struct page_info *page_huge_alloc(void)
+{
+	struct page_info *page;
+	struct list *node;
+
+	spin_lock(&huge_pool.lock);
+	node = list_pop(&huge_pool.pages);
+
+	if (!node) {
+		huge_pool.misses += huge_pool.target > 0;
+		spin_unlock(&huge_pool.lock);
+		return NULL;
+	}
+
+	page = container_of(node, struct page_info, pp_node);
+	page->pp_hpool = 0;
+	page->pp_hout = 1;
+	--huge_pool.count;
+	++huge_pool.nallocated;
+	++huge_pool.hits;
+	spin_unlock(&huge_pool.lock);
+
+	return page;
+}
+
+/* Puts a freed 2M chunk that has been handed out by the pool back into the
+ * pool if it is below its target, where the chunks that are still out count
+ * towards the target. Returns 0 on success and -1 if the chunk should go to
+ * the buddy allocator instead, as do the chunks that never came from the pool.
+ */
+int page_huge_free(struct page_info *page)
+{
+	int ret = -1;
+
+	if (!page->pp_hout)
+		return -1;
+
+	spin_lock(&huge_pool.lock);
+	page->pp_hout = 0;
+	--huge_pool.nallocated;
+
+	if (huge_pool.count + huge_pool.nallocated < huge_pool.target) {
+		huge_add(page);
+		ret = 0;
+	}
+
+	spin_unlock(&huge_pool.lock);
+
+	return ret;
+}
+
+/* Gets the number of pages held by the pool. */
+size_t count_huge_pages(void)
+{
+	return huge_pool.count << BUDDY_2M_PAGE;
+}
+
+/* Shows the fill level and the hit rate of the pool. */
+void show_huge_info(void)
+{
+	cprintf("  huge order #%u chunks=%u/%u out=%u hits=%u misses=%u\n",
+		BUDDY_2M_PAGE, huge_pool.count, huge_pool.target,
+		huge_pool.nallocated, huge_pool.hits, huge_pool.misses);
+}
@@ -2,14 +2,13 @@
 #include <boot.h>
 #include <list.h>
 #include <paging.h>
+#include <string.h>
 
 #include <x86-64/asm.h>
 
 #include <kernel/mem.h>
 #include <kernel/tests.h>
 
-extern struct list buddy_free_list[];
-
 /*
  * Set up a four-level page table:
  * kernel_pml4 is its linear (virtual) address of the root
@@ -28,13 +27,15 @@ void mem_init(struct boot_info *boot_info)
 	uint32_t cr0;
 	size_t i, n;
 
+	/* Keep the descriptors as small as they have been laid out. */
+	static_assert(sizeof(struct page_info) == 24);
+	static_assert(BUDDY_MAX_ORDER <= 16);
+
 	/* Align the areas in the memory map. */
 	align_boot_info(boot_info);
 
-	/* Set up the buddy free lists. */
-	for (i = 0; i < BUDDY_MAX_ORDER; ++i) {
-		list_init(buddy_free_list + i);
-	};
+	cprintf("mem_init: direct map of %u MiB with %u KiB pages\n",
+		boot_map_end >> 20, boot_map_page_size >> 10);
 
 	/* Find the amount of pages to allocate structs for. */
 	entry = (struct mmap_entry *)((physaddr_t)boot_info->mmap_addr);
@@ -51,9 +52,6 @@ void mem_init(struct boot_info *boot_info)
 	 */
 	npages = MIN(BOOT_MAP_LIM, highest_addr) / PAGE_SIZE;
 
-	/* Remove this line when you're ready to test this function. */
-	panic("mem_init: This function is not finished\n");
-
 	/*
 	 * Allocate an array of npages 'struct page_info's and store it in 'pages'.
 	 * The kernel uses this array to keep track of physical pages: for each
@@ -62,6 +60,22 @@ void mem_init(struct boot_info *boot_info)
 	 */
 	pages = boot_alloc(npages * sizeof *pages);
 
+	/* Allocate the bitmaps that track which buddies are free. */
+	buddy_map = boot_alloc(buddy_map_size());
+
+	/* Find the NUMA nodes and give each of them its slice of the pages. */
+	numa_init();
+
+	/* Set up the buddy free lists of every zone of every node. */
+	buddy_init();
+
+	/* Set up the per-CPU page caches. */
+	page_pcp_init();
+	page_zero_init();
+
+	/* Set up the slab allocator. */
+	kmem_init();
+
 	/*
 	 * Now that we've allocated the initial kernel data structures, we set
 	 * up the list of free physical pages. Once we've done so, all further
@@ -70,24 +84,90 @@ void mem_init(struct boot_info *boot_info)
 	 */
 	page_init(boot_info);
 
+	/* Reserve the 2M chunks for ALLOC_HUGE before 4K allocations split
+	 * them.
+	 */
+	page_huge_init();
+
 	/* Perform the tests of lab 1. */
 	lab1_check_mem(boot_info);
 
 	/* We will set up page tables here in lab 2. */
 }
 
-/*
- * Initialize page structure and memory free list. After this is done, NEVER
- * use boot_alloc() again. After this function has been called to set up the
- * memory allocator, ONLY the buddy allocator should be used to allocate and
- * free physical memory.
+/* A physical range [base, end) that must not be handed to the allocator. */
+struct reserved_range {
+	physaddr_t base;
+	physaddr_t end;
+};
+
+/* Sorts the reserved ranges by their base address (insertion sort). */
+static void sort_reserved(struct reserved_range *ranges, size_t n)
+{
+	struct reserved_range range;
+	size_t i, j;
+
+	for (i = 1; i < n; ++i) {
+		range = ranges[i];
+
+		for (j = i; j > 0 && ranges[j - 1].base > range.base; --j)
+			ranges[j] = ranges[j - 1];
+
+		ranges[j] = range;
+	}
+}
+
+/* Hands the free memory in [base, end) that is not covered by any of the
+ * sorted reserved ranges to the buddy allocator.
+ *
+ * Returns the number of chunks freed.
  */
-void page_init(struct boot_info *boot_info)
+static size_t free_unreserved(physaddr_t base, physaddr_t end,
+	struct reserved_range *ranges, size_t n)
+{
+	size_t i, nchunks = 0;
+
+	for (i = 0; i < n && base < end; ++i) {
+		if (ranges[i].end <= base)
+			continue;
+
+		if (ranges[i].base >= end)
+			break;
+
+		if (ranges[i].base > base)
+			nchunks += buddy_free_range(base, ranges[i].base);
+
+		base = ranges[i].end;
+	}
+
+	if (base < end)
+		nchunks += buddy_free_range(base, end);
+
+	return nchunks;
+}
+
+/* The reserved memory, along with the memory map, for page_init_deferred(). */
+static struct reserved_range reserved[5];
+static struct boot_info *deferred_boot_info;
+
+/* The first page of which the struct page_info has not been set up yet. */
+static size_t deferred_next;
+
+/* Sets up the struct page_infos of the pages [first, last) and hands the free
+ * memory among them to the buddy allocator. Both bounds must be multiples of
+ * PAGE_INIT_SECTION (or npages), such that no buddy of the freed chunks has an
+ * uninitialized struct page_info.
+ *
+ * Returns the number of chunks freed.
+ */
+static size_t init_pages(size_t first, size_t last)
 {
+	struct boot_info *boot_info = deferred_boot_info;
 	struct page_info *page;
 	struct mmap_entry *entry;
-	uintptr_t pa, end;
-	size_t i;
+	physaddr_t lo = first * PAGE_SIZE, hi = last * PAGE_SIZE;
+	physaddr_t base, end;
+	size_t i, nchunks = 0;
 
 	/* Go through the array of struct page_info structs and:
 	 *  1) call list_init() to initialize the linked list node.
@@ -95,27 +175,109 @@ void page_init(struct boot_info *boot_info)
 	 *  3) mark the page as in use by setting pp_free to zero.
 	 *  4) set the order pp_order to zero.
 	 */
-	for (i = 0; i < npages; ++i) {
-		/* LAB 1: your code here. */
+	for (i = first; i < last; ++i) {
+		page = pages + i;
+		memset(page, 0, sizeof *page);
+		list_init(&page->pp_node);
+		page->pp_zone = buddy_zone_of(page2pa(page));
 	}
 
+	/* Go through the entries in the memory map and hand the free regions
+	 * within [lo, hi) to the buddy allocator, minus the reserved memory.
+	 * Each region is freed as a few large naturally aligned chunks rather
+	 * than page by page, see buddy_free_range().
+	 */
 	entry = (struct mmap_entry *)KADDR(boot_info->mmap_addr);
+
+	for (i = 0; i < boot_info->mmap_len; ++i, ++entry) {
+		if (entry->type != MMAP_FREE)
+			continue;
+
+		base = MAX(entry->addr, lo);
+		end = MIN(entry->addr + entry->len, hi);
+
+		if (base < end)
+			nchunks += free_unreserved(base, end, reserved,
+				length_of(reserved));
+	}
+
+	return nchunks;
+}
+
+/*
+ * Sets up the next nsections sections of PAGE_INIT_SECTION pages that
+ * page_init() left alone, and hands their free memory to the buddy allocator.
+ * page_alloc() calls this once it runs out of memory, and passing SIZE_MAX
+ * completes the initialization.
+ *
+ * Returns the number of pages of which the struct page_info has been set up.
+ */
+size_t page_init_deferred(size_t nsections)
+{
+	size_t first = deferred_next;
+
+	if (!deferred_boot_info)
+		return 0;
+
+	for (; nsections > 0 && deferred_next < npages; --nsections) {
+		init_pages(deferred_next,
+			MIN(deferred_next + PAGE_INIT_SECTION, npages));
+		deferred_next = MIN(deferred_next + PAGE_INIT_SECTION, npages);
+	}
+
+	if (deferred_next != first)
+		buddy_zone_default_reserves();
+
+	return deferred_next - first;
+}
+
+/*
+ * Initialize page structure and memory free list. After this is done, NEVER
+ * use boot_alloc() again. After this function has been called to set up the
+ * memory allocator, ONLY the buddy allocator should be used to allocate and
+ * free physical memory.
+ */
+void page_init(struct boot_info *boot_info)
+{
+	uintptr_t end;
+	uint64_t start;
+	size_t i, nchunks;
+
+	start = read_tsc();
 	end = PADDR(boot_alloc(0));
 
-	/* Go through the entries in the memory map:
-	 *  1) Ignore the entry if the region is not free memory.
-	 *  2) Iterate through the pages in the region.
-	 *  3) If the physical address is above BOOT_MAP_LIM, ignore.
-	 *  4) Hand the page to the buddy allocator by calling page_free() if
-	 *     the page is not reserved.
-	 *
+	/*
 	 * What memory is reserved?
 	 *  - Address 0 contains the IVT and BIOS data.
+	 *  - boot_info and the memory map it points to.
 	 *  - boot_info->elf_hdr points to the ELF header.
 	 *  - Any address in [KERNEL_LMA, end) is part of the kernel.
 	 */
-	for (i = 0; i < boot_info->mmap_len; ++i, ++entry) {
-		/* LAB 1: your code here. */
-	}
-}
+	reserved[0].base = 0;
+	reserved[1].base = PAGE_ADDR(PADDR(boot_info));
+	reserved[2].base = PAGE_ADDR(boot_info->mmap_addr);
+	reserved[3].base = PAGE_ADDR((uintptr_t)boot_info->elf_hdr);
+
+	for (i = 0; i < 4; ++i)
+		reserved[i].end = reserved[i].base + PAGE_SIZE;
+
+	reserved[4].base = KERNEL_LMA;
+	reserved[4].end = ROUNDUP(end, PAGE_SIZE);
+	sort_reserved(reserved, length_of(reserved));
 
+	/* Only set up the pages below PAGE_INIT_EAGER_LIM now, the remaining
+	 * pages are set up on demand by page_init_deferred().
+	 */
+	deferred_boot_info = boot_info;
+	deferred_next = MIN(npages, PAGE_INIT_EAGER_LIM / PAGE_SIZE);
+	nchunks = init_pages(0, deferred_next);
+
+	/* Keep some memory back in the lower zones, now that we know how
+	 * large every zone is.
+	 */
+	buddy_zone_default_reserves();
+
+	cprintf("page_init: freed %u pages as %u chunks in %lu cycles, "
+		"%u pages deferred\n", count_total_free_pages(), nchunks,
+		read_tsc() - start, npages - deferred_next);
+}
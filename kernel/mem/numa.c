@@ -0,0 +1,250 @@
+#include <types.h>
+#include <paging.h>
+
+#include <x86-64/asm.h>
+
+#include <kernel/acpi.h>
+#include <kernel/mem.h>
+
+#define CPUID_1_ECX_X2APIC (1 << 21)
+
+struct numa_node numa_nodes[MAX_NUMNODES] = {
+	[0] = {
+		.base = 0,
+		.end = ~(physaddr_t)0,
+	},
+};
+
+size_t nnuma_nodes = 1;
+
+/* The node of the boot CPU. */
+static size_t local_node;
+
+/* Returns the APIC ID of the current CPU, which is what the SRAT uses to
+ * identify the CPUs.
+ */
+static uint32_t cpu_apic_id(void)
+{
+	uint32_t max_leaf, ebx, ecx, edx;
+
+	cpuid(0, &max_leaf, NULL, NULL, NULL);
+	cpuid(1, NULL, &ebx, &ecx, NULL);
+
+	if ((ecx & CPUID_1_ECX_X2APIC) && max_leaf >= 0xb) {
+		cpuid_count(0xb, 0, NULL, NULL, NULL, &edx);
+		return edx;
+	}
+
+	return ebx >> 24;
+}
+
+/* Adds the memory range to the node of the proximity domain, which is set up
+ * if this is the first range of the domain.
+ *
+ * Returns -1 if there are more domains than MAX_NUMNODES, and 0 otherwise.
+ */
+static int add_range(struct numa_node *nodes, size_t *n, uint32_t domain,
+	physaddr_t base, physaddr_t end)
+{
+	size_t i;
+
+	for (i = 0; i < *n && nodes[i].domain != domain; ++i)
+		;
+
+	if (i == *n) {
+		if (*n == MAX_NUMNODES)
+			return -1;
+
+		nodes[i].domain = domain;
+		nodes[i].base = base;
+		nodes[i].end = end;
+		++*n;
+	}
+
+	nodes[i].base = MIN(nodes[i].base, base);
+	nodes[i].end = MAX(nodes[i].end, end);
+
+	return 0;
+}
+
+/* Sorts the nodes by their base address (insertion sort). */
+static void sort_nodes(struct numa_node *nodes, size_t n)
+{
+	struct numa_node node;
+	size_t i, j;
+
+	for (i = 1; i < n; ++i) {
+		node = nodes[i];
+
+		for (j = i; j > 0 && nodes[j - 1].base > node.base; --j)
+			nodes[j] = nodes[j - 1];
+
+		nodes[j] = node;
+	}
+}
+
+/* Goes through the entries of the SRAT to find the memory of every proximity
+ * domain and the domain of the boot CPU.
+ *
+ * Returns the number of nodes found, or 0 if they cannot be used.
+ */
+static size_t parse_srat(struct acpi_srat *srat, struct numa_node *nodes,
+	uint32_t *local_domain)
+{
+	struct acpi_srat_entry *entry;
+	struct acpi_srat_cpu *cpu;
+	struct acpi_srat_mem *mem;
+	struct acpi_srat_x2apic *x2apic;
+	uint32_t apic_id = cpu_apic_id();
+	char *p = (char *)(srat + 1);
+	char *end = (char *)srat + srat->header.length;
+	size_t i, n = 0;
+
+	for (; p + sizeof *entry <= end; p += entry->length) {
+		entry = (struct acpi_srat_entry *)p;
+
+		if (entry->length < sizeof *entry || p + entry->length > end)
+			break;
+
+		switch (entry->type) {
+		case SRAT_CPU_AFFINITY:
+			cpu = (struct acpi_srat_cpu *)entry;
+
+			if ((cpu->flags & SRAT_ENABLED) && cpu->apic_id == apic_id)
+				*local_domain = cpu->domain_lo |
+					cpu->domain_hi[0] << 8 |
+					cpu->domain_hi[1] << 16 |
+					cpu->domain_hi[2] << 24;
+			break;
+		case SRAT_X2APIC_AFFINITY:
+			x2apic = (struct acpi_srat_x2apic *)entry;
+
+			if ((x2apic->flags & SRAT_ENABLED) &&
+			    x2apic->x2apic_id == apic_id)
+				*local_domain = x2apic->domain;
+			break;
+		case SRAT_MEM_AFFINITY:
+			mem = (struct acpi_srat_mem *)entry;
+
+			if (!(mem->flags & SRAT_ENABLED) || !mem->len)
+				break;
+
+			if (add_range(nodes, &n, mem->domain, mem->base,
+			    mem->base + mem->len) < 0) {
+				cprintf("numa: more than %u domains\n",
+					MAX_NUMNODES);
+				return 0;
+			}
+			break;
+		}
+	}
+
+	sort_nodes(nodes, n);
+
+	/* Interleaved domains cannot be told apart by address alone. */
+	for (i = 1; i < n; ++i) {
+		if (nodes[i - 1].end > nodes[i].base) {
+			cprintf("numa: the domains overlap\n");
+			return 0;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Sets up the NUMA nodes from the memory affinity entries of the SRAT, and
+ * finds the node of the boot CPU. The gaps between the nodes are given to the
+ * node below, and the boundaries are rounded down to the largest buddy chunk,
+ * such that buddies never end up on different nodes.
+ *
+ * This has to run once the struct page_info array has been allocated, but
+ * before buddy_init() sets up the zones of the nodes.
+ */
+void numa_init(void)
+{
+	struct numa_node nodes[MAX_NUMNODES];
+	struct acpi_srat *srat;
+	uint32_t local_domain = 0;
+	size_t i, n = 0;
+
+	srat = acpi_find_table("SRAT");
+
+	if (srat)
+		n = parse_srat(srat, nodes, &local_domain);
+
+	acpi_unmap();
+
+	for (i = 1; i < n; ++i) {
+		nodes[i].base = ROUNDDOWN(nodes[i].base,
+			(physaddr_t)PAGE_SIZE << (BUDDY_MAX_ORDER - 1));
+
+		if (nodes[i].base <= nodes[i - 1].base) {
+			cprintf("numa: domains %u and %u share a buddy chunk\n",
+				nodes[i - 1].domain, nodes[i].domain);
+			n = 0;
+			break;
+		}
+	}
+
+	if (n > 0) {
+		nodes[0].base = 0;
+
+		for (i = 0; i + 1 < n; ++i)
+			nodes[i].end = nodes[i + 1].base;
+
+		nodes[n - 1].end = ~(physaddr_t)0;
+		nnuma_nodes = n;
+		local_node = 0;
+
+		for (i = 0; i < n; ++i) {
+			numa_nodes[i] = nodes[i];
+
+			if (nodes[i].domain == local_domain)
+				local_node = i;
+		}
+	}
+
+	for (i = 0; i < nnuma_nodes; ++i) {
+		numa_nodes[i].pages = pages +
+			MIN(PAGE_INDEX(numa_nodes[i].base), npages);
+		numa_nodes[i].npages = MIN(PAGE_INDEX(numa_nodes[i].end),
+			npages) - (numa_nodes[i].pages - pages);
+	}
+
+	show_numa_info();
+}
+
+/* Returns the node the physical address belongs to. */
+size_t numa_node_of(physaddr_t pa)
+{
+	size_t i;
+
+	for (i = 0; i < nnuma_nodes - 1; ++i) {
+		if (pa < numa_nodes[i].end)
+			break;
+	}
+
+	return i;
+}
+
+/* Returns the node of the current CPU, which is where page_alloc() takes
+ * memory from first.
+ */
+size_t numa_local_node(void)
+{
+	return local_node;
+}
+
+void show_numa_info(void)
+{
+	struct numa_node *node;
+
+	cprintf("NUMA nodes:\n");
+
+	for (node = numa_nodes; node < numa_nodes + nnuma_nodes; ++node)
+		cprintf("  node %u domain %u %016p - %016p pages=%u%s\n",
+			node - numa_nodes, node->domain, node->base, node->end,
+			node->npages,
+			node - numa_nodes == local_node ? " (local)" : "");
+}
@@ -0,0 +1,189 @@
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+#include <kernel/cpu.h>
+#include <kernel/mem.h>
+
+struct page_pcp page_pcps[NCPUS];
+
+/* Whether page_alloc() and page_free() go through the per-CPU caches. */
+static int page_pcp_enabled;
+
+static struct page_pcp *this_pcp(void)
+{
+	return page_pcps + cpu_id();
+}
+
+/* Hands the coldest pages back to the buddy allocator until at most target
+ * pages remain in the cache, in batches of up to PCP_BATCH pages.
+ */
+static size_t pcp_shrink(struct page_pcp *pcp, size_t target)
+{
+	struct page_info *pp[PCP_BATCH];
+	size_t n, ndrained = 0;
+
+	while (pcp->count > target) {
+		for (n = 0; n < PCP_BATCH && pcp->count > target; ++n) {
+			pp[n] = container_of(list_pop_tail(&pcp->pages),
+				struct page_info, pp_node);
+			pp[n]->pp_pcp = 0;
+			--pcp->count;
+		}
+
+		page_free_bulk(pp, n);
+		ndrained += n;
+	}
+
+	return ndrained;
+}
+
+/* Pulls up to batch pages from the buddy allocator into the cache, in bulk. */
+static void pcp_refill(struct page_pcp *pcp)
+{
+	struct page_info *pp[PCP_BATCH];
+	size_t i, n, want, left = pcp->batch;
+
+	while (left > 0) {
+		want = left < PCP_BATCH ? left : PCP_BATCH;
+		n = page_alloc_bulk(BUDDY_4K_PAGE, want, pp);
+
+		for (i = 0; i < n; ++i) {
+			pp[i]->pp_pcp = 1;
+			list_add_tail(&pcp->pages, &pp[i]->pp_node);
+		}
+
+		pcp->count += n;
+		left -= n;
+
+		if (n < want)
+			break;
+	}
+}
+
+void page_pcp_init(void)
+{
+	struct page_pcp *pcp;
+	size_t i;
+
+	for (i = 0; i < NCPUS; ++i) {
+		pcp = page_pcps + i;
+		list_init(&pcp->pages);
+		pcp->count = 0;
+		pcp->low = PCP_LOW;
+		pcp->high = PCP_HIGH;
+		pcp->batch = PCP_BATCH;
+	}
+
+	page_pcp_enabled = 1;
+}
+
+/* Enables or disables the per-CPU page caches. Disabling the caches drains
+ * them. Returns whether the caches were enabled before.
+ */
+int page_pcp_enable(int enable)
+{
+	int was_enabled = page_pcp_enabled;
+
+	if (!enable)
+		page_pcp_drain();
+
+	page_pcp_enabled = enable;
+
+	return was_enabled;
+}
+
+/* Configures the watermarks of every per-CPU cache. */
+void page_pcp_set_watermarks(size_t low, size_t high, size_t batch)
+{
+	struct page_pcp *pcp;
+	size_t i;
+
+	if (low > high)
+		low = high;
+
+	for (i = 0; i < NCPUS; ++i) {
+		pcp = page_pcps + i;
+		pcp->low = low;
+		pcp->high = high;
+		pcp->batch = batch;
+		pcp_shrink(pcp, high);
+	}
+}
+
+/* Takes an order 0 page from the per-CPU cache, refilling the cache from the
+ * buddy allocator if it is empty. Hot pages are preferred, unless
+ * (alloc_flags & ALLOC_COLD).
+ *
+ * Returns NULL if the caches are disabled or if out of free memory.
+ */
+struct page_info *page_pcp_alloc(int alloc_flags)
+{
+	struct page_pcp *pcp = this_pcp();
+	struct page_info *page;
+	struct list *node;
+
+	if (!page_pcp_enabled || pcp->high == 0)
+		return NULL;
+
+	if (pcp->count == 0)
+		pcp_refill(pcp);
+
+	if (alloc_flags & ALLOC_COLD)
+		node = list_pop_tail(&pcp->pages);
+	else
+		node = list_pop(&pcp->pages);
+
+	if (!node)
+		return NULL;
+
+	page = container_of(node, struct page_info, pp_node);
+	page->pp_pcp = 0;
+	--pcp->count;
+
+	return page;
+}
+
+/* Puts an order 0 page into the per-CPU cache as the hottest page. Returns 0
+ * on success and -1 if the page should go to the buddy allocator instead.
+ */
+int page_pcp_free(struct page_info *page)
+{
+	struct page_pcp *pcp = this_pcp();
+
+	if (!page_pcp_enabled || pcp->high == 0 ||
+	    page->pp_order != BUDDY_4K_PAGE)
+		return -1;
+
+	page->pp_pcp = 1;
+	list_add(&pcp->pages, &page->pp_node);
+
+	if (++pcp->count > pcp->high)
+		pcp_shrink(pcp, pcp->low);
+
+	return 0;
+}
+
+/* Returns all the pages held by the per-CPU caches to the buddy allocator.
+ * Returns the number of pages that have been drained.
+ */
+size_t page_pcp_drain(void)
+{
+	size_t i, ndrained = 0;
+
+	for (i = 0; i < NCPUS; ++i)
+		ndrained += pcp_shrink(page_pcps + i, 0);
+
+	return ndrained;
+}
+
+/* Gets the number of pages held by the per-CPU caches. */
+size_t count_pcp_pages(void)
+{
+	size_t i, npcp_pages = 0;
+
+	for (i = 0; i < NCPUS; ++i)
+		npcp_pages += page_pcps[i].count;
+
+	return npcp_pages;
+}
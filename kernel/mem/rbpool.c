@@ -0,0 +1,146 @@
+#include <types.h>
+#include <assert.h>
+#include <error.h>
+#include <rbtree.h>
+#include <string.h>
+
+#include <kernel/mem.h>
+
+/* Initializes a pool of objects of size bytes, with their rb_node at the given
+ * offset.
+ */
+void rb_pool_init(struct rb_pool *pool, size_t size, size_t offset)
+{
+	arena_init(&pool->arena, ARENA_CHUNK_ORDER);
+	pool->free = NULL;
+	pool->size = ROUNDUP(MAX(size, sizeof(struct rb_node)), sizeof(void *));
+	pool->offset = offset;
+	pool->nactive = 0;
+}
+
+/* Returns the rb_node of a new object, taking the most recently freed object
+ * if there is one. The node is initialized, the rest of the object is not.
+ *
+ * Returns NULL if we are out of memory.
+ */
+struct rb_node *rb_pool_alloc(struct rb_pool *pool)
+{
+	struct rb_node *node = pool->free;
+	char *obj;
+
+	if (node) {
+		pool->free = node->child[0];
+	} else {
+		obj = arena_alloc(&pool->arena, pool->size, sizeof(void *));
+
+		if (!obj)
+			return NULL;
+
+		node = (struct rb_node *)(obj + pool->offset);
+	}
+
+	rb_node_init(node);
+	++pool->nactive;
+
+	return node;
+}
+
+/* Puts the object of the node, which must no longer be in a tree, back into
+ * the pool.
+ */
+void rb_pool_free(struct rb_pool *pool, struct rb_node *node)
+{
+	node->child[0] = pool->free;
+	pool->free = node;
+	--pool->nactive;
+}
+
+/* Moves the object of the node into the slot, and relinks the tree to it. */
+static void rb_pool_move(struct rb_pool *pool, struct rb_tree *tree,
+	struct rb_node *node, char *slot)
+{
+	struct rb_node *new_node = (struct rb_node *)(slot + pool->offset);
+
+	memcpy(slot, (char *)node - pool->offset, pool->size);
+	rb_replace(tree, node, new_node);
+}
+
+/*
+ * Moves the objects of the tree into a single contiguous block, in breadth-
+ * first order, for trees that are mostly read from then on. The top levels of
+ * the tree, which every lookup goes through, end up packed into the same few
+ * cache lines, and a lookup touches a few pages at most rather than one per
+ * level.
+ *
+ * All the objects that have been allocated from the pool must be in the tree,
+ * and the tree must not hold any other nodes, as the memory they were in is
+ * handed back to the buddy allocator. Pointers to the objects other than the
+ * links of the tree are no longer valid, which rules out a struct
+ * rb_tree_cached, of which the leftmost and rightmost nodes would go stale.
+ *
+ * Returns 0 on success, -EINVAL if the tree does not hold exactly as many
+ * nodes as there are objects allocated from the pool, or -ENOMEM if there is
+ * no block large enough for the whole tree. On error the tree is left as it
+ * is.
+ */
+int rb_pool_compact(struct rb_pool *pool, struct rb_tree *tree)
+{
+	struct arena arena;
+	struct rb_node *node;
+	char *slots;
+	size_t scan, fill, dir;
+
+	if (!tree->root)
+		return 0;
+
+	/* The block only has room for the objects of the pool. */
+	fill = 0;
+
+	rb_foreach(tree, node)
+		++fill;
+
+	if (fill != pool->nactive)
+		return -EINVAL;
+
+	arena_init(&arena, ARENA_CHUNK_ORDER);
+	slots = arena_alloc(&arena, pool->nactive * pool->size, sizeof(void *));
+
+	if (!slots)
+		return -ENOMEM;
+
+	/*
+	 * The block itself serves as the queue: the moved objects still link to
+	 * the children that have not been moved yet, which go into the next
+	 * slots as we scan the slots in order.
+	 */
+	rb_pool_move(pool, tree, tree->root, slots);
+
+	for (scan = 0, fill = 1; scan < fill; ++scan) {
+		node = (struct rb_node *)(slots + scan * pool->size + pool->offset);
+
+		for (dir = RB_LEFT; dir <= RB_RIGHT; ++dir) {
+			if (!node->child[dir])
+				continue;
+
+			assert(fill < pool->nactive);
+			rb_pool_move(pool, tree, node->child[dir],
+				slots + fill++ * pool->size);
+		}
+	}
+
+	arena_destroy(&pool->arena);
+	pool->arena = arena;
+	pool->free = NULL;
+
+	return 0;
+}
+
+/* Frees all the objects of the pool at once, handing the chunks back to the
+ * buddy allocator.
+ */
+void rb_pool_destroy(struct rb_pool *pool)
+{
+	arena_destroy(&pool->arena);
+	pool->free = NULL;
+	pool->nactive = 0;
+}
@@ -0,0 +1,293 @@
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+
+#include <kernel/mem.h>
+
+/* The cache the struct kmem_caches themselves are allocated from. */
+static struct kmem_cache kmem_cache_cache;
+
+/* All the caches, for show_slab_info(). */
+static struct list kmem_caches = LIST_INIT(kmem_caches);
+
+/* The id to try first for the next cache. */
+static uint16_t kmem_next_id = 1;
+
+/* Returns the first free object of the slab, or NULL if there is none. */
+static void *slab_freelist(struct page_info *page)
+{
+	if (page->pp_freelist == PP_FREELIST_END)
+		return NULL;
+
+	return (char *)page2kva(page) + page->pp_freelist;
+}
+
+/* Makes obj, which may be NULL, the first free object of the slab. */
+static void slab_set_freelist(struct page_info *page, void *obj)
+{
+	page->pp_freelist = obj ? (char *)obj - (char *)page2kva(page) :
+		PP_FREELIST_END;
+}
+
+/* Returns an id that none of the caches uses, or 0 if they are all taken. */
+static uint16_t cache_id(void)
+{
+	struct kmem_cache *cache;
+	struct list *node;
+	uint16_t id;
+	size_t i;
+
+	for (i = 0; i < 0xffff; ++i) {
+		id = kmem_next_id;
+		kmem_next_id = kmem_next_id == 0xffff ? 1 : kmem_next_id + 1;
+
+		list_foreach(&kmem_caches, node) {
+			cache = container_of(node, struct kmem_cache, node);
+
+			if (cache->id == id)
+				break;
+		}
+
+		if (node == &kmem_caches)
+			return id;
+	}
+
+	return 0;
+}
+
+static int cache_init(struct kmem_cache *cache, size_t size, size_t align)
+{
+	if (align == 0)
+		align = sizeof(void *);
+
+	if (align & (align - 1))
+		return -1;
+
+	align = MAX(align, sizeof(void *));
+	size = ROUNDUP(MAX(size, sizeof(void *)), align);
+
+	/* Objects have to fit in a single 4K slab. */
+	if (size > PAGE_SIZE)
+		return -1;
+
+	cache->id = cache_id();
+
+	if (cache->id == 0)
+		return -1;
+
+	cache->size = size;
+	cache->align = align;
+	cache->nobjs = PAGE_SIZE / size;
+	cache->colour = 0;
+	cache->colour_max = PAGE_SIZE - cache->nobjs * size;
+	cache->colour_step = MAX(align, KMEM_CACHE_LINE);
+	list_init(&cache->partial);
+	list_init(&cache->full);
+	list_init(&cache->empty);
+	cache->nslabs = 0;
+	cache->nempty = 0;
+	cache->nactive = 0;
+	list_add_tail(&kmem_caches, &cache->node);
+
+	return 0;
+}
+
+void kmem_init(void)
+{
+	cache_init(&kmem_cache_cache, sizeof(struct kmem_cache),
+		sizeof(void *));
+}
+
+/*
+ * Creates a cache of objects of the given size, aligned to align bytes, which
+ * has to be a power of two (0 meaning pointer-sized). Objects larger than a
+ * page are not supported.
+ *
+ * Returns the cache, or NULL if the parameters are invalid or if we are out
+ * of memory.
+ */
+struct kmem_cache *kmem_cache_create(size_t size, size_t align)
+{
+	struct kmem_cache *cache;
+
+	cache = kmem_cache_alloc(&kmem_cache_cache);
+
+	if (!cache)
+		return NULL;
+
+	if (cache_init(cache, size, align) < 0) {
+		kmem_cache_free(&kmem_cache_cache, cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+/* Takes a fresh page from page_alloc() and threads its objects onto the free
+ * list, starting at the next colour offset. The slab goes on the empty list.
+ */
+static struct page_info *slab_grow(struct kmem_cache *cache)
+{
+	struct page_info *page;
+	char *base;
+	void *freelist = NULL;
+	size_t i;
+
+	page = page_alloc(0);
+
+	if (!page)
+		return NULL;
+
+	base = (char *)page2kva(page) + cache->colour;
+	cache->colour += cache->colour_step;
+
+	if (cache->colour > cache->colour_max)
+		cache->colour = 0;
+
+	for (i = cache->nobjs; i > 0; --i) {
+		*(void **)(base + (i - 1) * cache->size) = freelist;
+		freelist = base + (i - 1) * cache->size;
+	}
+
+	page->pp_slab = 1;
+	page->pp_cache = cache->id;
+	slab_set_freelist(page, freelist);
+	page->pp_inuse = 0;
+
+	list_add(&cache->empty, &page->pp_node);
+	++cache->nslabs;
+	++cache->nempty;
+
+	return page;
+}
+
+/* Hands the empty slab, which must have been taken off its list, back to
+ * page_free().
+ */
+static void slab_release(struct kmem_cache *cache, struct page_info *page)
+{
+	page->pp_slab = 0;
+	page->pp_cache = 0;
+	page->pp_freelist = PP_FREELIST_END;
+	--cache->nslabs;
+
+	page_free(page);
+}
+
+/* Returns a free object from the cache, or NULL if we are out of memory. The
+ * contents of the object are undefined.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+	struct page_info *page;
+	void *obj;
+
+	if (list_is_empty(&cache->partial)) {
+		if (list_is_empty(&cache->empty) && !slab_grow(cache))
+			return NULL;
+
+		page = container_of(list_pop(&cache->empty), struct page_info,
+			pp_node);
+		--cache->nempty;
+		list_add(&cache->partial, &page->pp_node);
+	} else {
+		page = container_of(list_head(&cache->partial), struct page_info,
+			pp_node);
+	}
+
+	obj = slab_freelist(page);
+	slab_set_freelist(page, *(void **)obj);
+	++page->pp_inuse;
+	++cache->nactive;
+
+	if (page->pp_inuse == cache->nobjs) {
+		list_del(&page->pp_node);
+		list_add(&cache->full, &page->pp_node);
+	}
+
+	return obj;
+}
+
+/* Returns the object to the slab it came from. The slab is moved back to the
+ * partial list once it has a free object again, and released once none of its
+ * objects are in use, unless the cache holds fewer than KMEM_MAX_EMPTY empty
+ * slabs.
+ */
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+	struct page_info *page = pa2page(PADDR(obj));
+	int was_full = page->pp_inuse == cache->nobjs;
+
+	if (!page->pp_slab || page->pp_cache != cache->id ||
+	    page->pp_inuse == 0)
+		panic("kmem_cache_free: object %p does not belong to cache %p",
+			obj, cache);
+
+	*(void **)obj = slab_freelist(page);
+	slab_set_freelist(page, obj);
+	--page->pp_inuse;
+	--cache->nactive;
+
+	if (page->pp_inuse == 0) {
+		list_del(&page->pp_node);
+
+		if (cache->nempty >= KMEM_MAX_EMPTY) {
+			slab_release(cache, page);
+		} else {
+			list_add(&cache->empty, &page->pp_node);
+			++cache->nempty;
+		}
+	} else if (was_full) {
+		list_del(&page->pp_node);
+		list_add(&cache->partial, &page->pp_node);
+	}
+}
+
+/* Releases all the empty slabs of the cache. Returns the number of pages that
+ * have been freed.
+ */
+size_t kmem_cache_shrink(struct kmem_cache *cache)
+{
+	struct page_info *page;
+	size_t nreleased = 0;
+
+	while (!list_is_empty(&cache->empty)) {
+		page = container_of(list_pop(&cache->empty), struct page_info,
+			pp_node);
+		--cache->nempty;
+
+		slab_release(cache, page);
+		++nreleased;
+	}
+
+	return nreleased;
+}
+
+/* Releases the cache, all of its objects must have been freed. */
+void kmem_cache_destroy(struct kmem_cache *cache)
+{
+	if (cache->nactive)
+		panic("kmem_cache_destroy: cache %p still has %u objects in use",
+			cache, cache->nactive);
+
+	kmem_cache_shrink(cache);
+	list_del(&cache->node);
+	kmem_cache_free(&kmem_cache_cache, cache);
+}
+
+/* Shows the object size and the usage of every cache. */
+void show_slab_info(void)
+{
+	struct kmem_cache *cache;
+	struct list *node;
+
+	cprintf("Slab caches:\n");
+
+	list_foreach(&kmem_caches, node) {
+		cache = container_of(node, struct kmem_cache, node);
+
+		cprintf("  size=%u align=%u objs=%u/%u slabs=%u empty=%u\n",
+			cache->size, cache->align, cache->nactive,
+			cache->nslabs * cache->nobjs, cache->nslabs, cache->nempty);
+	}
+}
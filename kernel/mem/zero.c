@@ -0,0 +1,216 @@
+#include <types.h>
+#include <list.h>
+#include <paging.h>
+#include <string.h>
+
+#include <kernel/mem.h>
+
+#define NZERO_POOLS 2
+
+/* The pools for 4K and 2M chunks, the only sizes page_alloc() serves. */
+static struct zero_pool zero_pools[NZERO_POOLS];
+
+/* Whether the pools have been set up. */
+static int page_zero_enabled;
+
+static struct zero_pool *zero_pool_of(size_t order)
+{
+	size_t i;
+
+	for (i = 0; i < NZERO_POOLS; ++i) {
+		if (zero_pools[i].order == order)
+			return zero_pools + i;
+	}
+
+	return NULL;
+}
+
+/* Hands chunks back to the buddy allocator until at most target chunks remain
+ * in the pool. The chunks no longer count as cleared once they are merged.
+ */
+static size_t zero_shrink(struct zero_pool *pool, size_t target)
+{
+	struct page_info *page;
+	size_t ndrained = 0;
+
+	spin_lock(&pool->lock);
+
+	while (pool->count > target) {
+		page = container_of(list_pop(&pool->pages), struct page_info,
+			pp_node);
+		page->pp_zpool = 0;
+		--pool->count;
+
+		buddy_free(page);
+		ndrained += 1 << pool->order;
+	}
+
+	spin_unlock(&pool->lock);
+
+	return ndrained;
+}
+
+/* Puts the cleared chunk into the pool, unless the pool has been filled up
+ * by someone else in the meantime. Returns 0 on success and -1 otherwise.
+ */
+static int zero_add(struct zero_pool *pool, struct page_info *page)
+{
+	int ret = -1;
+
+	spin_lock(&pool->lock);
+
+	if (pool->count < pool->target) {
+		page->pp_zpool = 1;
+		list_add_tail(&pool->pages, &page->pp_node);
+		++pool->count;
+		ret = 0;
+	}
+
+	spin_unlock(&pool->lock);
+
+	return ret;
+}
+
+void page_zero_init(void)
+{
+	spin_init(&zero_pools[0].lock, "zero 4K");
+	list_init(&zero_pools[0].pages);
+	zero_pools[0].order = BUDDY_4K_PAGE;
+	zero_pools[0].target = ZERO_POOL_4K;
+
+	spin_init(&zero_pools[1].lock, "zero 2M");
+	list_init(&zero_pools[1].pages);
+	zero_pools[1].order = BUDDY_2M_PAGE;
+	zero_pools[1].target = ZERO_POOL_2M;
+
+	page_zero_enabled = 1;
+}
+
+/* Sets the number of chunks of the given order to keep pre-zeroed. */
+void page_zero_set_target(size_t order, size_t target)
+{
+	struct zero_pool *pool = zero_pool_of(order);
+
+	if (!page_zero_enabled || !pool)
+		return;
+
+	spin_lock(&pool->lock);
+	pool->target = target;
+	spin_unlock(&pool->lock);
+
+	zero_shrink(pool, target);
+}
+
+/*
+ * Tops up the pools by taking chunks straight from the buddy allocator and
+ * clearing them. This is meant to be called whenever the kernel is idle, and
+ * clears at most max_pages pages per call, rounded up to a whole chunk. The
+ * chunks are cleared without holding the lock of the pool.
+ *
+ * Returns the number of pages that have been cleared.
+ */
+size_t page_zero_fill(size_t max_pages)
+{
+	struct zero_pool *pool;
+	struct page_info *page;
+	size_t i, nzeroed = 0;
+
+	if (!page_zero_enabled)
+		return 0;
+
+	for (i = 0; i < NZERO_POOLS; ++i) {
+		pool = zero_pools + i;
+
+		while (READ_ONCE(pool->count) < READ_ONCE(pool->target) &&
+		       nzeroed < max_pages) {
+			page = buddy_find(pool->order);
+
+			if (!page)
+				break;
+
+			memset(page2kva(page), 0, PAGE_SIZE << pool->order);
+
+			if (zero_add(pool, page) < 0) {
+				buddy_free(page);
+				break;
+			}
+
+			nzeroed += 1 << pool->order;
+		}
+	}
+
+	return nzeroed;
+}
+
+/* Takes a cleared chunk of the given order from the pool.
+ *
+ * Returns NULL if the pool has run dry.
+ */
+struct page_info *page_zero_alloc(size_t order)
+{
+	struct zero_pool *pool = zero_pool_of(order);
+	struct page_info *page;
+	struct list *node;
+
+	if (!page_zero_enabled || !pool)
+		return NULL;
+
+	spin_lock(&pool->lock);
+	node = list_pop(&pool->pages);
+
+	if (!node) {
+		++pool->misses;
+		spin_unlock(&pool->lock);
+		return NULL;
+	}
+
+	page = container_of(node, struct page_info, pp_node);
+	page->pp_zpool = 0;
+	--pool->count;
+	++pool->hits;
+	spin_unlock(&pool->lock);
+
+	return page;
+}
+
+/* Returns all the chunks held by the pools to the buddy allocator.
+ * Returns the number of pages that have been drained.
+ */
+size_t page_zero_drain(void)
+{
+	size_t i, ndrained = 0;
+
+	if (!page_zero_enabled)
+		return 0;
+
+	for (i = 0; i < NZERO_POOLS; ++i)
+		ndrained += zero_shrink(zero_pools + i, 0);
+
+	return ndrained;
+}
+
+/* Gets the number of pages held by the pools. */
+size_t count_zero_pages(void)
+{
+	size_t i, nzero_pages = 0;
+
+	for (i = 0; i < NZERO_POOLS; ++i)
+		nzero_pages += zero_pools[i].count << zero_pools[i].order;
+
+	return nzero_pages;
+}
+
+/* Shows the fill level and the hit rate of the pools. */
+void show_zero_info(void)
+{
+	struct zero_pool *pool;
+	size_t i;
+
+	for (i = 0; i < NZERO_POOLS; ++i) {
+		pool = zero_pools + i;
+
+		cprintf("  zeroed order #%u chunks=%u/%u hits=%u misses=%u\n",
+			pool->order, pool->count, pool->target, pool->hits,
+			pool->misses);
+	}
+}
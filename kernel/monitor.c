@@ -6,12 +6,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <rbtree.h>
 
 #include <x86-64/asm.h>
 
+#include <kernel/bench.h>
 #include <kernel/console.h>
 #include <kernel/monitor.h>
 #include <kernel/mem.h>
+#include <kernel/trace.h>
 
 #define CMDBUF_SIZE 80  /* enough for one VGA text line */
 
@@ -27,7 +30,12 @@ static struct command commands[] = {
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace", "Display stack backtrace", mon_backtrace },
 	{ "buddyinfo", "Display debugging information for the buddy allocator", mon_buddyinfo },
+	{ "memstat", "Display allocation statistics and latencies, or reset them", mon_memstat },
+	{ "slabinfo", "Display debugging information for the slab allocator", mon_slabinfo },
+	{ "rbstats", "Display the rebalancing statistics of the rbtrees", mon_rbstats },
+	{ "trace", "Control the trace rings or dump their records", mon_trace },
 	{ "pageinfo", "Display page information for a given page index", mon_pageinfo },
+	{ "bench", "Run the micro-benchmarks, or those starting with a name", mon_bench },
 };
 
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
@@ -92,6 +100,88 @@ int mon_buddyinfo(int argc, char **argv, struct int_frame *frame)
 	return 0;
 }
 
+int mon_memstat(int argc, char **argv, struct int_frame *frame)
+{
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		reset_mem_stats();
+		return 0;
+	}
+
+	if (argc > 1) {
+		cprintf("usage: %s [reset]\n", argv[0]);
+		return 0;
+	}
+
+	show_mem_stats();
+
+	return 0;
+}
+
+int mon_slabinfo(int argc, char **argv, struct int_frame *frame)
+{
+	show_slab_info();
+
+	return 0;
+}
+
+int mon_rbstats(int argc, char **argv, struct int_frame *frame)
+{
+#ifdef RB_STATS
+	cprintf("rotations: %u\n", rb_stats.rotations);
+	cprintf("recolors: %u\n", rb_stats.recolors);
+	cprintf("balance loops: %u\n", rb_stats.balance_loops);
+	cprintf("remove loops: %u\n", rb_stats.remove_loops);
+	cprintf("max depth: %u\n", rb_stats.max_depth);
+#else
+	cprintf("error: rbtree statistics not built in, use DEFS=-DRB_STATS\n");
+#endif
+
+	return 0;
+}
+
+int mon_trace(int argc, char **argv, struct int_frame *frame)
+{
+	uint32_t event = TRACE_NONE;
+	size_t max = TRACE_RING_SIZE;
+	int i;
+
+	if (argc < 2) {
+		cprintf("tracing is %s\n", trace_enabled ? "on" : "off");
+		cprintf("usage: %s [on|off|clear|dump [event] [count]]\n",
+			argv[0]);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "on") == 0) {
+		trace_enable(1);
+	} else if (strcmp(argv[1], "off") == 0) {
+		trace_enable(0);
+	} else if (strcmp(argv[1], "clear") == 0) {
+		trace_clear();
+	} else if (strcmp(argv[1], "dump") == 0) {
+		for (i = 2; i < argc; ++i) {
+			if (*argv[i] >= '0' && *argv[i] <= '9') {
+				max = strtol(argv[i], NULL, 0);
+				continue;
+			}
+
+			event = trace_event_of(argv[i]);
+
+			if (event == TRACE_NONE) {
+				cprintf("error: unknown event %s\n", argv[i]);
+				return 0;
+			}
+		}
+
+		cprintf("%u records\n", trace_dump(event, max));
+	} else {
+		cprintf("usage: %s [on|off|clear|dump [event] [count]]\n",
+			argv[0]);
+	}
+
+	return 0;
+}
+
 int mon_pageinfo(int argc, char **argv, struct int_frame *frame)
 {
 	struct page_info *page;
@@ -129,9 +219,34 @@ int mon_pageinfo(int argc, char **argv, struct int_frame *frame)
 
 	cprintf("  Page index: %u\n", idx);
 	cprintf("  Physical address: %p\n", page2pa(page));
-	cprintf("  State: %s\n", page->pp_free ? "free" : "used");
-	cprintf("  References: %u\n", page->pp_ref);
+	cprintf("  State: %s\n", page->pp_free ? "free" :
+		page->pp_pcp ? "per-CPU cache" :
+		page->pp_zpool ? "zero pool" :
+		page->pp_hpool ? "huge pool" :
+		page->pp_slab ? "slab" : "used");
+	if (page->pp_slab)
+		cprintf("  Cache: %u\n", page->pp_cache);
+	else
+		cprintf("  References: %u\n", page->pp_ref);
 	cprintf("  Order: %u\n", page->pp_order);
+	cprintf("  Zone: %s\n", buddy_zones[page->pp_zone].name);
+	cprintf("  Node: %u\n", buddy_zones[page->pp_zone].node);
+	cprintf("  Pageblock: %s\n",
+		buddy_pageblock_type(page) == MIGRATE_MOVABLE ? "movable" :
+		"unmovable");
+
+	return 0;
+}
+
+int mon_bench(int argc, char **argv, struct int_frame *frame)
+{
+	if (argc > 2) {
+		cprintf("usage: %s [name]\n", argv[0]);
+		return 0;
+	}
+
+	if (bench_run_all(argc > 1 ? argv[1] : NULL) == 0)
+		cprintf("error: no benchmark named %s\n", argv[1]);
 
 	return 0;
 }
@@ -187,6 +302,12 @@ void monitor(struct int_frame *frame)
 	cprintf("Type 'help' for a list of commands.\n");
 
 	while (1) {
+		/* Use the time waiting for input to clear free pages. */
+		page_zero_fill(ZERO_FILL_BATCH);
+
+		/* Get everything out on the serial port before we block. */
+		cons_flush();
+
 		buf = readline("K> ");
 		if (buf != NULL)
 			if (runcmd(buf, frame) < 0)
@@ -1,24 +1,50 @@
 /*
  * Simple implementation of cprintf console output for the kernel, based on
- * printfmt() and the kernel console's cputchar().
+ * vprintfmt_write() and the kernel console's cputs(). The output is collected
+ * in a small buffer, such that the console gets it in runs rather than one
+ * character at a time.
  */
 
 #include <types.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 
-static void putch(int ch, int *cnt)
+struct printbuf {
+	int idx;
+	int cnt;
+	char buf[256];
+};
+
+static void printwrite(const char *str, size_t n, struct printbuf *b)
 {
-	cputchar(ch);
-	*cnt++;
+	b->cnt += n;
+
+	if (b->idx + n > sizeof b->buf) {
+		cputs(b->buf, b->idx);
+		b->idx = 0;
+	}
+
+	/* Runs that do not fit in the buffer go out directly. */
+	if (n > sizeof b->buf) {
+		cputs(str, n);
+		return;
+	}
+
+	memcpy(b->buf + b->idx, str, n);
+	b->idx += n;
 }
 
 int vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
+	struct printbuf b;
 
-	vprintfmt((void*)putch, &cnt, fmt, ap);
-	return cnt;
+	b.idx = 0;
+	b.cnt = 0;
+	vprintfmt_write((void*)printwrite, &b, fmt, ap);
+	cputs(b.buf, b.idx);
+
+	return b.cnt;
 }
 
 int cprintf(const char *fmt, ...)
@@ -0,0 +1,77 @@
+#include <types.h>
+#include <assert.h>
+
+#include <x86-64/asm.h>
+
+#include <kernel/spinlock.h>
+
+void spin_init(struct spinlock *lock, const char *name)
+{
+	lock->locked = 0;
+	lock->name = name;
+	lock->acquired_at = 0;
+	spin_reset_stats(lock);
+}
+
+/* Takes the lock, spinning for as long as some other CPU holds it. */
+void spin_lock(struct spinlock *lock)
+{
+	uint64_t start = read_tsc();
+	int contended = 0;
+
+	while (xchg(&lock->locked, 1)) {
+		contended = 1;
+
+		while (lock->locked)
+			pause();
+	}
+
+	lock->acquired_at = read_tsc();
+	++lock->nacquired;
+
+	if (contended) {
+		++lock->ncontended;
+		lock->spin_cycles += lock->acquired_at - start;
+	}
+}
+
+/* Takes the lock if it is free. Returns 1 if the lock has been taken, and 0
+ * otherwise.
+ */
+int spin_trylock(struct spinlock *lock)
+{
+	if (xchg(&lock->locked, 1))
+		return 0;
+
+	lock->acquired_at = read_tsc();
+	++lock->nacquired;
+
+	return 1;
+}
+
+void spin_unlock(struct spinlock *lock)
+{
+	uint64_t held = read_tsc() - lock->acquired_at;
+
+	if (!lock->locked)
+		panic("spin_unlock: lock %s is not held", lock->name);
+
+	lock->hold_cycles += held;
+	lock->hold_max = MAX(lock->hold_max, held);
+
+	/* Stores are not reordered with older stores, so this only has to keep
+	 * the compiler from sinking the critical section below the release.
+	 */
+	barrier();
+	lock->locked = 0;
+}
+
+/* Clears the counters of the lock. */
+void spin_reset_stats(struct spinlock *lock)
+{
+	lock->nacquired = 0;
+	lock->ncontended = 0;
+	lock->spin_cycles = 0;
+	lock->hold_cycles = 0;
+	lock->hold_max = 0;
+}
@@ -1,31 +1,66 @@
 #include <types.h>
 #include <assert.h>
+#include <btree.h>
+#include <error.h>
+#include <interval_tree.h>
 #include <list.h>
+#include <os_tree.h>
+#include <rbtree.h>
 #include <paging.h>
+#include <string.h>
+#include <timerq.h>
 
+#include <kernel/bench.h>
+#include <kernel/cpu.h>
 #include <kernel/mem.h>
+#include <kernel/trace.h>
 
-extern struct list buddy_free_list[];
+/* Checks that the pages page_init() left for later are set up on demand, and
+ * sets up all of the remaining pages, as the other checks walk every struct
+ * page_info.
+ */
+void lab1_check_deferred_init(void)
+{
+	size_t nfree_pages, n;
+
+	nfree_pages = count_total_free_pages();
+	n = page_init_deferred(1);
+
+	assert(n <= PAGE_INIT_SECTION);
+	assert(count_total_free_pages() >= nfree_pages);
+	assert(count_total_free_pages() <= nfree_pages + n);
+
+	page_init_deferred(SIZE_MAX);
+	assert(page_init_deferred(1) == 0);
+
+	cprintf("[LAB 1] check_deferred_init() succeeded!\n");
+}
 
 /* Checks the number of free pages available in both base memory and high
  * memory.
  */
 void lab1_check_free_list_avail(void)
 {
+	struct buddy_zone *zone;
 	struct page_info *page;
 	struct list *node;
-	size_t order;
+	size_t order, type;
 	size_t nfree_basemem = 0;
 	size_t nfree_extmem = 0;
 
-	for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
-		list_foreach(buddy_free_list + order, node) {
-			page = container_of(node, struct page_info, pp_node);
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		for (type = 0; type < NMIGRATE_TYPES; ++type) {
+			for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
+				list_foreach(zone->free_list[type] + order, node) {
+					page = container_of(node, struct page_info,
+						pp_node);
 
-			if (page2pa(page) < EXT_PHYS_MEM) {
-				++nfree_basemem;
-			} else {
-				++nfree_extmem;
+					if (page2pa(page) < EXT_PHYS_MEM) {
+						++nfree_basemem;
+					} else {
+						++nfree_extmem;
+					}
+				}
 			}
 		}
 	}
@@ -36,22 +71,31 @@ void lab1_check_free_list_avail(void)
 	cprintf("[LAB 1] check_free_list_avail() succeeded!\n");
 }
 
-/* Checks if the order of the free pages on the free list for the respective
- * order matches.
+/* Checks if the order, the zone and the migrate type of the free pages on the
+ * free list for the respective order matches.
  */
 void lab1_check_free_list_order(void)
 {
+	struct buddy_zone *zone;
 	struct page_info *page;
 	struct list *node;
-	size_t order;
+	size_t order, type;
 	size_t nviolations = 0;
 
-	for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
-		list_foreach(buddy_free_list + order, node) {
-			page = container_of(node, struct page_info, pp_node);
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		for (type = 0; type < NMIGRATE_TYPES; ++type) {
+			for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
+				list_foreach(zone->free_list[type] + order, node) {
+					page = container_of(node, struct page_info,
+						pp_node);
 
-			if (page->pp_order != order)
-				++nviolations;
+					if (page->pp_order != order ||
+					    buddy_pageblock_type(page) != type ||
+					    buddy_zones +
+					    buddy_zone_of(page2pa(page)) != zone)
+						++nviolations;
+				}
+			}
 		}
 	}
 
@@ -115,7 +159,8 @@ void check_buddy_consistency(physaddr_t addr, size_t order, struct page_info *pa
 			page2pa(page), page->pp_order);
 	}
 
-	if (!page->pp_free && !list_is_empty(&page->pp_node)) {
+	if (!page->pp_free && !page->pp_pcp && !page->pp_zpool &&
+		!page->pp_hpool && !page->pp_slab && !list_is_empty(&page->pp_node)) {
 		panic("page %p of order %u is in use, but on the free list",
 			page2pa(page), page->pp_order);
 	}
@@ -133,10 +178,17 @@ void check_buddy_consistency(physaddr_t addr, size_t order, struct page_info *pa
 	check_buddy_consistency(addr | (1 << (order + 12)), order, parent);
 }
 
+/* Whether the chunk is on the free lists with the given order. */
+static int free_at(size_t idx, size_t order)
+{
+	return idx < npages && pages[idx].pp_free && pages[idx].pp_order == order;
+}
+
 void lab1_check_buddy_consistency(void)
 {
 	struct page_info *page;
 	physaddr_t addr;
+	size_t order, idx;
 
 	for (addr = 0;
 	     addr < BOOT_MAP_LIM;
@@ -144,15 +196,34 @@ void lab1_check_buddy_consistency(void)
 		check_buddy_consistency(addr, BUDDY_MAX_ORDER - 1, NULL);
 	}
 
+	/* The bitmap of every order should agree with the free lists. */
+	for (order = 0; order < BUDDY_MAX_ORDER - 1; ++order) {
+		for (idx = 0; idx < npages; idx += 2 << order) {
+			if (buddy_map_test(pages + idx, order) !=
+			    (free_at(idx, order) ^ free_at(idx + (1 << order),
+			    order)))
+				panic("bitmap of the buddies of page %p at order "
+					"%u does not match the free lists",
+					idx * PAGE_SIZE, order);
+		}
+	}
+
 	cprintf("[LAB 1] check_buddy_consistency() succeeded!\n");
 }
 
 void lab1_check_split_and_merge(int flags)
 {
-	struct list stolen_free_list[10];
+	static struct buddy_zone stolen_zones[NBUDDY_ZONES];
+	struct buddy_zone *zone;
 	struct page_info *page;
-	size_t order;
+	size_t order, type;
 	size_t nfree_pages;
+	int pcp_enabled;
+
+	/* The checks below look at the buddy free lists directly, so keep the
+	 * per-CPU page caches out of the way.
+	 */
+	pcp_enabled = page_pcp_enable(0);
 
 	/* Count the number of order 9 pages. */
 	nfree_pages = count_free_pages(BUDDY_2M_PAGE);
@@ -172,10 +243,24 @@ void lab1_check_split_and_merge(int flags)
 	/* Check against the count of huge pages. */
 	assert(count_free_pages(BUDDY_2M_PAGE) + 1 == nfree_pages);
 
-	/* Steal the lists of free pages. */
-	for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
-		stolen_free_list[order] = buddy_free_list[order];
-		list_init(buddy_free_list + order);
+	/* Steal the lists of free pages of every zone along with their
+	 * counts.
+	 */
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone) {
+		stolen_zones[zone - buddy_zones] = *zone;
+
+		for (type = 0; type < NMIGRATE_TYPES; ++type) {
+			for (order = 0; order < BUDDY_MAX_ORDER; ++order)
+				list_init(zone->free_list[type] + order);
+
+			zone->free_mask[type] = 0;
+		}
+
+		for (order = 0; order < BUDDY_MAX_ORDER; ++order)
+			zone->nfree[order] = 0;
+
+		zone->nfree_pages = 0;
+		zone->reserve = 0;
 	}
 
 	/* Return the huge page. */
@@ -223,13 +308,14 @@ void lab1_check_split_and_merge(int flags)
 	}
 
 	/* Return the lists of free chunks. */
-	for (order = 0; order < BUDDY_MAX_ORDER; ++order) {
-		buddy_free_list[order] = stolen_free_list[order];
-	}
+	for (zone = buddy_zones; zone < buddy_zones + NBUDDY_ZONES; ++zone)
+		*zone = stolen_zones[zone - buddy_zones];
 
 	/* Return the huge page. */
 	page_free(page);
 
+	page_pcp_enable(pcp_enabled);
+
 #ifdef BONUS_LAB1
 	if (flags & ALLOC_HUGE)
 		cprintf("[LAB 1] check_split_and_merge() for huge pages succeeded!\n");
@@ -239,15 +325,1599 @@ void lab1_check_split_and_merge(int flags)
 
 }
 
-void lab1_check_mem(struct boot_info *boot_info)
+/* Checks that order 0 alloc/free ping-pong is absorbed by the per-CPU page
+ * cache instead of splitting and merging buddy chunks every time.
+ */
+void lab1_check_pcp(void)
 {
-	lab1_check_free_list_avail();
-	lab1_check_free_list_order();
-	lab1_check_memory_layout(boot_info);
+	struct page_info *page;
+	size_t nfree_pages;
+	size_t i;
+
+	/* Prime the per-CPU page cache. */
+	page = page_alloc(0);
+	assert(page);
+	page_free(page);
+
+	nfree_pages = count_total_free_pages();
+
+	for (i = 0; i < 2 * PCP_HIGH; ++i) {
+		page = page_alloc(0);
+		assert(page && !page->pp_free && !page->pp_pcp);
+		page_free(page);
+		assert(count_total_free_pages() == nfree_pages);
+	}
+
+	page_pcp_drain();
+	assert(count_pcp_pages() == 0);
+
+	cprintf("[LAB 1] check_pcp() succeeded!\n");
+}
+
+void lab1_check_bulk(void)
+{
+	struct page_info *pp[100];
+	size_t nfree_pages;
+	size_t i, j, n;
+	int pcp;
+
+	pcp = page_pcp_enable(0);
+	nfree_pages = count_total_free_pages();
+
+	n = page_alloc_bulk(0, 100, pp);
+	assert(n == 100);
+	assert(count_total_free_pages() == nfree_pages - 100);
+
+	for (i = 0; i < n; ++i) {
+		assert(!pp[i]->pp_free && pp[i]->pp_order == 0);
+
+		for (j = 0; j < i; ++j)
+			assert(pp[i] != pp[j]);
+	}
+
+	page_free_bulk(pp, n);
+	assert(count_total_free_pages() == nfree_pages);
+
+	page_pcp_enable(pcp);
 	lab1_check_buddy_consistency();
-	lab1_check_split_and_merge(0);
-#ifdef BONUS_LAB1
-	lab1_check_split_and_merge(ALLOC_HUGE);
-#endif
 
+	cprintf("[LAB 1] check_bulk() succeeded!\n");
+}
+
+void lab1_check_lazy_merge(void)
+{
+	struct page_info *pp[16];
+	size_t nfree[BUDDY_MAX_ORDER];
+	size_t nfree_pages;
+	size_t i, threshold;
+	int pcp;
+
+	pcp = page_pcp_enable(0);
+	nfree_pages = count_total_free_pages();
+
+	for (i = 0; i < BUDDY_MAX_ORDER; ++i)
+		nfree[i] = count_free_pages(i);
+
+	threshold = buddy_set_merge_threshold(64);
+
+	/* Freed pages should stay at their own order. */
+	for (i = 0; i < 16; ++i) {
+		pp[i] = page_alloc(0);
+		assert(pp[i]);
+	}
+
+	for (i = 0; i < 16; ++i) {
+		page_free(pp[i]);
+		assert(pp[i]->pp_free && pp[i]->pp_order == 0);
+	}
+
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	/* Leaving lazy merging should coalesce everything again. */
+	buddy_set_merge_threshold(0);
+	assert(count_total_free_pages() == nfree_pages);
+
+	for (i = 0; i < BUDDY_MAX_ORDER; ++i)
+		assert(count_free_pages(i) == nfree[i]);
+
+	buddy_set_merge_threshold(threshold);
+	page_pcp_enable(pcp);
+
+	cprintf("[LAB 1] check_lazy_merge() succeeded!\n");
+}
+
+void lab1_check_zero_pool(void)
+{
+	struct page_info *page;
+	size_t nfree_pages, nzero_pages;
+	uint8_t *p;
+	size_t i;
+
+	page_pcp_drain();
+	nfree_pages = count_total_free_pages() + count_zero_pages();
+	page_zero_set_target(BUDDY_4K_PAGE, 4);
+	page_zero_fill(ZERO_FILL_BATCH);
+	nzero_pages = count_zero_pages();
+	assert(nzero_pages >= 4);
+
+	/* ALLOC_ZERO should be served from the pool. */
+	page = page_alloc(ALLOC_ZERO);
+	assert(page && !page->pp_zpool);
+	assert(count_zero_pages() == nzero_pages - 1);
+
+	p = page2kva(page);
+
+	for (i = 0; i < PAGE_SIZE; ++i)
+		assert(p[i] == 0);
+
+	/* Dirty the page, it should not end up back in the pool. */
+	memset(p, 0xff, PAGE_SIZE);
+	page_free(page);
+	assert(count_zero_pages() == nzero_pages - 1);
+
+	page_zero_drain();
+	assert(count_zero_pages() == 0);
+	page_zero_set_target(BUDDY_4K_PAGE, ZERO_POOL_4K);
+	page_pcp_drain();
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_zero_pool() succeeded!\n");
+}
+
+void lab1_check_slab(void)
+{
+	struct kmem_cache *cache;
+	struct page_info *page;
+	void *objs[25];
+	size_t nfree_pages;
+	size_t i, j;
+
+	assert(!kmem_cache_create(PAGE_SIZE + 1, 0));
+	assert(!kmem_cache_create(64, 3));
+
+	/* 480 byte objects leave room for colouring the slabs. */
+	cache = kmem_cache_create(470, 32);
+	assert(cache);
+	assert(cache->size == 480 && cache->nobjs == 8);
+
+	page_pcp_drain();
+	nfree_pages = count_total_free_pages();
+
+	for (i = 0; i < length_of(objs); ++i) {
+		objs[i] = kmem_cache_alloc(cache);
+		assert(objs[i]);
+		assert(((uintptr_t)objs[i] & (cache->align - 1)) == 0);
+
+		page = pa2page(PADDR(objs[i]));
+		assert(page->pp_slab && page->pp_cache == cache->id &&
+			!page->pp_free);
+
+		for (j = 0; j < i; ++j)
+			assert(objs[j] != objs[i]);
+
+		memset(objs[i], i, cache->size);
+	}
+
+	assert(cache->nslabs == 4 && cache->nactive == length_of(objs));
+
+	/* Consecutive slabs should start at different colour offsets. */
+	assert(((uintptr_t)objs[0] & (PAGE_SIZE - 1)) !=
+		((uintptr_t)objs[8] & (PAGE_SIZE - 1)));
+
+	for (i = 0; i < length_of(objs); ++i) {
+		for (j = 0; j < cache->size; ++j)
+			assert(((uint8_t *)objs[i])[j] == (uint8_t)i);
+	}
+
+	/* A freed object should be handed out again first. */
+	kmem_cache_free(cache, objs[3]);
+	assert(kmem_cache_alloc(cache) == objs[3]);
+
+	for (i = 0; i < length_of(objs); ++i)
+		kmem_cache_free(cache, objs[i]);
+
+	assert(cache->nactive == 0 && cache->nempty == KMEM_MAX_EMPTY);
+	assert(kmem_cache_shrink(cache) == KMEM_MAX_EMPTY);
+	assert(cache->nslabs == 0);
+
+	page_pcp_drain();
+	assert(count_total_free_pages() == nfree_pages);
+	kmem_cache_destroy(cache);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_slab() succeeded!\n");
+}
+
+void lab1_check_arena(void)
+{
+	struct arena arena;
+	struct arena_mark mark;
+	size_t nfree_pages;
+	char *p, *q;
+	size_t i;
+
+	page_pcp_drain();
+	nfree_pages = count_total_free_pages();
+	arena_init(&arena, ARENA_CHUNK_ORDER);
+
+	assert(!arena_alloc(&arena, 16, 3));
+
+	/* Small allocations should be packed into a single chunk. */
+	p = arena_alloc(&arena, 1, 0);
+	assert(p);
+
+	for (i = 0; i < 64; ++i) {
+		q = arena_alloc(&arena, 24, 8);
+		assert(q && ((uintptr_t)q & 7) == 0 && q > p);
+		memset(q, 0xaa, 24);
+		p = q;
+	}
+
+	assert(arena.nchunks == 1);
+
+	/* Everything allocated after the mark should go away on reset. */
+	arena_mark(&arena, &mark);
+	p = arena_alloc(&arena, 8 * PAGE_SIZE, PAGE_SIZE);
+	assert(p && ((uintptr_t)p & (PAGE_SIZE - 1)) == 0);
+	memset(p, 0x55, 8 * PAGE_SIZE);
+	assert(arena.nchunks == 2);
+	assert(arena_alloc(&arena, 64, 64));
+
+	arena_reset(&arena, &mark);
+	assert(arena.nchunks == 1);
+	assert(arena_alloc(&arena, 24, 8) == mark.cur);
+
+	arena_destroy(&arena);
+	assert(arena.nchunks == 0);
+
+	page_pcp_drain();
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_arena() succeeded!\n");
+}
+
+void lab1_check_buddy_index(void)
+{
+	struct page_info *page, *lowest = NULL, *pp[3];
+	physaddr_t lo, hi;
+	size_t nfree_pages, zone;
+	size_t i;
+
+	page_pcp_drain();
+	nfree_pages = count_total_free_pages();
+	assert(!buddy_find_lowest(BUDDY_4K_PAGE, 0));
+	assert(!buddy_index_enable(1));
+
+	zone = numa_local_node() * NZONES + ZONE_NORMAL;
+
+	if (!buddy_zones[zone].nfree_pages)
+		zone = numa_local_node() * NZONES + ZONE_DMA;
+
+	for (i = 0; i < npages; ++i) {
+		if (pages[i].pp_free && pages[i].pp_zone == zone) {
+			lowest = pages + i;
+			break;
+		}
+	}
+
+	/* The lowest free page of the preferred zone should be handed out
+	 * first.
+	 */
+	pp[0] = page_alloc(ALLOC_LOW);
+	assert(pp[0] == lowest);
+
+	/* Allocate a chunk of order 2 within the upper half of memory. */
+	lo = page2pa(pages + npages / 2);
+	hi = page2pa(pages + npages - 1);
+	pp[1] = buddy_find_range(2, lo, hi);
+	assert(pp[1] && pp[1]->pp_order == 2 && !pp[1]->pp_free);
+	assert(page2pa(pp[1]) >= lo && page2pa(pp[1] + 4) <= hi);
+	assert(((pp[1] - pages) & 3) == 0);
+
+	/* Ask for a single page in the middle of a free range. */
+	for (page = pages + npages / 4; page < pages + npages / 2; ++page) {
+		if (page->pp_free && page->pp_order > 0)
+			break;
+	}
+
+	if (page < pages + npages / 2) {
+		lo = page2pa(page + 1);
+		pp[2] = buddy_find_range(0, lo, lo + PAGE_SIZE);
+		assert(pp[2] == page + 1);
+	} else {
+		pp[2] = NULL;
+	}
+
+	assert(!buddy_find_range(0, lo, lo));
+	assert(!buddy_find_range(2, lo, lo + PAGE_SIZE));
+
+	for (i = 0; i < length_of(pp); ++i) {
+		if (pp[i])
+			buddy_free(pp[i]);
+	}
+
+	assert(buddy_index_enable(0));
+	page_pcp_drain();
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_buddy_index() succeeded!\n");
+}
+
+void lab1_check_zones(void)
+{
+	struct buddy_zone *dma = buddy_zones + ZONE_DMA;
+	struct page_info *page, *pp[2];
+	size_t nfree_pages, reserve, nother, i;
+	int pcp_enabled;
+
+	pcp_enabled = page_pcp_enable(0);
+	page_pcp_drain();
+	page_zero_drain();
+	nfree_pages = count_total_free_pages();
+
+	/* Every free page should be on the free lists of its own zone. */
+	for (page = pages; page < pages + npages; ++page) {
+		if (page->pp_free)
+			assert(page->pp_zone == buddy_zone_of(page2pa(page)));
+	}
+
+	/* DMA allocations must come from below ZONE_DMA_LIM. */
+	pp[0] = page_alloc(ALLOC_DMA);
+	assert(pp[0] && page2pa(pp[0]) < ZONE_DMA_LIM);
+	assert(pp[0]->pp_zone == ZONE_DMA);
+
+	/* Once all of the DMA zone is reserved, only DMA allocations may take
+	 * from it, unless there is memory left in any other zone.
+	 */
+	reserve = dma->reserve;
+	buddy_zone_set_reserve(ZONE_DMA, dma->nfree_pages);
+
+	for (i = 0, nother = 0; i < NBUDDY_ZONES; ++i) {
+		if (i % NZONES <= ZONE_NORMAL && buddy_zones + i != dma)
+			nother += buddy_zones[i].nfree_pages;
+	}
+
+	if (nother == 0)
+		assert(!page_alloc(0));
+
+	pp[1] = page_alloc(ALLOC_DMA);
+	assert(pp[1] && pp[1]->pp_zone == ZONE_DMA);
+
+	buddy_zone_set_reserve(ZONE_DMA, reserve);
+
+	page_free(pp[0]);
+	page_free(pp[1]);
+
+	page_pcp_enable(pcp_enabled);
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_zones() succeeded!\n");
+}
+
+/* Checks that 4K allocations cannot break up the reserved 2M chunks. */
+/* Checks that the NUMA nodes cover all of the memory between them and that
+ * allocations are served by the node they ask for while it has memory.
+ */
+void lab1_check_numa(void)
+{
+	struct numa_node *node;
+	struct buddy_zone *normal;
+	struct page_info *page;
+	size_t i, nfree_pages, nnode_pages = 0;
+	int pcp_enabled;
+
+	assert(nnuma_nodes > 0 && numa_local_node() < nnuma_nodes);
+	assert(numa_nodes[0].base == 0);
+	assert(numa_nodes[nnuma_nodes - 1].end == ~(physaddr_t)0);
+
+	for (node = numa_nodes; node < numa_nodes + nnuma_nodes; ++node) {
+		assert(node == numa_nodes || node->base == node[-1].end);
+		assert(numa_node_of(node->base) == node - numa_nodes);
+		assert(node->pages == pages + MIN(PAGE_INDEX(node->base), npages));
+		nnode_pages += node->npages;
+	}
+
+	assert(nnode_pages == npages);
+
+	/* Every free page should be in a zone of its own node. */
+	for (page = pages; page < pages + npages; ++page) {
+		if (page->pp_free)
+			assert(buddy_zones[page->pp_zone].node ==
+				numa_node_of(page2pa(page)));
+	}
+
+	pcp_enabled = page_pcp_enable(0);
+	nfree_pages = count_total_free_pages();
+
+	for (i = 0; i < nnuma_nodes; ++i) {
+		normal = buddy_zones + i * NZONES + ZONE_NORMAL;
+		page = page_alloc_node(i, 0);
+		assert(page);
+		assert(!normal->nfree_pages || numa_node_of(page2pa(page)) == i);
+		page_free(page);
+	}
+
+	page_pcp_enable(pcp_enabled);
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_numa() succeeded!\n");
+}
+
+void lab1_check_huge_pool(void)
+{
+	struct page_info *page, *huge;
+	struct list used, *node;
+	size_t nfree_pages, nhuge_pages;
+	int pcp_enabled;
+
+	pcp_enabled = page_pcp_enable(0);
+	page_zero_drain();
+	nfree_pages = count_total_free_pages() + count_huge_pages();
+
+	if (page_huge_reserve(HUGE_POOL_2M + 1) <= HUGE_POOL_2M) {
+		cprintf("[LAB 1] check_huge_pool() skipped, no free 2M chunk\n");
+		page_huge_reserve(HUGE_POOL_2M);
+		page_pcp_enable(pcp_enabled);
+		return;
+	}
+
+	nhuge_pages = count_huge_pages();
+	assert(count_total_free_pages() + nhuge_pages == nfree_pages);
+
+	/* Chunks that are out should still count towards the target. */
+	huge = page_alloc(ALLOC_HUGE);
+	assert(huge && huge->pp_order == BUDDY_2M_PAGE);
+	assert(page_huge_reserve(HUGE_POOL_2M + 1) == HUGE_POOL_2M + 1);
+	assert(count_huge_pages() + (1 << BUDDY_2M_PAGE) == nhuge_pages);
+	assert(count_total_free_pages() + nhuge_pages == nfree_pages);
+
+	/* 2M chunks that never came from the pool should not end up in it. */
+	page = buddy_find_flags(BUDDY_2M_PAGE, 0);
+
+	if (page) {
+		assert(!page->pp_hout);
+		page_free(page);
+		assert(count_huge_pages() + (1 << BUDDY_2M_PAGE) ==
+			nhuge_pages);
+	}
+
+	assert(huge->pp_hout);
+	page_free(huge);
+	assert(!huge->pp_hout);
+	assert(count_huge_pages() == nhuge_pages);
+
+	/* Use up all of the 4K pages. */
+	list_init(&used);
+
+	while ((page = page_alloc(0)))
+		list_add(&used, &page->pp_node);
+
+	assert(count_huge_pages() == nhuge_pages);
+
+	/* The pool should still serve huge pages. */
+	huge = page_alloc(ALLOC_HUGE);
+	assert(huge && huge->pp_order == BUDDY_2M_PAGE && !huge->pp_hpool);
+	assert(count_huge_pages() + (1 << BUDDY_2M_PAGE) == nhuge_pages);
+
+	/* And take them back once they are freed. */
+	page_free(huge);
+	assert(count_huge_pages() == nhuge_pages);
+
+	while ((node = list_pop(&used)))
+		page_free(container_of(node, struct page_info, pp_node));
+
+	page_huge_reserve(HUGE_POOL_2M);
+	page_pcp_enable(pcp_enabled);
+	assert(count_total_free_pages() + count_huge_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_huge_pool() succeeded!\n");
+}
+
+/* Checks that movable and unmovable allocations come from different
+ * pageblocks.
+ */
+void lab1_check_migrate_types(void)
+{
+	struct page_info *movable[2], *unmovable;
+	size_t nfree_pages, order;
+	int pcp_enabled, claim;
+
+	pcp_enabled = page_pcp_enable(0);
+	page_zero_drain();
+	nfree_pages = count_total_free_pages();
+
+	/* There is free memory, so at least order 0 cannot be fragmented. */
+	assert(buddy_fragmentation_index(0) == -1000);
+
+	for (order = 0; order < BUDDY_MAX_ORDER; ++order)
+		assert(buddy_fragmentation_index(order) < 1000);
+
+	/* Without any movable pageblocks, the first movable allocation has
+	 * to claim a free pageblock for itself.
+	 */
+	claim = count_free_pages(PAGEBLOCK_ORDER) > 0;
+	movable[0] = page_alloc(ALLOC_MOVABLE);
+	assert(movable[0]);
+
+	if (claim)
+		assert(buddy_pageblock_type(movable[0]) == MIGRATE_MOVABLE);
+
+	/* Which then serves the next movable allocation, but not the
+	 * unmovable ones.
+	 */
+	movable[1] = page_alloc(ALLOC_MOVABLE);
+	unmovable = page_alloc(0);
+	assert(movable[1] && unmovable);
+
+	if (claim) {
+		assert(buddy_pageblock_type(movable[1]) == MIGRATE_MOVABLE);
+		assert(buddy_pageblock_type(unmovable) == MIGRATE_UNMOVABLE);
+		assert((movable[0] - pages) >> PAGEBLOCK_ORDER ==
+			(movable[1] - pages) >> PAGEBLOCK_ORDER);
+	}
+
+	page_free(movable[0]);
+	page_free(movable[1]);
+	page_free(unmovable);
+
+	page_pcp_enable(pcp_enabled);
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+	lab1_check_free_list_order();
+
+	cprintf("[LAB 1] check_migrate_types() succeeded!\n");
+}
+
+/* Checks that page_alloc() and page_free() are accounted for. */
+void lab1_check_mem_stats(void)
+{
+	struct buddy_stats *stats = buddy_stats + cpu_id();
+	struct buddy_stats saved = *stats;
+	struct page_info *page;
+	size_t i, nhist = 0;
+
+	reset_mem_stats();
+
+	page = page_alloc(0);
+	assert(page);
+	page_free(page);
+
+	assert(stats->nallocs[BUDDY_4K_PAGE] == 1);
+	assert(stats->nfrees[BUDDY_4K_PAGE] == 1);
+	assert(stats->nfailed == 0);
+	assert(stats->alloc_max > 0);
+	assert(stats->alloc_cycles == stats->alloc_max);
+
+	for (i = 0; i < MEMSTAT_NBUCKETS; ++i)
+		nhist += stats->alloc_hist[i];
+
+	assert(nhist == 1);
+
+	/* DMA allocations bypass the per-CPU caches and take the zone lock. */
+	reset_mem_stats();
+
+	for (i = 0; i < NBUDDY_ZONES; ++i)
+		assert(buddy_zones[i].lock.nacquired == 0);
+
+	page = page_alloc(ALLOC_DMA);
+	assert(page);
+	buddy_free(page);
+
+	assert(buddy_zones[ZONE_DMA].lock.nacquired == 2);
+	assert(!buddy_zones[ZONE_DMA].lock.locked);
+
+	*stats = saved;
+
+	cprintf("[LAB 1] check_mem_stats() succeeded!\n");
+}
+
+void lab1_check_spinlock(void)
+{
+	struct spinlock lock;
+
+	spin_init(&lock, "test");
+	spin_lock(&lock);
+	assert(lock.locked && lock.nacquired == 1);
+	assert(!spin_trylock(&lock));
+	spin_unlock(&lock);
+
+	assert(!lock.locked && lock.ncontended == 0);
+	assert(spin_trylock(&lock));
+	spin_unlock(&lock);
+	assert(lock.nacquired == 2 && lock.hold_max > 0);
+	assert(lock.hold_cycles >= lock.hold_max);
+
+	cprintf("[LAB 1] check_spinlock() succeeded!\n");
+}
+
+/* Checks that the trace points only record anything while tracing is on. */
+void lab1_check_trace(void)
+{
+	struct page_info *page;
+	int was_enabled;
+
+	was_enabled = trace_enable(1);
+	trace_clear();
+
+	page = page_alloc(0);
+	assert(page);
+	page_free(page);
+
+	trace_enable(0);
+	assert(trace_dump(TRACE_PAGE_ALLOC, 1) == 1);
+	assert(trace_dump(TRACE_PAGE_FREE, 1) == 1);
+
+	trace_clear();
+	page = page_alloc(0);
+	assert(page);
+	page_free(page);
+	assert(trace_dump(TRACE_NONE, TRACE_RING_SIZE) == 0);
+
+	trace_enable(was_enabled);
+
+	cprintf("[LAB 1] check_trace() succeeded!\n");
+}
+
+struct pool_obj {
+	uint64_t key;
+	struct rb_node node;
+};
+
+RB_GENERATE(pool_obj, struct pool_obj, node, key, RB_CMP_NUM)
+
+void lab1_check_rb_pool(void)
+{
+	struct rb_pool pool;
+	struct rb_tree tree;
+	struct rb_node *node;
+	struct pool_obj *obj, *prev, extra;
+	size_t nfree_pages, n;
+	uint64_t key;
+
+	page_pcp_drain();
+	nfree_pages = count_total_free_pages();
+	RB_POOL_INIT(&pool, struct pool_obj, node);
+	rb_init(&tree);
+
+	/* Objects should be carved out of the chunk one after the other. */
+	for (key = 0, prev = NULL; key < 1000; ++key) {
+		node = rb_pool_alloc(&pool);
+		assert(node);
+		obj = pool_obj_entry(node);
+		assert(!prev || (char *)obj == (char *)(prev + 1) ||
+			pool.arena.nchunks > 1);
+		obj->key = key * 7 % 1000;
+		assert(pool_obj_insert(&tree, obj) == 0);
+		prev = obj;
+	}
+
+	assert(pool.nactive == 1000);
+
+	/* Freed nodes should be handed out again before the arena grows. */
+	for (key = 0; key < 1000; key += 2) {
+		obj = pool_obj_find(&tree, key);
+		assert(obj);
+		pool_obj_remove(&tree, obj);
+		rb_pool_free(&pool, &obj->node);
+	}
+
+	assert(pool.nactive == 500);
+	node = rb_pool_alloc(&pool);
+	assert(node == &obj->node && !node->child[0] && !node->child[1]);
+	rb_pool_free(&pool, node);
+
+	n = pool.arena.nchunks;
+
+	for (key = 0; key < 1000; key += 2) {
+		node = rb_pool_alloc(&pool);
+		assert(node);
+		pool_obj_entry(node)->key = key;
+		assert(pool_obj_insert(&tree, pool_obj_entry(node)) == 0);
+	}
+
+	assert(pool.nactive == 1000 && pool.arena.nchunks == n);
+
+	/* Trees with nodes from elsewhere should be refused as they are. */
+	rb_node_init(&extra.node);
+	extra.key = 1000;
+	assert(pool_obj_insert(&tree, &extra) == 0);
+	assert(rb_pool_compact(&pool, &tree) == -EINVAL);
+	assert(pool_obj_find(&tree, 1000) == &extra);
+	pool_obj_remove(&tree, &extra);
+
+	/* Compacting should lay the tree out in breadth-first order. */
+	assert(rb_pool_compact(&pool, &tree) == 0);
+	assert(pool.nactive == 1000 && !pool.free);
+
+	obj = pool_obj_entry(tree.root);
+	assert(pool_obj_entry(tree.root->child[RB_LEFT]) == obj + 1);
+	assert(pool_obj_entry(tree.root->child[RB_RIGHT]) == obj + 2);
+
+	for (node = rb_first(&tree), n = 0; node; node = rb_next(node), ++n) {
+		obj = pool_obj_entry(node);
+		assert(obj->key == n && pool_obj_find(&tree, n) == obj);
+		assert(obj >= pool_obj_entry(tree.root) &&
+			obj < pool_obj_entry(tree.root) + 1000);
+	}
+
+	assert(n == 1000);
+
+	rb_pool_destroy(&pool);
+	assert(pool.nactive == 0 && pool.arena.nchunks == 0);
+
+	page_pcp_drain();
+	assert(count_total_free_pages() == nfree_pages);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_rb_pool() succeeded!\n");
+}
+
+#define RB_TEST_NODES 512
+
+struct rb_test_node {
+	struct rb_node node;
+	uint64_t key;
+	size_t size;
+};
+
+static struct rb_test_node rb_test_nodes[RB_TEST_NODES];
+static struct rb_node *rb_test_ptrs[RB_TEST_NODES];
+static uint64_t rb_test_seed = 1;
+
+#define RB_TEST_KEY RB_KEY_OFFSET(struct rb_test_node, node, key)
+#define rb_test_entry(n) container_of(n, struct rb_test_node, node)
+
+static int rb_test_cmp(const void *lhs, const void *rhs)
+{
+	uint64_t a = *(const uint64_t *)lhs;
+	uint64_t b = *(const uint64_t *)rhs;
+
+	return RB_CMP_NUM(a, b);
+}
+
+/* Returns the next number of a xorshift sequence. */
+static uint64_t rb_test_rand(void)
+{
+	rb_test_seed ^= rb_test_seed << 13;
+	rb_test_seed ^= rb_test_seed >> 7;
+	rb_test_seed ^= rb_test_seed << 17;
+
+	return rb_test_seed;
+}
+
+/* Gives the first n test nodes the keys 0, 2, 4, ..., in order. */
+static void rb_test_fill(size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		rb_node_init(&rb_test_nodes[i].node);
+		rb_test_nodes[i].key = 2 * i;
+		rb_test_ptrs[i] = &rb_test_nodes[i].node;
+	}
+}
+
+/* Checks the parent links of the subtree, that no red node has a red child
+ * and that every path holds the same number of black nodes. Returns the black
+ * height of the subtree.
+ */
+static size_t rb_test_height(struct rb_node *node, struct rb_node *parent)
+{
+	size_t lbh, rbh;
+
+	if (!node)
+		return 1;
+
+	assert(rb_parent(node) == parent);
+	assert(rb_color(node) == RB_BLACK ||
+	    (parent && rb_color(parent) == RB_BLACK));
+
+	lbh = rb_test_height(node->child[RB_LEFT], node);
+	rbh = rb_test_height(node->child[RB_RIGHT], node);
+	assert(lbh == rbh);
+
+	return lbh + (rb_color(node) == RB_BLACK);
+}
+
+/* Checks that the tree is a valid red-black tree of which the keys are in
+ * order and within [lo, hi). Returns the number of nodes in the tree.
+ */
+static size_t rb_test_check(struct rb_tree *tree, uint64_t lo, uint64_t hi)
+{
+	struct rb_test_node *tnode, *prev = NULL;
+	struct rb_node *node;
+	size_t n = 0;
+
+	assert(!tree->root || rb_color(tree->root) == RB_BLACK);
+	rb_test_height(tree->root, NULL);
+
+	rb_foreach(tree, node) {
+		tnode = rb_test_entry(node);
+		assert(tnode->key >= lo && tnode->key < hi);
+		assert(!prev || prev->key <= tnode->key);
+		prev = tnode;
+		++n;
+	}
+
+	return n;
+}
+
+/* Checks that rb_build_sorted(), rb_join() and rb_split() leave valid trees
+ * holding the right nodes.
+ */
+void lab1_check_rb_bulk(void)
+{
+	struct rb_tree tree, right;
+	uint64_t key;
+	size_t i, n, mid;
+
+	/* Building should work for any number of nodes, perfect or not. */
+	for (n = 0; n <= RB_TEST_NODES; n += n < 16 ? 1 : 31) {
+		rb_test_fill(n);
+		assert(rb_build_sorted(&tree, rb_test_ptrs, n) == 0);
+		assert(rb_test_check(&tree, 0, 2 * n) == n);
+	}
+
+	/* Join trees of very different black heights either way round, the
+	 * right one being built by insertions rather than in bulk.
+	 */
+	n = RB_TEST_NODES;
+
+	for (mid = 0; mid <= n; mid += mid < 8 ? 1 : 63) {
+		rb_test_fill(n);
+		assert(rb_build_sorted(&tree, rb_test_ptrs, mid) == 0);
+		rb_init(&right);
+
+		for (i = n; i > mid; --i)
+			assert(rb_insert(&right, rb_test_ptrs[i - 1],
+				rb_test_cmp, RB_TEST_KEY) == 0);
+
+		assert(rb_join(&tree, &right) == 0);
+		assert(!right.root);
+		assert(rb_test_check(&tree, 0, 2 * n) == n);
+	}
+
+	/* Split a tree built in random order at keys that are in the tree, keys
+	 * that are not and keys beyond either end, then join it back up.
+	 */
+	rb_test_fill(n);
+	rb_init(&tree);
+
+	for (i = 0; i < n; ++i)
+		assert(rb_insert(&tree, rb_test_ptrs[i * 7919 % n], rb_test_cmp,
+			RB_TEST_KEY) == 0);
+
+	for (i = 0; i < 64; ++i) {
+		key = i < 2 ? i * 2 * n : rb_test_rand() % (2 * n + 2);
+		assert(rb_split(&tree, &key, rb_test_cmp, RB_TEST_KEY,
+			&right) == 0);
+
+		mid = rb_test_check(&tree, 0, key);
+		assert(mid == MIN((key + 1) / 2, n));
+		assert(rb_test_check(&right, key, 2 * n) == n - mid);
+
+		assert(rb_join(&tree, &right) == 0);
+		assert(rb_test_check(&tree, 0, 2 * n) == n);
+	}
+
+	cprintf("[LAB 1] check_rb_bulk() succeeded!\n");
+}
+
+static struct seqcount rb_seq_test;
+static struct rb_tree rb_seq_tree;
+static struct rb_node *rb_seq_victim;
+static size_t rb_seq_ncmps;
+
+/* Compares like rb_test_cmp(), but the first time it runs into the victim it
+ * replaces the victim by a node with the same key, as a writer running
+ * concurrently with the lookup would.
+ */
+static int rb_seq_cmp(const void *lhs, const void *rhs)
+{
+	struct rb_node *victim = rb_seq_victim;
+	struct rb_test_node *new = rb_test_nodes + RB_TEST_NODES - 1;
+
+	++rb_seq_ncmps;
+
+	if (victim && rhs == RB_KEY(victim, RB_TEST_KEY)) {
+		rb_seq_victim = NULL;
+		write_seqcount_begin(&rb_seq_test);
+		rb_remove(&rb_seq_tree, victim);
+		new->key = rb_test_entry(victim)->key;
+		rb_insert(&rb_seq_tree, &new->node, rb_test_cmp, RB_TEST_KEY);
+		write_seqcount_end(&rb_seq_test);
+	}
+
+	return rb_test_cmp(lhs, rhs);
+}
+
+/* Checks that lookups under a sequence count find the right nodes, and that
+ * a lookup that raced with a writer is retried.
+ */
+void lab1_check_rb_seq(void)
+{
+	struct rb_tree *tree = &rb_seq_tree;
+	struct rb_node *node, *root;
+	uint64_t key;
+	size_t i, n = RB_TEST_NODES - 1;
+
+	seqcount_init(&rb_seq_test);
+	rb_test_fill(n);
+	rb_init(tree);
+
+	for (i = 0; i < n; ++i)
+		rb_insert(tree, rb_test_ptrs[i], rb_test_cmp, RB_TEST_KEY);
+
+	/* A stable tree should give the same results as rb_find(). */
+	for (key = 0; key < 2 * n; ++key) {
+		node = rb_find_seq(tree, &rb_seq_test, &key, rb_seq_cmp,
+			RB_TEST_KEY);
+		assert(node == rb_find(tree, &key, rb_test_cmp, RB_TEST_KEY));
+		assert(key % 2 ? !node : rb_test_entry(node)->key == key);
+	}
+
+	/* The lookup of the root matches after a single comparison, but the
+	 * root is replaced in the meantime: only the retry finds the new node.
+	 */
+	root = tree->root;
+	key = rb_test_entry(root)->key;
+	rb_seq_victim = root;
+	rb_seq_ncmps = 0;
+
+	node = rb_find_seq(tree, &rb_seq_test, &key, rb_seq_cmp, RB_TEST_KEY);
+	assert(!rb_seq_victim && rb_seq_ncmps > 1);
+	assert(node == &rb_test_nodes[n].node);
+	assert(rb_test_check(tree, 0, 2 * n) == n);
+	assert(rb_seq_test.sequence == 2);
+
+	cprintf("[LAB 1] check_rb_seq() succeeded!\n");
+}
+
+/* Links the test node i next to the hint, checking the outermost nodes of
+ * the tree afterwards if it is to be kept as a cached tree.
+ */
+static void rb_test_link(struct rb_tree_cached *ctree, int cached,
+	struct rb_node *hint, size_t i, enum rb_dir dir)
+{
+	struct rb_node *node = rb_test_ptrs[i];
+
+	if (!cached) {
+		if (dir == RB_RIGHT)
+			assert(rb_insert_after(&ctree->tree, hint, node) == 0);
+		else
+			assert(rb_insert_before(&ctree->tree, hint, node) == 0);
+
+		return;
+	}
+
+	if (dir == RB_RIGHT)
+		assert(rb_insert_after_cached(ctree, hint, node) == 0);
+	else
+		assert(rb_insert_before_cached(ctree, hint, node) == 0);
+
+	assert(ctree->leftmost == rb_first(&ctree->tree));
+	assert(ctree->rightmost == rb_last(&ctree->tree));
+}
+
+/* Builds a tree of n test nodes, a multiple of 4, without comparing any keys:
+ * every fourth node is appended, and the others are linked after or before
+ * their neighbours, the last one being linked as the last node of the tree.
+ * Checks that the nodes end up in order.
+ */
+static void rb_test_build_hinted(struct rb_tree_cached *ctree, int cached,
+	size_t n)
+{
+	struct rb_node *node;
+	size_t i;
+
+	rb_test_fill(n);
+	rb_init_cached(ctree);
+
+	for (i = 0; i < n; i += 4)
+		rb_test_link(ctree, cached, i ? rb_test_ptrs[i - 4] : NULL, i,
+			RB_RIGHT);
+
+	for (i = 2; i < n; i += 4) {
+		if (i + 2 < n)
+			rb_test_link(ctree, cached, rb_test_ptrs[i + 2], i,
+				RB_LEFT);
+		else
+			rb_test_link(ctree, cached, rb_test_ptrs[i - 2], i,
+				RB_RIGHT);
+	}
+
+	for (i = 1; i < n; i += 4)
+		rb_test_link(ctree, cached, rb_test_ptrs[i - 1], i, RB_RIGHT);
+
+	for (i = 3; i < n; i += 4)
+		rb_test_link(ctree, cached, i + 1 < n ? rb_test_ptrs[i + 1] :
+			NULL, i, RB_LEFT);
+
+	assert(rb_test_check(&ctree->tree, 0, 2 * n) == n);
+	i = 0;
+
+	rb_foreach(&ctree->tree, node)
+		assert(node == rb_test_ptrs[i++]);
+}
+
+/* Checks the hinted insertions and that popping drains trees in order, with
+ * and without the cached outermost nodes.
+ */
+void lab1_check_rb_hints(void)
+{
+	struct rb_tree_cached ctree;
+	struct rb_tree *tree = &ctree.tree;
+	struct rb_node *node;
+	size_t i, lo, hi, n = RB_TEST_NODES;
+
+	rb_test_build_hinted(&ctree, 0, n);
+
+	for (i = 0; i < n; ++i) {
+		assert(rb_pop_first(tree) == rb_test_ptrs[i]);
+
+		if (i % 64 == 0)
+			assert(rb_test_check(tree, 2 * i, 2 * n) == n - i - 1);
+	}
+
+	assert(!tree->root && !rb_pop_first(tree) && !rb_pop_last(tree));
+	rb_test_build_hinted(&ctree, 0, n);
+
+	for (i = n; i > 0; --i) {
+		assert(rb_pop_last(tree) == rb_test_ptrs[i - 1]);
+
+		if (i % 64 == 0)
+			assert(rb_test_check(tree, 0, 2 * i) == i - 1);
+	}
+
+	assert(!tree->root);
+
+	/* Drain the cached tree from both ends. */
+	rb_test_build_hinted(&ctree, 1, n);
+
+	for (lo = 0, hi = n; lo < hi; ) {
+		if (rb_test_rand() % 2) {
+			node = rb_pop_first_cached(&ctree);
+			assert(node == rb_test_ptrs[lo]);
+			++lo;
+		} else {
+			node = rb_pop_last_cached(&ctree);
+			assert(node == rb_test_ptrs[hi - 1]);
+			--hi;
+		}
+
+		assert(ctree.leftmost == rb_first(tree));
+		assert(ctree.rightmost == rb_last(tree));
+	}
+
+	assert(!tree->root && !ctree.leftmost && !ctree.rightmost);
+	assert(!rb_pop_first_cached(&ctree) && !rb_pop_last_cached(&ctree));
+
+	cprintf("[LAB 1] check_rb_hints() succeeded!\n");
+}
+
+static size_t aug_test_nrotates;
+static size_t aug_test_ncopies;
+
+static size_t aug_test_size(struct rb_node *node)
+{
+	return node ? rb_test_entry(node)->size : 0;
+}
+
+static size_t aug_test_compute(struct rb_node *node)
+{
+	return 1 + aug_test_size(node->child[RB_LEFT]) +
+		aug_test_size(node->child[RB_RIGHT]);
+}
+
+static void aug_test_propagate(struct rb_node *node, struct rb_node *stop)
+{
+	for (; node != stop; node = rb_parent(node))
+		rb_test_entry(node)->size = aug_test_compute(node);
+}
+
+static void aug_test_copy(struct rb_node *old, struct rb_node *new)
+{
+	++aug_test_ncopies;
+	rb_test_entry(new)->size = rb_test_entry(old)->size;
+}
+
+static void aug_test_rotate(struct rb_node *old, struct rb_node *new)
+{
+	++aug_test_nrotates;
+	rb_test_entry(new)->size = rb_test_entry(old)->size;
+	rb_test_entry(old)->size = aug_test_compute(old);
+}
+
+static const struct rb_augment aug_test = {
+	.propagate = aug_test_propagate,
+	.copy = aug_test_copy,
+	.rotate = aug_test_rotate,
+};
+
+/* Checks the size of every node in the subtree and returns that of the
+ * subtree itself.
+ */
+static size_t aug_test_check(struct rb_node *node)
+{
+	size_t size;
+
+	if (!node)
+		return 0;
+
+	size = 1 + aug_test_check(node->child[RB_LEFT]) +
+		aug_test_check(node->child[RB_RIGHT]);
+	assert(rb_test_entry(node)->size == size);
+
+	return size;
+}
+
+/* Checks that the augment callbacks keep the size of every subtree up to
+ * date across the insertions and removals, including their rotations.
+ */
+void lab1_check_rb_augment(void)
+{
+	struct rb_tree tree;
+	struct rb_node *node;
+	size_t i, n = RB_TEST_NODES;
+
+	aug_test_nrotates = 0;
+	aug_test_ncopies = 0;
+	rb_test_fill(n);
+	rb_init(&tree);
+
+	for (i = 0; i < n; ++i) {
+		node = rb_test_ptrs[i * 7919 % n];
+		rb_test_entry(node)->size = 1;
+		_rb_link(&tree, node, rb_test_cmp, RB_TEST_KEY);
+		rb_balance_augmented(&tree, node, &aug_test);
+		assert(aug_test_check(tree.root) == i + 1);
+	}
+
+	assert(rb_test_check(&tree, 0, 2 * n) == n);
+	assert(aug_test_nrotates > 0);
+
+	/* Removals unlink leaves as well as nodes with two children. */
+	for (i = 0; i < n; ++i) {
+		rb_remove_augmented(&tree, rb_test_ptrs[i * 31 % n], &aug_test);
+		assert(aug_test_check(tree.root) == n - i - 1);
+	}
+
+	assert(!tree.root && aug_test_ncopies > 0);
+
+	cprintf("[LAB 1] check_rb_augment() succeeded!\n");
+}
+
+#define IT_TEST_NODES 256
+
+static struct interval_node it_test_nodes[IT_TEST_NODES];
+static int it_test_in[IT_TEST_NODES];
+static size_t it_test_seen[IT_TEST_NODES];
+static size_t it_test_nqueries;
+
+/* Checks the max_end of every node in the subtree and returns that of the
+ * subtree itself.
+ */
+static uint64_t it_test_max_end(struct rb_node *node)
+{
+	struct interval_node *inode;
+	uint64_t max_end;
+
+	if (!node)
+		return 0;
+
+	inode = container_of(node, struct interval_node, node);
+	max_end = MAX(inode->end, MAX(it_test_max_end(node->child[RB_LEFT]),
+		it_test_max_end(node->child[RB_RIGHT])));
+	assert(inode->max_end == max_end);
+
+	return max_end;
+}
+
+/* Checks that the query returns every interval in the tree that overlaps
+ * [start, end) exactly once and in order, compared to a brute-force scan.
+ */
+static void it_test_query(struct interval_tree *itree, uint64_t start,
+	uint64_t end)
+{
+	struct interval_node *inode, *prev = NULL;
+	size_t i, n = 0, nexpected = 0;
+
+	++it_test_nqueries;
+
+	interval_tree_foreach(itree, inode, start, end) {
+		i = inode - it_test_nodes;
+		assert(i < IT_TEST_NODES && it_test_in[i]);
+		assert(it_test_seen[i] != it_test_nqueries);
+		assert(inode->start < end && start < inode->end);
+		assert(!prev || prev->start <= inode->start);
+		it_test_seen[i] = it_test_nqueries;
+		prev = inode;
+		++n;
+	}
+
+	for (i = 0; i < IT_TEST_NODES; ++i) {
+		inode = it_test_nodes + i;
+		nexpected += it_test_in[i] && inode->start < end &&
+			start < inode->end;
+	}
+
+	assert(n == nexpected);
+
+	/* The lookup should find the interval that starts first. */
+	inode = interval_tree_lookup(itree, start);
+
+	for (i = 0; i < IT_TEST_NODES; ++i) {
+		if (!it_test_in[i] || it_test_nodes[i].start > start ||
+		    it_test_nodes[i].end <= start)
+			continue;
+
+		assert(inode && inode->start <= it_test_nodes[i].start);
+	}
+
+	assert(!inode || (inode->start <= start && start < inode->end));
+}
+
+static void it_test_queries(struct interval_tree *itree)
+{
+	uint64_t start;
+	size_t i;
+
+	it_test_max_end(itree->tree.root);
+
+	for (i = 0; i < 64; ++i) {
+		start = rb_test_rand() % 4400;
+		it_test_query(itree, start, start + 1 + rb_test_rand() % 512);
+	}
+}
+
+/* Checks the overlap queries and the max_end of the interval tree across
+ * random insertions and removals.
+ */
+void lab1_check_interval_tree(void)
+{
+	struct interval_tree itree;
+	struct interval_node *inode;
+	size_t i;
+
+	interval_tree_init(&itree);
+	it_test_query(&itree, 0, ~0ull);
+
+	for (i = 0; i < IT_TEST_NODES; ++i) {
+		inode = it_test_nodes + i;
+		inode->start = rb_test_rand() % 4096;
+		inode->end = inode->start + 1 +
+			rb_test_rand() % (i % 16 ? 256 : 2048);
+		interval_tree_insert(&itree, inode);
+		it_test_in[i] = 1;
+		it_test_max_end(itree.tree.root);
+	}
+
+	it_test_queries(&itree);
+
+	/* Remove about half of the intervals, checking along the way. */
+	for (i = 0; i < IT_TEST_NODES; ++i) {
+		if (rb_test_rand() % 2)
+			continue;
+
+		interval_tree_remove(&itree, it_test_nodes + i);
+		it_test_in[i] = 0;
+		it_test_max_end(itree.tree.root);
+	}
+
+	it_test_queries(&itree);
+
+	for (i = 0; i < IT_TEST_NODES; ++i) {
+		if (it_test_in[i])
+			interval_tree_remove(&itree, it_test_nodes + i);
+
+		it_test_in[i] = 0;
+	}
+
+	assert(!itree.tree.root);
+	it_test_query(&itree, 0, ~0ull);
+
+	cprintf("[LAB 1] check_interval_tree() succeeded!\n");
+}
+
+#define OS_TEST_NODES 256
+
+struct os_test_node {
+	struct os_node onode;
+	uint64_t key;
+	size_t seq;
+};
+
+static struct os_test_node os_test_nodes[OS_TEST_NODES];
+static int os_test_in[OS_TEST_NODES];
+
+#define OS_TEST_KEY RB_KEY_OFFSET(struct os_test_node, onode.node, key)
+
+/* Checks that the rank of every node is its position in order, that selecting
+ * that position returns the node, and that nodes with equal keys are in the
+ * order they were inserted in.
+ */
+static void os_test_check(struct os_tree *otree, size_t n)
+{
+	struct os_test_node *tnode, *prev = NULL;
+	struct rb_node *node;
+	size_t rank = 0;
+
+	assert(os_tree_size(otree) == n);
+
+	rb_foreach(&otree->tree, node) {
+		tnode = container_of(node, struct os_test_node, onode.node);
+		assert(os_tree_rank(&tnode->onode) == rank);
+		assert(os_tree_select(otree, rank) == &tnode->onode);
+		assert(!prev || prev->key < tnode->key ||
+			(prev->key == tnode->key && prev->seq < tnode->seq));
+		prev = tnode;
+		++rank;
+	}
+
+	assert(rank == n && !os_tree_select(otree, n));
+}
+
+/* Checks the rank and select of the order-statistic tree across a random
+ * sequence of insertions and removals.
+ */
+void lab1_check_os_tree(void)
+{
+	struct os_tree otree;
+	struct os_test_node *tnode;
+	size_t i, step, n = 0;
+
+	os_tree_init(&otree);
+	os_test_check(&otree, 0);
+	memset(os_test_in, 0, sizeof os_test_in);
+
+	for (step = 0; step < 2048; ++step) {
+		i = rb_test_rand() % OS_TEST_NODES;
+		tnode = os_test_nodes + i;
+
+		if (os_test_in[i]) {
+			os_tree_remove(&otree, &tnode->onode);
+			--n;
+		} else {
+			/* Few distinct keys, to get plenty of duplicates. */
+			tnode->key = rb_test_rand() % 64;
+			tnode->seq = step;
+			os_tree_insert(&otree, &tnode->onode, rb_test_cmp,
+				OS_TEST_KEY);
+			++n;
+		}
+
+		os_test_in[i] = !os_test_in[i];
+		os_test_check(&otree, n);
+	}
+
+	cprintf("[LAB 1] check_os_tree() succeeded!\n");
+}
+
+/* Checks the B+-tree, of which the nodes come from a slab cache. */
+void lab1_check_btree(void)
+{
+	static uint64_t keys[600];
+	static void *vals[600];
+	struct btree tree;
+	struct btree_iter iter;
+	uint64_t key, last;
+	void *val;
+	size_t i, n;
+
+	btree_init(&tree);
+	assert(!btree_find(&tree, 0) && !btree_remove(&tree, 0));
+	assert(btree_insert(&tree, 1, NULL) == -EINVAL);
+
+	/* Insert the keys out of order, such that nodes split all over. */
+	for (i = 0; i < 1000; ++i) {
+		key = i * 7 % 1000;
+		assert(btree_insert(&tree, key, (void *)(key + 1)) == 0);
+	}
+
+	assert(tree.count == 1000 && tree.height > 1);
+	assert(btree_insert(&tree, 7, (void *)1) == -EEXIST);
+
+	for (key = 0; key < 1000; ++key)
+		assert(btree_find(&tree, key) == (void *)(key + 1));
+
+	assert(!btree_find(&tree, 1000));
+
+	/* The leaves should be linked in order. */
+	btree_iter_seek(&iter, &tree, 500);
+
+	for (n = 0; btree_iter_next(&iter, &key, &val); ++n)
+		assert(key == 500 + n && val == (void *)(key + 1));
+
+	assert(n == 500);
+
+	for (key = 0; key < 1000; key += 2)
+		assert(btree_remove(&tree, key) == (void *)(key + 1));
+
+	assert(tree.count == 500 && !btree_remove(&tree, 0));
+
+	for (key = 0; key < 1000; ++key)
+		assert(btree_find(&tree, key) == (key & 1 ? (void *)(key + 1) : NULL));
+
+	btree_destroy(&tree);
+	assert(!tree.root && tree.count == 0);
+
+	/* Bulk load and then scan the whole tree. */
+	for (i = 0; i < length_of(keys); ++i) {
+		keys[i] = 3 * i;
+		vals[i] = (void *)(3 * i + 1);
+	}
+
+	assert(btree_build_sorted(&tree, keys, vals, length_of(keys)) == 0);
+	assert(tree.count == length_of(keys));
+	assert(btree_build_sorted(&tree, keys, vals, 1) == -EINVAL);
+
+	btree_iter_seek(&iter, &tree, 0);
+
+	for (n = 0, last = 0; btree_iter_next(&iter, &key, &val); ++n) {
+		assert(key == keys[n] && val == vals[n]);
+		assert(n == 0 || key > last);
+		last = key;
+	}
+
+	assert(n == length_of(keys));
+	assert(btree_insert(&tree, 4, (void *)5) == 0);
+	assert(btree_find(&tree, 4) == (void *)5 && btree_find(&tree, 3) == vals[1]);
+
+	btree_destroy(&tree);
+	lab1_check_buddy_consistency();
+
+	cprintf("[LAB 1] check_btree() succeeded!\n");
+}
+
+static struct timerq timerq_test;
+static size_t timerq_nfired;
+
+/* Arms the timer again 5 ticks later, the first time it fires. */
+static void timerq_rearm(struct timer *timer)
+{
+	if (timerq_nfired++ == 0)
+		timerq_arm(&timerq_test, timer, timer->deadline + 5);
+}
+
+static void timerq_count(struct timer *timer)
+{
+	++timerq_nfired;
+}
+
+/* Checks that the timers expire in order of their deadlines, and that the
+ * queue reports when the first deadline changes.
+ */
+void lab1_check_timerq(void)
+{
+	struct timerq *q = &timerq_test;
+	struct timer timers[16];
+	size_t i;
+
+	timerq_init(q);
+
+	for (i = 0; i < 16; ++i) {
+		timer_setup(timers + i, timerq_count);
+		assert(timerq_arm(q, timers + i, 100 - i) == 1);
+	}
+
+	assert(q->count == 16 && timerq_first(q) == timers + 15);
+
+	/* Timers with the same deadline should expire in the order armed. */
+	assert(timerq_arm(q, timers + 0, 85) == 0);
+	assert(timerq_first(q) == timers + 15);
+	assert(timerq_cancel(q, timers + 15) == 1);
+	assert(timerq_cancel(q, timers + 15) == 0);
+	assert(!timer_armed(timers + 15) && q->count == 15);
+
+	timerq_nfired = 0;
+	assert(timerq_expire(q, 84) == 0);
+	assert(timerq_expire(q, 86) == 2);
+	assert(!timer_armed(timers + 14) && !timer_armed(timers + 0));
+	assert(timerq_first(q) == timers + 13);
+
+	for (i = 0; i < 16; ++i)
+		timerq_cancel(q, timers + i);
+
+	assert(!timerq_first(q) && q->count == 0);
+
+	/* A timer should be able to arm itself from its callback. */
+	timerq_nfired = 0;
+	timer_setup(timers, timerq_rearm);
+	timerq_arm(q, timers, 10);
+	assert(timerq_expire(q, 20) == 2 && timerq_nfired == 2);
+	assert(!timerq_first(q));
+
+	cprintf("[LAB 1] check_timerq() succeeded!\n");
+}
+
+static size_t bench_test_calls;
+static size_t bench_test_teardowns;
+
+static size_t bench_test_setup(uintptr_t runs)
+{
+	bench_test_calls = 0;
+	return runs;
+}
+
+static void bench_test_body(uintptr_t runs, size_t i)
+{
+	assert(i == bench_test_calls++);
+}
+
+static void bench_test_teardown(uintptr_t runs)
+{
+	++bench_test_teardowns;
+}
+
+/* Checks that a benchmark runs its body once per run in order, and that the
+ * cycles it reports are sorted.
+ */
+void lab1_check_bench(void)
+{
+	struct bench bench = { "test", bench_test_setup, bench_test_body,
+		bench_test_teardown, 100 };
+	struct bench_result result;
+
+	bench_test_teardowns = 0;
+	assert(bench_run(&bench, &result) == 0);
+	assert(result.runs == 100 && bench_test_calls == 100);
+	assert(bench_test_teardowns == 1);
+	assert(result.min <= result.median && result.median <= result.p99);
+
+	/* Setups asking for more runs than there are room for are capped. */
+	bench.arg = BENCH_RUNS + 1;
+	assert(bench_run(&bench, &result) == 0);
+	assert(result.runs == BENCH_RUNS && bench_test_calls == BENCH_RUNS);
+
+	/* Setups asking for no runs skip the benchmark, but still clean up. */
+	bench.arg = 0;
+	assert(bench_run(&bench, &result) == -1);
+	assert(result.runs == 0 && bench_test_calls == 0);
+	assert(bench_test_teardowns == 3);
+
+	cprintf("[LAB 1] check_bench() succeeded!\n");
+}
+
+void lab1_check_mem(struct boot_info *boot_info)
+{
+	lab1_check_deferred_init();
+	lab1_check_free_list_avail();
+	lab1_check_free_list_order();
+	lab1_check_memory_layout(boot_info);
+	lab1_check_buddy_consistency();
+	lab1_check_split_and_merge(0);
+#ifdef BONUS_LAB1
+	lab1_check_split_and_merge(ALLOC_HUGE);
+#endif
+	lab1_check_pcp();
+	lab1_check_bulk();
+	lab1_check_lazy_merge();
+	lab1_check_zero_pool();
+	lab1_check_slab();
+	lab1_check_arena();
+	lab1_check_buddy_index();
+	lab1_check_zones();
+	lab1_check_numa();
+	lab1_check_huge_pool();
+	lab1_check_migrate_types();
+	lab1_check_spinlock();
+	lab1_check_mem_stats();
+	lab1_check_trace();
+	lab1_check_btree();
+	lab1_check_rb_pool();
+	lab1_check_rb_bulk();
+	lab1_check_rb_seq();
+	lab1_check_rb_hints();
+	lab1_check_rb_augment();
+	lab1_check_interval_tree();
+	lab1_check_os_tree();
+	lab1_check_timerq();
+	lab1_check_bench();
 }
@@ -0,0 +1,187 @@
+#include <types.h>
+#include <timerq.h>
+
+#include <x86-64/asm.h>
+#include <x86-64/idt.h>
+
+#include <kernel/lapic.h>
+#include <kernel/pic.h>
+#include <kernel/timer.h>
+
+/* The PIT runs at 1.193182 MHz, channel 2 is gated through port 0x61. */
+#define PIT_HZ        1193182
+#define PIT_CH0       0x40
+#define PIT_CH2       0x42
+#define PIT_CMD       0x43
+#define PIT_GATE      0x61
+#define PIT_GATE_CH2  0x01
+#define PIT_SPEAKER   0x02
+#define PIT_OUT_CH2   0x20
+
+/* Channel, access lo/hi byte, mode 0: interrupt on terminal count. */
+#define PIT_CMD_CH0_ONESHOT 0x30
+#define PIT_CMD_CH2_ONESHOT 0xb0
+
+/* Calibrate the clocks over 10ms. */
+#define CALIBRATE_HZ  100
+
+static struct timerq timers;
+static int timer_mode;
+static uint64_t tsc_hz;
+
+/* APIC timer ticks per TSC cycle, as a 32.32 fixed point number. */
+static uint64_t apic_per_tsc;
+
+/* Measures the frequency of the TSC, and of the APIC timer if it is to be
+ * used, by letting channel 2 of the PIT count down for 1 / CALIBRATE_HZ
+ * seconds.
+ */
+static void calibrate(int apic)
+{
+	uint16_t count = PIT_HZ / CALIBRATE_HZ;
+	uint64_t start, cycles;
+	uint32_t ticks;
+
+	/* Gate channel 2 on, with the speaker off. */
+	outb(PIT_GATE, (inb(PIT_GATE) & ~PIT_SPEAKER) | PIT_GATE_CH2);
+	outb(PIT_CMD, PIT_CMD_CH2_ONESHOT);
+	outb(PIT_CH2, count & 0xff);
+
+	if (apic)
+		lapic_timer_start(IRQ_APIC_TIMER, 0xffffffff, 0);
+
+	outb(PIT_CH2, count >> 8);
+	start = read_tsc();
+
+	while (!(inb(PIT_GATE) & PIT_OUT_CH2))
+		pause();
+
+	cycles = read_tsc() - start;
+	tsc_hz = cycles * CALIBRATE_HZ;
+
+	if (apic) {
+		ticks = 0xffffffff - lapic_timer_current();
+		lapic_timer_stop();
+		apic_per_tsc = ((unsigned __int128)ticks << 32) / cycles;
+	}
+}
+
+/* Converts the number of TSC cycles to ticks of a clock running at hz,
+ * capped at max ticks.
+ */
+static uint64_t cycles_to(uint64_t cycles, uint64_t hz, uint64_t max)
+{
+	unsigned __int128 ticks = (unsigned __int128)cycles * hz / tsc_hz;
+
+	return ticks > max ? max : ticks;
+}
+
+/* Programs the hardware for the deadline of the first timer, or stops it if
+ * there is none. Counters that cannot reach that far fire early, after which
+ * the rest of the time is programmed.
+ */
+static void program(void)
+{
+	struct timer *first = timerq_first(&timers);
+	uint64_t now, delta, ticks;
+
+	if (timer_mode == TIMER_APIC_DEADLINE) {
+		lapic_timer_deadline(IRQ_APIC_TIMER, first ? first->deadline : 0);
+		return;
+	}
+
+	if (!first) {
+		if (timer_mode == TIMER_APIC_ONESHOT)
+			lapic_timer_stop();
+		else if (timer_mode == TIMER_PIT)
+			pic_disable_irq(IRQ_TIMER - IRQ_OFFSET);
+
+		return;
+	}
+
+	now = read_tsc();
+	delta = first->deadline > now ? first->deadline - now : 0;
+
+	if (timer_mode == TIMER_APIC_ONESHOT) {
+		ticks = ((unsigned __int128)delta * apic_per_tsc) >> 32;
+		lapic_timer_start(IRQ_APIC_TIMER, MAX(MIN(ticks, 0xffffffff),
+			1), 0);
+	} else if (timer_mode == TIMER_PIT) {
+		ticks = MAX(cycles_to(delta, PIT_HZ, 0xffff), 1);
+		outb(PIT_CMD, PIT_CMD_CH0_ONESHOT);
+		outb(PIT_CH0, ticks & 0xff);
+		outb(PIT_CH0, ticks >> 8);
+		pic_enable_irq(IRQ_TIMER - IRQ_OFFSET);
+	}
+}
+
+/* Calibrates the TSC and picks the timer hardware. The local APIC has to be
+ * set up already, see lapic_init().
+ */
+void timers_init(void)
+{
+	timerq_init(&timers);
+	calibrate(lapic_enabled() && !lapic_has_tsc_deadline());
+
+	if (lapic_has_tsc_deadline()) {
+		timer_mode = TIMER_APIC_DEADLINE;
+	} else if (lapic_enabled() && apic_per_tsc) {
+		timer_mode = TIMER_APIC_ONESHOT;
+	} else {
+		timer_mode = TIMER_PIT;
+	}
+
+	/* Take channel 0 out of the periodic mode the BIOS left it in: without
+	 * a count it stays idle until the first timer is armed, and IRQ0 stays
+	 * masked for as long as there is no timer.
+	 */
+	outb(PIT_CMD, PIT_CMD_CH0_ONESHOT);
+	pic_disable_irq(IRQ_TIMER - IRQ_OFFSET);
+}
+
+/* Returns the frequency of the TSC, i.e. the number of cycles per second. */
+uint64_t timer_tsc_hz(void)
+{
+	return tsc_hz;
+}
+
+/* Arms the timer to expire once the TSC reaches the deadline. */
+void timer_arm(struct timer *timer, uint64_t deadline)
+{
+	if (timerq_arm(&timers, timer, deadline))
+		program();
+}
+
+/* Arms the timer to expire the given number of TSC cycles from now. */
+void timer_arm_in(struct timer *timer, uint64_t cycles)
+{
+	timer_arm(timer, read_tsc() + cycles);
+}
+
+void timer_cancel(struct timer *timer)
+{
+	if (timerq_cancel(&timers, timer))
+		program();
+}
+
+/* Runs the timers that are due. Returns the number of timers run. */
+size_t timer_poll(void)
+{
+	struct timer *first = timerq_first(&timers);
+	size_t nexpired;
+
+	if (!first || first->deadline > read_tsc())
+		return 0;
+
+	nexpired = timerq_expire(&timers, read_tsc());
+	program();
+
+	return nexpired;
+}
+
+/* Handles the interrupt of the timer hardware. */
+void timer_intr(void)
+{
+	timerq_expire(&timers, read_tsc());
+	program();
+}
@@ -0,0 +1,122 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <x86-64/asm.h>
+
+#include <kernel/cpu.h>
+#include <kernel/trace.h>
+
+int trace_enabled;
+
+static struct trace_ring trace_rings[NCPUS];
+
+static const char *trace_event_names[NTRACE_EVENTS] = {
+	[TRACE_NONE] = "none",
+	[TRACE_PAGE_ALLOC] = "page_alloc",
+	[TRACE_PAGE_FREE] = "page_free",
+	[TRACE_BUDDY_SPLIT] = "buddy_split",
+	[TRACE_BUDDY_MERGE] = "buddy_merge",
+	[TRACE_RB_BALANCE] = "rb_balance",
+	[TRACE_RB_REMOVE] = "rb_remove",
+};
+
+/* Appends a record to the trace ring of the current CPU, see trace(). */
+void trace_log(uint32_t event, uint64_t arg0, uint64_t arg1)
+{
+	struct trace_ring *ring = trace_rings + cpu_id();
+	struct trace_record *record;
+
+	record = ring->records + (ring->head++ & (TRACE_RING_SIZE - 1));
+	record->tsc = read_tsc();
+	record->event = event;
+	record->cpu = cpu_id();
+	record->arg0 = arg0;
+	record->arg1 = arg1;
+}
+
+/* Enables or disables tracing. Returns whether tracing was enabled. */
+int trace_enable(int enable)
+{
+	int was_enabled = trace_enabled;
+
+	trace_enabled = enable;
+
+	return was_enabled;
+}
+
+/* Throws away the records of all the trace rings. */
+void trace_clear(void)
+{
+	size_t i;
+
+	for (i = 0; i < NCPUS; ++i)
+		trace_rings[i].head = 0;
+}
+
+const char *trace_event_name(uint32_t event)
+{
+	if (event >= NTRACE_EVENTS)
+		return "unknown";
+
+	return trace_event_names[event];
+}
+
+/* Returns the event with the given name, or TRACE_NONE if there is none. */
+uint32_t trace_event_of(const char *name)
+{
+	uint32_t event;
+
+	for (event = TRACE_NONE + 1; event < NTRACE_EVENTS; ++event) {
+		if (strcmp(trace_event_names[event], name) == 0)
+			return event;
+	}
+
+	return TRACE_NONE;
+}
+
+/*
+ * Prints the most recent max records of every trace ring, oldest first, with
+ * their timestamps relative to the first record printed. Only records of the
+ * given event are printed, unless event is TRACE_NONE.
+ *
+ * Returns the number of records printed.
+ */
+size_t trace_dump(uint32_t event, size_t max)
+{
+	struct trace_ring *ring;
+	struct trace_record *record;
+	uint64_t base;
+	size_t cpu, first, i, n, nprinted = 0;
+
+	for (cpu = 0; cpu < NCPUS; ++cpu) {
+		ring = trace_rings + cpu;
+		first = ring->head > TRACE_RING_SIZE ?
+			ring->head - TRACE_RING_SIZE : 0;
+
+		/* Find the oldest of the most recent max matching records. */
+		for (i = ring->head, n = 0; i > first && n < max; --i) {
+			record = ring->records + ((i - 1) & (TRACE_RING_SIZE - 1));
+			n += event == TRACE_NONE || record->event == event;
+		}
+
+		base = 0;
+
+		for (; i < ring->head; ++i) {
+			record = ring->records + (i & (TRACE_RING_SIZE - 1));
+
+			if (event != TRACE_NONE && record->event != event)
+				continue;
+
+			if (!base)
+				base = record->tsc;
+
+			cprintf("%u %12lu %-12s %016lx %lx\n", record->cpu,
+				record->tsc - base, trace_event_name(record->event),
+				record->arg0, record->arg1);
+			++nprinted;
+		}
+	}
+
+	return nprinted;
+}
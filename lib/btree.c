@@ -0,0 +1,568 @@
+#include <types.h>
+#include <string.h>
+#include <error.h>
+
+#include <btree.h>
+
+#ifdef OpenLSD_KERNEL
+#include <kernel/mem.h>
+
+/* The cache the nodes of all the trees are allocated from. */
+static struct kmem_cache *btree_node_cache;
+
+static void *node_mem_alloc(void)
+{
+	if (!btree_node_cache)
+		btree_node_cache = kmem_cache_create(sizeof(struct btree_node),
+			KMEM_CACHE_LINE);
+
+	if (!btree_node_cache)
+		return NULL;
+
+	return kmem_cache_alloc(btree_node_cache);
+}
+
+static void node_mem_free(void *node)
+{
+	kmem_cache_free(btree_node_cache, node);
+}
+#else
+#include <stdlib.h>
+
+static void *node_mem_alloc(void)
+{
+	return aligned_alloc(64, sizeof(struct btree_node));
+}
+
+static void node_mem_free(void *node)
+{
+	free(node);
+}
+#endif
+
+static struct btree_node *node_alloc(int leaf)
+{
+	struct btree_node *node = node_mem_alloc();
+
+	if (!node)
+		return NULL;
+
+	node->nkeys = 0;
+	node->leaf = leaf;
+
+	if (leaf)
+		btree_leaf_next(node) = NULL;
+
+	return node;
+}
+
+static void free_subtree(struct btree_node *node)
+{
+	size_t i;
+
+	if (!node->leaf) {
+		for (i = 0; i <= node->nkeys; ++i)
+			free_subtree(node->child[i]);
+	}
+
+	node_mem_free(node);
+}
+
+/*
+ * Returns the number of keys in the node that are smaller than key, or that are
+ * not larger than key if upper is set. As the keys are contiguous, the loop
+ * has no data-dependent branches and stays within the node, which the compiler
+ * turns into SIMD compares where those are available.
+ */
+static __always_inline size_t node_rank(const struct btree_node *node,
+	uint64_t key, int upper)
+{
+	size_t i, rank = 0;
+
+	for (i = 0; i < node->nkeys; ++i)
+		rank += upper ? node->keys[i] <= key : node->keys[i] < key;
+
+	return rank;
+}
+
+/* Returns the leaf that key belongs in. The tree must not be empty. */
+static struct btree_node *find_leaf(struct btree *tree, uint64_t key)
+{
+	struct btree_node *node = tree->root;
+
+	while (!node->leaf)
+		node = node->child[node_rank(node, key, 1)];
+
+	return node;
+}
+
+/* Returns the value stored for key, or NULL if there is none. */
+void *btree_find(struct btree *tree, uint64_t key)
+{
+	struct btree_node *leaf;
+	size_t i;
+
+	if (!tree->root)
+		return NULL;
+
+	leaf = find_leaf(tree, key);
+	i = node_rank(leaf, key, 0);
+
+	if (i < leaf->nkeys && leaf->keys[i] == key)
+		return leaf->vals[i];
+
+	return NULL;
+}
+
+/* Splits the full child i of parent in two halves and adds the separator of
+ * the halves to parent, which must not be full.
+ */
+static int split_child(struct btree_node *parent, size_t i)
+{
+	struct btree_node *child = parent->child[i];
+	struct btree_node *right;
+	size_t mid = BTREE_ORDER / 2;
+	uint64_t sep;
+
+	right = node_alloc(child->leaf);
+
+	if (!right)
+		return -ENOMEM;
+
+	if (child->leaf) {
+		/* The separator is copied up, the right leaf keeps the key. */
+		right->nkeys = child->nkeys - mid;
+		memcpy(right->keys, child->keys + mid,
+			right->nkeys * sizeof *child->keys);
+		memcpy(right->vals, child->vals + mid,
+			right->nkeys * sizeof *child->vals);
+		btree_leaf_next(right) = btree_leaf_next(child);
+		btree_leaf_next(child) = right;
+		sep = right->keys[0];
+	} else {
+		/* The separator moves up. */
+		right->nkeys = child->nkeys - mid - 1;
+		memcpy(right->keys, child->keys + mid + 1,
+			right->nkeys * sizeof *child->keys);
+		memcpy(right->child, child->child + mid + 1,
+			(right->nkeys + 1) * sizeof *child->child);
+		sep = child->keys[mid];
+	}
+
+	child->nkeys = mid;
+
+	memmove(parent->keys + i + 1, parent->keys + i,
+		(parent->nkeys - i) * sizeof *parent->keys);
+	memmove(parent->child + i + 2, parent->child + i + 1,
+		(parent->nkeys - i) * sizeof *parent->child);
+	parent->keys[i] = sep;
+	parent->child[i + 1] = right;
+	++parent->nkeys;
+
+	return 0;
+}
+
+/*
+ * Inserts the value for key, which must not be NULL. Full nodes are split on
+ * the way down, such that there always is room for the separator of a split
+ * child.
+ *
+ * Returns 0 on success, -EEXIST if the key is already in the tree, -EINVAL if
+ * the value is NULL or -ENOMEM if we are out of memory.
+ */
+int btree_insert(struct btree *tree, uint64_t key, void *val)
+{
+	struct btree_node *node, *root;
+	size_t i;
+
+	if (!val)
+		return -EINVAL;
+
+	if (!tree->root) {
+		tree->root = node_alloc(1);
+
+		if (!tree->root)
+			return -ENOMEM;
+
+		tree->height = 1;
+	}
+
+	if (tree->root->nkeys == BTREE_ORDER) {
+		root = node_alloc(0);
+
+		if (!root)
+			return -ENOMEM;
+
+		root->child[0] = tree->root;
+
+		if (split_child(root, 0) < 0) {
+			node_mem_free(root);
+			return -ENOMEM;
+		}
+
+		tree->root = root;
+		++tree->height;
+	}
+
+	node = tree->root;
+
+	while (!node->leaf) {
+		i = node_rank(node, key, 1);
+
+		if (node->child[i]->nkeys == BTREE_ORDER) {
+			if (split_child(node, i) < 0)
+				return -ENOMEM;
+
+			if (key >= node->keys[i])
+				++i;
+		}
+
+		node = node->child[i];
+	}
+
+	i = node_rank(node, key, 0);
+
+	if (i < node->nkeys && node->keys[i] == key)
+		return -EEXIST;
+
+	memmove(node->keys + i + 1, node->keys + i,
+		(node->nkeys - i) * sizeof *node->keys);
+	memmove(node->vals + i + 1, node->vals + i,
+		(node->nkeys - i) * sizeof *node->vals);
+	node->keys[i] = key;
+	node->vals[i] = val;
+	++node->nkeys;
+	++tree->count;
+
+	return 0;
+}
+
+/* Moves the last key of the left sibling of child i of parent over to it. */
+static void borrow_left(struct btree_node *parent, size_t i)
+{
+	struct btree_node *child = parent->child[i];
+	struct btree_node *left = parent->child[i - 1];
+
+	memmove(child->keys + 1, child->keys, child->nkeys * sizeof *child->keys);
+
+	if (child->leaf) {
+		memmove(child->vals + 1, child->vals,
+			child->nkeys * sizeof *child->vals);
+		child->keys[0] = left->keys[left->nkeys - 1];
+		child->vals[0] = left->vals[left->nkeys - 1];
+		parent->keys[i - 1] = child->keys[0];
+	} else {
+		memmove(child->child + 1, child->child,
+			(child->nkeys + 1) * sizeof *child->child);
+		child->keys[0] = parent->keys[i - 1];
+		child->child[0] = left->child[left->nkeys];
+		parent->keys[i - 1] = left->keys[left->nkeys - 1];
+	}
+
+	--left->nkeys;
+	++child->nkeys;
+}
+
+/* Moves the first key of the right sibling of child i of parent over to it. */
+static void borrow_right(struct btree_node *parent, size_t i)
+{
+	struct btree_node *child = parent->child[i];
+	struct btree_node *right = parent->child[i + 1];
+
+	if (child->leaf) {
+		child->keys[child->nkeys] = right->keys[0];
+		child->vals[child->nkeys] = right->vals[0];
+		memmove(right->vals, right->vals + 1,
+			(right->nkeys - 1) * sizeof *right->vals);
+	} else {
+		child->keys[child->nkeys] = parent->keys[i];
+		child->child[child->nkeys + 1] = right->child[0];
+		memmove(right->child, right->child + 1,
+			right->nkeys * sizeof *right->child);
+		parent->keys[i] = right->keys[0];
+	}
+
+	memmove(right->keys, right->keys + 1,
+		(right->nkeys - 1) * sizeof *right->keys);
+	--right->nkeys;
+	++child->nkeys;
+
+	if (child->leaf)
+		parent->keys[i] = right->keys[0];
+}
+
+/* Merges child i + 1 of parent into child i and frees it. */
+static void merge_children(struct btree_node *parent, size_t i)
+{
+	struct btree_node *left = parent->child[i];
+	struct btree_node *right = parent->child[i + 1];
+
+	if (left->leaf) {
+		memcpy(left->keys + left->nkeys, right->keys,
+			right->nkeys * sizeof *right->keys);
+		memcpy(left->vals + left->nkeys, right->vals,
+			right->nkeys * sizeof *right->vals);
+		left->nkeys += right->nkeys;
+		btree_leaf_next(left) = btree_leaf_next(right);
+	} else {
+		left->keys[left->nkeys] = parent->keys[i];
+		memcpy(left->keys + left->nkeys + 1, right->keys,
+			right->nkeys * sizeof *right->keys);
+		memcpy(left->child + left->nkeys + 1, right->child,
+			(right->nkeys + 1) * sizeof *right->child);
+		left->nkeys += right->nkeys + 1;
+	}
+
+	memmove(parent->keys + i, parent->keys + i + 1,
+		(parent->nkeys - i - 1) * sizeof *parent->keys);
+	memmove(parent->child + i + 1, parent->child + i + 2,
+		(parent->nkeys - i - 1) * sizeof *parent->child);
+	--parent->nkeys;
+
+	node_mem_free(right);
+}
+
+/* Makes sure child i of parent has more than the minimum number of keys, by
+ * borrowing a key from a sibling or by merging it with one. Returns the index
+ * of the child that now covers the keys of child i.
+ */
+static size_t fill_child(struct btree_node *parent, size_t i)
+{
+	if (i > 0 && parent->child[i - 1]->nkeys > BTREE_MIN_KEYS) {
+		borrow_left(parent, i);
+		return i;
+	}
+
+	if (i < parent->nkeys && parent->child[i + 1]->nkeys > BTREE_MIN_KEYS) {
+		borrow_right(parent, i);
+		return i;
+	}
+
+	if (i < parent->nkeys) {
+		merge_children(parent, i);
+		return i;
+	}
+
+	merge_children(parent, i - 1);
+	return i - 1;
+}
+
+/*
+ * Removes key from the tree. Nodes with the minimum number of keys are refilled
+ * on the way down, such that removing the key from its leaf never leaves a
+ * node less than half full.
+ *
+ * Returns the value that was stored for key, or NULL if there was none.
+ */
+void *btree_remove(struct btree *tree, uint64_t key)
+{
+	struct btree_node *node = tree->root;
+	void *val;
+	size_t i;
+
+	if (!node)
+		return NULL;
+
+	while (!node->leaf) {
+		i = node_rank(node, key, 1);
+
+		if (node->child[i]->nkeys <= BTREE_MIN_KEYS)
+			i = fill_child(node, i);
+
+		/* Only the root can run out of keys, by merging its last two
+		 * children. */
+		if (node->nkeys == 0) {
+			tree->root = node->child[0];
+			--tree->height;
+			node_mem_free(node);
+			node = tree->root;
+			continue;
+		}
+
+		node = node->child[i];
+	}
+
+	i = node_rank(node, key, 0);
+
+	if (i == node->nkeys || node->keys[i] != key)
+		return NULL;
+
+	val = node->vals[i];
+
+	memmove(node->keys + i, node->keys + i + 1,
+		(node->nkeys - i - 1) * sizeof *node->keys);
+	memmove(node->vals + i, node->vals + i + 1,
+		(node->nkeys - i - 1) * sizeof *node->vals);
+	--node->nkeys;
+	--tree->count;
+
+	if (node->nkeys == 0) {
+		node_mem_free(node);
+		btree_init(tree);
+	}
+
+	return val;
+}
+
+struct build_ctx {
+	const uint64_t *keys;
+	void * const *vals;
+	size_t n;
+	size_t nleaves;
+	struct btree_node *prev;
+};
+
+/* Spreads count items over n slots, returns the index of the first item of
+ * the given slot.
+ */
+static size_t spread(size_t count, size_t n, size_t slot)
+{
+	return slot * (count / n) + (slot < count % n ? slot : count % n);
+}
+
+/* Builds the subtree of the given height over the nleaves leaves starting at
+ * leaf first, where cap is the largest number of leaves the subtree can have.
+ */
+static struct btree_node *build(struct build_ctx *ctx, size_t height,
+	size_t first, size_t nleaves, size_t cap)
+{
+	struct btree_node *node, *child;
+	size_t start, end, nchildren, i;
+
+	if (height == 1) {
+		node = node_alloc(1);
+
+		if (!node)
+			return NULL;
+
+		start = spread(ctx->n, ctx->nleaves, first);
+		end = spread(ctx->n, ctx->nleaves, first + 1);
+		node->nkeys = end - start;
+		memcpy(node->keys, ctx->keys + start, node->nkeys * sizeof *ctx->keys);
+		memcpy(node->vals, ctx->vals + start, node->nkeys * sizeof *ctx->vals);
+
+		if (ctx->prev)
+			btree_leaf_next(ctx->prev) = node;
+
+		ctx->prev = node;
+		return node;
+	}
+
+	node = node_alloc(0);
+
+	if (!node)
+		return NULL;
+
+	cap /= BTREE_ORDER + 1;
+	nchildren = (nleaves + cap - 1) / cap;
+
+	for (i = 0; i < nchildren; ++i) {
+		start = first + spread(nleaves, nchildren, i);
+		end = first + spread(nleaves, nchildren, i + 1);
+		child = build(ctx, height - 1, start, end - start, cap);
+
+		if (!child) {
+			if (i == 0) {
+				node_mem_free(node);
+			} else {
+				node->nkeys = i - 1;
+				free_subtree(node);
+			}
+
+			return NULL;
+		}
+
+		node->child[i] = child;
+
+		if (i > 0)
+			node->keys[i - 1] = ctx->keys[spread(ctx->n, ctx->nleaves, start)];
+	}
+
+	node->nkeys = nchildren - 1;
+	return node;
+}
+
+/*
+ * Builds the tree bottom up from the n keys, which must be strictly
+ * increasing, and their values. The keys are spread evenly over as few leaves
+ * as possible, and the leaves over as few inner nodes as possible, such that
+ * every node is at least half full. The tree must be empty.
+ *
+ * Returns 0 on success, -EINVAL if the tree is not empty or -ENOMEM if we are
+ * out of memory, in which case the tree is left empty.
+ */
+int btree_build_sorted(struct btree *tree, const uint64_t *keys,
+	void * const *vals, size_t n)
+{
+	struct build_ctx ctx = { keys, vals, n, 0, NULL };
+	struct btree_node *root;
+	size_t height = 1, cap = 1;
+
+	if (tree->root)
+		return -EINVAL;
+
+	if (n == 0)
+		return 0;
+
+	ctx.nleaves = (n + BTREE_ORDER - 1) / BTREE_ORDER;
+
+	while (cap < ctx.nleaves) {
+		cap *= BTREE_ORDER + 1;
+		++height;
+	}
+
+	root = build(&ctx, height, 0, ctx.nleaves, cap);
+
+	if (!root)
+		return -ENOMEM;
+
+	tree->root = root;
+	tree->height = height;
+	tree->count = n;
+
+	return 0;
+}
+
+/* Frees all the nodes and leaves the tree empty. */
+void btree_destroy(struct btree *tree)
+{
+	if (tree->root)
+		free_subtree(tree->root);
+
+	btree_init(tree);
+}
+
+/* Positions the iterator at the first key that is not smaller than key. */
+void btree_iter_seek(struct btree_iter *iter, struct btree *tree,
+	uint64_t key)
+{
+	if (!tree->root) {
+		iter->leaf = NULL;
+		iter->pos = 0;
+		return;
+	}
+
+	iter->leaf = find_leaf(tree, key);
+	iter->pos = node_rank(iter->leaf, key, 0);
+}
+
+/* Returns the key and the value at the iterator and moves it to the next key,
+ * following the links between the leaves. Returns 0 once there are no more
+ * keys, 1 otherwise. The tree must not be modified during the scan.
+ */
+int btree_iter_next(struct btree_iter *iter, uint64_t *key, void **val)
+{
+	while (iter->leaf && iter->pos == iter->leaf->nkeys) {
+		iter->leaf = btree_leaf_next(iter->leaf);
+		iter->pos = 0;
+	}
+
+	if (!iter->leaf)
+		return 0;
+
+	*key = iter->leaf->keys[iter->pos];
+	*val = iter->leaf->vals[iter->pos];
+	++iter->pos;
+
+	return 1;
+}
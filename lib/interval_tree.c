@@ -0,0 +1,153 @@
+#include <types.h>
+
+#include <interval_tree.h>
+
+#define to_inode(n) container_of(n, struct interval_node, node)
+
+static uint64_t compute_max_end(struct interval_node *inode)
+{
+	uint64_t max_end = inode->end;
+	struct rb_node *child;
+	size_t i;
+
+	for (i = 0; i < 2; ++i) {
+		child = inode->node.child[i];
+
+		if (child && to_inode(child)->max_end > max_end)
+			max_end = to_inode(child)->max_end;
+	}
+
+	return max_end;
+}
+
+static void augment_propagate(struct rb_node *node, struct rb_node *stop)
+{
+	for (; node != stop; node = rb_parent(node))
+		to_inode(node)->max_end = compute_max_end(to_inode(node));
+}
+
+static void augment_copy(struct rb_node *old, struct rb_node *new)
+{
+	to_inode(new)->max_end = to_inode(old)->max_end;
+}
+
+static void augment_rotate(struct rb_node *old, struct rb_node *new)
+{
+	to_inode(new)->max_end = to_inode(old)->max_end;
+	to_inode(old)->max_end = compute_max_end(to_inode(old));
+}
+
+static const struct rb_augment interval_augment = {
+	.propagate = augment_propagate,
+	.copy = augment_copy,
+	.rotate = augment_rotate,
+};
+
+static int interval_cmp(const void *lhs, const void *rhs)
+{
+	uint64_t a = *(const uint64_t *)lhs;
+	uint64_t b = *(const uint64_t *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+void interval_tree_insert(struct interval_tree *itree,
+	struct interval_node *inode)
+{
+	inode->max_end = inode->end;
+	_rb_link(&itree->tree, &inode->node, interval_cmp,
+		RB_KEY_OFFSET(struct interval_node, node, start));
+	rb_balance_augmented(&itree->tree, &inode->node, &interval_augment);
+}
+
+void interval_tree_remove(struct interval_tree *itree,
+	struct interval_node *inode)
+{
+	rb_remove_augmented(&itree->tree, &inode->node, &interval_augment);
+}
+
+/* Finds the leftmost interval in the subtree of inode that overlaps
+ * [start, end), skipping any subtree that ends before start.
+ */
+static struct interval_node *subtree_search(struct interval_node *inode,
+	uint64_t start, uint64_t end)
+{
+	struct rb_node *child;
+
+	while (1) {
+		child = inode->node.child[RB_LEFT];
+
+		if (child && start < to_inode(child)->max_end) {
+			inode = to_inode(child);
+			continue;
+		}
+
+		if (inode->start < end) {
+			if (start < inode->end)
+				return inode;
+
+			child = inode->node.child[RB_RIGHT];
+
+			if (child && start < to_inode(child)->max_end) {
+				inode = to_inode(child);
+				continue;
+			}
+		}
+
+		return NULL;
+	}
+}
+
+/* Returns the first interval, ordered by start address, that overlaps
+ * [start, end), or NULL if no interval does.
+ */
+struct interval_node *interval_tree_first(struct interval_tree *itree,
+	uint64_t start, uint64_t end)
+{
+	struct interval_node *root;
+
+	if (!itree->tree.root)
+		return NULL;
+
+	root = to_inode(itree->tree.root);
+
+	if (root->max_end <= start)
+		return NULL;
+
+	return subtree_search(root, start, end);
+}
+
+/* Returns the interval following inode that overlaps [start, end), or NULL if
+ * there are no more such intervals.
+ */
+struct interval_node *interval_tree_next(struct interval_node *inode,
+	uint64_t start, uint64_t end)
+{
+	struct rb_node *node = inode->node.child[RB_RIGHT];
+	struct rb_node *prev;
+
+	while (1) {
+		/* Search the right subtree if it may overlap. */
+		if (node && start < to_inode(node)->max_end)
+			return subtree_search(to_inode(node), start, end);
+
+		/* Move up to the first ancestor we reach from the left. */
+		do {
+			node = rb_parent(&inode->node);
+
+			if (!node)
+				return NULL;
+
+			prev = &inode->node;
+			inode = to_inode(node);
+			node = inode->node.child[RB_RIGHT];
+		} while (prev == node);
+
+		/* The ancestors to come only start later. */
+		if (end <= inode->start)
+			return NULL;
+
+		if (start < inode->end)
+			return inode;
+	}
+}
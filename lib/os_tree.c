@@ -0,0 +1,100 @@
+#include <types.h>
+
+#include <os_tree.h>
+
+#define to_onode(n) container_of(n, struct os_node, node)
+
+static size_t subtree_size(struct rb_node *node)
+{
+	return node ? to_onode(node)->size : 0;
+}
+
+static size_t compute_size(struct os_node *onode)
+{
+	return 1 + subtree_size(onode->node.child[RB_LEFT]) +
+		subtree_size(onode->node.child[RB_RIGHT]);
+}
+
+static void augment_propagate(struct rb_node *node, struct rb_node *stop)
+{
+	for (; node != stop; node = rb_parent(node))
+		to_onode(node)->size = compute_size(to_onode(node));
+}
+
+static void augment_copy(struct rb_node *old, struct rb_node *new)
+{
+	to_onode(new)->size = to_onode(old)->size;
+}
+
+static void augment_rotate(struct rb_node *old, struct rb_node *new)
+{
+	to_onode(new)->size = to_onode(old)->size;
+	to_onode(old)->size = compute_size(to_onode(old));
+}
+
+static const struct rb_augment os_augment = {
+	.propagate = augment_propagate,
+	.copy = augment_copy,
+	.rotate = augment_rotate,
+};
+
+/* Inserts the node, of which the key is found at key_offset bytes from the
+ * struct rb_node in onode, as for rb_insert().
+ */
+void os_tree_insert(struct os_tree *otree, struct os_node *onode,
+	rb_cmp_t cmp, ptrdiff_t key_offset)
+{
+	onode->size = 1;
+	_rb_link(&otree->tree, &onode->node, cmp, key_offset);
+	rb_balance_augmented(&otree->tree, &onode->node, &os_augment);
+}
+
+void os_tree_remove(struct os_tree *otree, struct os_node *onode)
+{
+	rb_remove_augmented(&otree->tree, &onode->node, &os_augment);
+}
+
+/* Returns the node at position k in order, or NULL if the tree holds k nodes
+ * or fewer.
+ */
+struct os_node *os_tree_select(struct os_tree *otree, size_t k)
+{
+	struct rb_node *node = otree->tree.root;
+	size_t left;
+
+	while (node) {
+		left = subtree_size(node->child[RB_LEFT]);
+
+		if (k == left)
+			return to_onode(node);
+
+		if (k < left) {
+			node = node->child[RB_LEFT];
+		} else {
+			k -= left + 1;
+			node = node->child[RB_RIGHT];
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the position of the node in order, i.e. the number of nodes that
+ * precede it.
+ */
+size_t os_tree_rank(struct os_node *onode)
+{
+	struct rb_node *node = &onode->node;
+	struct rb_node *parent;
+	size_t rank = subtree_size(node->child[RB_LEFT]);
+
+	/* Every ancestor we reach from the right precedes the node, along with
+	 * its left subtree.
+	 */
+	for (; (parent = rb_parent(node)); node = parent) {
+		if (parent->child[RB_RIGHT] == node)
+			rank += subtree_size(parent->child[RB_LEFT]) + 1;
+	}
+
+	return rank;
+}
@@ -31,23 +31,46 @@ static const char * const error_string[] = {
 };
 
 /*
- * Print a number (base <= 16) in reverse order,
- * using specified putch function and associated pointer putdat.
+ * Print n pad characters c, using the specified write function and associated
+ * pointer putdat.
  */
-static void printnum(void (*putch)(int, void*), void *putdat,
-	 unsigned long long num, unsigned base, int width, int padc)
+static void printpad(void (*write)(const char *, size_t, void *),
+	void *putdat, int c, int n)
 {
-	/* First recursively print all preceding (more significant) digits. */
-	if (num >= base) {
-		printnum(putch, putdat, num / base, base, width - 1, padc);
-	} else {
-		/* print any needed pad characters before first digit. */
-		while (--width > 0)
-			putch(padc, putdat);
+	char pad[16];
+	int len;
+
+	if (n <= 0)
+		return;
+
+	memset(pad, c, MIN(n, (int)sizeof pad));
+
+	for (; n > 0; n -= len) {
+		len = MIN(n, (int)sizeof pad);
+		write(pad, len, putdat);
 	}
+}
 
-	/* Then print this (the least significant) digit. */
-	putch("0123456789abcdef"[num % base], putdat);
+/*
+ * Print a number (base <= 16), padded to width with padc. The digits are
+ * converted from the least significant one into a buffer on the stack, which
+ * is then written at once.
+ */
+static void printnum(void (*write)(const char *, size_t, void *),
+	void *putdat, unsigned long long num, unsigned base, int width, int padc)
+{
+	/* Enough for the 22 octal digits of a 64-bit number. */
+	char buf[24];
+	char *p = buf + sizeof buf;
+
+	do {
+		*--p = "0123456789abcdef"[num % base];
+		num /= base;
+	} while (num);
+
+	/* print any needed pad characters before first digit. */
+	printpad(write, putdat, padc, width - (buf + sizeof buf - p));
+	write(p, buf + sizeof buf - p, putdat);
 }
 
 /*
@@ -78,27 +101,34 @@ static long long getint(va_list *ap, int lflag)
 }
 
 
-/* Main function to format and print a string. */
-void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
+static void printfmt_write(void (*write)(const char *, size_t, void *),
+	void *putdat, const char *fmt, ...);
 
-void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
-		va_list tmp_ap)
+/*
+ * Main function to format and print a string. Runs of literal characters,
+ * formatted numbers and strings are handed to write() as a whole.
+ */
+void vprintfmt_write(void (*write)(const char *, size_t, void *),
+	void *putdat, const char *fmt, va_list tmp_ap)
 {
 	va_list ap;
 	register const char *p;
 	register int ch, err;
 	unsigned long long num;
-	int base, lflag, width, precision, altflag;
-	char padc;
+	int base, lflag, width, precision, altflag, len, i, j;
+	char padc, c;
 
 	va_copy(ap, tmp_ap);
 
 	while (1) {
-		while ((ch = *(unsigned char *) fmt++) != '%') {
-			if (ch == '\0')
-				return;
-			putch(ch, putdat);
-		}
+		for (p = fmt; *fmt != '%' && *fmt != '\0'; ++fmt)
+			/* do nothing */;
+
+		if (fmt != p)
+			write(p, fmt - p, putdat);
+
+		if (*fmt++ == '\0')
+			return;
 
 		/* Process a %-escape sequence. */
 		padc = ' ';
@@ -162,7 +192,8 @@ void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
 
 		/* character */
 		case 'c':
-			putch(va_arg(ap, int), putdat);
+			c = va_arg(ap, int);
+			write(&c, 1, putdat);
 			break;
 
 		/* error message */
@@ -171,33 +202,41 @@ void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
 			if (err < 0)
 				err = -err;
 			if (err >= length_of(error_string) || (p = error_string[err]) == NULL)
-				printfmt(putch, putdat, "error %d", err);
+				printfmt_write(write, putdat, "error %d", err);
 			else
-				printfmt(putch, putdat, "%s", p);
+				write(p, strlen(p), putdat);
 			break;
 
 		/* string */
 		case 's':
 			if ((p = va_arg(ap, char *)) == NULL)
 				p = "(null)";
+			len = strnlen(p, precision);
 			if (width > 0 && padc != '-')
-				for (width -= strnlen(p, precision); width > 0; width--)
-					putch(padc, putdat);
-			for (; (ch = *p++) != '\0' && (precision < 0 || --precision >= 0);
-					width--)
-				if (altflag && (ch < ' ' || ch > '~'))
-					putch('?', putdat);
-				else
-					putch(ch, putdat);
-			for (; width > 0; width--)
-				putch(' ', putdat);
+				printpad(write, putdat, padc, width - len);
+			if (altflag) {
+				/* write the runs of printable characters in between the
+				 * ones replaced by '?' */
+				for (i = 0; i < len; i = j + 1) {
+					for (j = i; j < len && p[j] >= ' ' && p[j] <= '~'; j++)
+						/* do nothing */;
+					if (j > i)
+						write(p + i, j - i, putdat);
+					if (j < len)
+						write("?", 1, putdat);
+				}
+			} else {
+				write(p, len, putdat);
+			}
+			if (padc == '-')
+				printpad(write, putdat, ' ', width - len);
 			break;
 
 		/* (signed) decimal */
 		case 'd':
 			num = getint(&ap, lflag);
 			if ((long long) num < 0) {
-				putch('-', putdat);
+				write("-", 1, putdat);
 				num = -(long long) num;
 			}
 			base = 10;
@@ -217,8 +256,7 @@ void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
 
 		/* pointer */
 		case 'p':
-			putch('0', putdat);
-			putch('x', putdat);
+			write("0x", 2, putdat);
 			num = (unsigned long long)
 				(uintptr_t) va_arg(ap, void *);
 			base = 16;
@@ -229,17 +267,17 @@ void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
 			num = getuint(&ap, lflag);
 			base = 16;
 		number:
-			printnum(putch, putdat, num, base, width, padc);
+			printnum(write, putdat, num, base, width, padc);
 			break;
 
 		/* escaped '%' character */
 		case '%':
-			putch(ch, putdat);
+			write("%", 1, putdat);
 			break;
 
 		/* unrecognized escape sequence - just print it literally */
 		default:
-			putch('%', putdat);
+			write("%", 1, putdat);
 			for (fmt--; fmt[-1] != '%'; fmt--)
 				/* do nothing */;
 			break;
@@ -247,6 +285,36 @@ void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
 	}
 }
 
+static void printfmt_write(void (*write)(const char *, size_t, void *),
+	void *putdat, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintfmt_write(write, putdat, fmt, ap);
+	va_end(ap);
+}
+
+/* Adapts a putch function to the write interface of vprintfmt_write(). */
+struct putchbuf {
+	void (*putch)(int, void*);
+	void *putdat;
+};
+
+static void putchwrite(const char *buf, size_t n, struct putchbuf *b)
+{
+	while (n--)
+		b->putch(*buf++, b->putdat);
+}
+
+void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt,
+		va_list ap)
+{
+	struct putchbuf b = {putch, putdat};
+
+	vprintfmt_write((void*)putchwrite, &b, fmt, ap);
+}
+
 void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...)
 {
 	va_list ap;
@@ -262,11 +330,13 @@ struct sprintbuf {
 	int cnt;
 };
 
-static void sprintputch(int ch, struct sprintbuf *b)
+static void sprintwrite(const char *buf, size_t n, struct sprintbuf *b)
 {
-	b->cnt++;
-	if (b->buf < b->ebuf)
-		*b->buf++ = ch;
+	size_t len = MIN(n, (size_t)(b->ebuf - b->buf));
+
+	b->cnt += n;
+	memcpy(b->buf, buf, len);
+	b->buf += len;
 }
 
 int vsnprintf(char *buf, int n, const char *fmt, va_list ap)
@@ -277,7 +347,7 @@ int vsnprintf(char *buf, int n, const char *fmt, va_list ap)
 		return -EINVAL;
 
 	/* Print the string to the buffer. */
-	vprintfmt((void*)sprintputch, &b, fmt, ap);
+	vprintfmt_write((void*)sprintwrite, &b, fmt, ap);
 
 	/* Null terminate the buffer. */
 	*b.buf = '\0';
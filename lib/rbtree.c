@@ -2,41 +2,17 @@
 
 #include <rbtree.h>
 
-static void rotate_node(struct rb_tree *tree, struct rb_node *node,
-	enum rb_dir dir)
-{
-	struct rb_node *parent = node->parent;
-	struct rb_node *child = node->child[!dir];
-
-	if ((node->child[!dir] = child->child[dir])) {
-		child->child[dir]->parent = node;
-	}
+#include "rbtree_impl.h"
 
-	child->child[dir] = node;
-	child->parent = parent;
+#ifdef OpenLSD_KERNEL
+#include <kernel/trace.h>
+#else
+#define trace(event, arg0, arg1) ((void)0)
+#endif
 
-	if (parent) {
-		parent->child[parent->child[RB_RIGHT] == node] = child;
-	} else {
-		tree->root = child;
-	}
-
-	node->parent = child;
-}
-
-static struct rb_node *get_outermost(struct rb_node *node,
-	enum rb_dir dir)
-{
-	if (!node) {
-		return NULL;
-	}
-
-	while (node->child[dir]) {
-		node = node->child[dir];
-	}
-	
-	return node;
-}
+#ifdef RB_STATS
+struct rb_stats rb_stats;
+#endif
 
 static struct rb_node *get_closest(struct rb_node *node,
 	enum rb_dir dir)
@@ -49,7 +25,7 @@ static struct rb_node *get_closest(struct rb_node *node,
 	if (node->child[dir])
 		return get_outermost(node->child[dir], !dir);
 
-	while ((parent = node->parent) && parent->child[dir] == node)
+	while ((parent = rb_parent(node)) && parent->child[dir] == node)
 		node = parent;
 
 	return parent;
@@ -75,185 +51,590 @@ struct rb_node *rb_prev(struct rb_node *node)
 	return get_closest(node, RB_LEFT);
 }
 
-int rb_balance(struct rb_tree *tree, struct rb_node *node)
+/* Starts iterating at the first node of the tree in the given direction, i.e.
+ * at the leftmost node for RB_RIGHT and at the rightmost node for RB_LEFT.
+ */
+void rb_iter_init(struct rb_iter *iter, struct rb_tree *tree, enum rb_dir dir)
 {
-	struct rb_node *parent, *grandparent, *uncle;
-	enum rb_dir dir;
+	rb_iter_init_at(iter, get_outermost(tree->root, !dir), dir);
+}
 
-	if (!tree || !node)
-		return -1;
+/* Starts iterating at the given node in the given direction, e.g. to scan a
+ * range starting at a node found by a lookup.
+ */
+void rb_iter_init_at(struct rb_iter *iter, struct rb_node *node,
+	enum rb_dir dir)
+{
+	iter->next = node;
+	iter->dir = dir;
+
+	if (node)
+		__builtin_prefetch(node);
+}
 
-	node->color = RB_RED;
+/* Returns the next node and looks up and prefetches the node after that.
+ * Returns NULL once all the nodes have been visited.
+ */
+struct rb_node *rb_iter_next(struct rb_iter *iter)
+{
+	struct rb_node *node = iter->next;
 
-	while ((parent = node->parent) && parent->color == RB_RED) {
-		grandparent = parent->parent;
-		dir = grandparent->child[RB_LEFT] == parent;
-		uncle = grandparent->child[dir];
+	if (!node)
+		return NULL;
 
-		if (uncle && uncle->color == RB_RED) {
-			parent->color = RB_BLACK;
-			uncle->color = RB_BLACK;
-			grandparent->color = RB_RED;
-			node = grandparent;
+	iter->next = get_closest(node, iter->dir);
 
-			continue;
-		}
+	if (iter->next)
+		__builtin_prefetch(iter->next);
 
-		if (parent->child[dir] == node) {
-			rotate_node(tree, parent, !dir);
-			node = parent;
-			parent = node->parent;
-		}
+	return node;
+}
 
-		parent->color = RB_BLACK;
-		grandparent->color = RB_RED;
+/* Returns a node with a key equal to key, or NULL if there is none. */
+struct rb_node *rb_find(struct rb_tree *tree, const void *key, rb_cmp_t cmp,
+	ptrdiff_t key_offset)
+{
+	return _rb_find(tree, key, cmp, key_offset);
+}
 
-		rotate_node(tree, grandparent, dir);
-	}
+/*
+ * Looks up a node with a key equal to key without taking any locks, while a
+ * single writer may be modifying the tree within write_seqcount_begin() and
+ * write_seqcount_end() on seq. The lookup is retried whenever it may have
+ * raced with the writer. The nodes must not be freed while readers may still
+ * be looking at them.
+ */
+struct rb_node *rb_find_seq(struct rb_tree *tree, struct seqcount *seq,
+	const void *key, rb_cmp_t cmp, ptrdiff_t key_offset)
+{
+	struct rb_node *node;
+	uint32_t start;
 
-	tree->root->color = RB_BLACK;
+	do {
+		start = read_seqcount_begin(seq);
+		node = _rb_find_lockless(tree, key, cmp, key_offset);
+	} while (read_seqcount_retry(seq, start));
 
-	return 0;
+	return node;
 }
 
-static int do_remove(struct rb_tree *tree,
-	struct rb_node *node)
+/* Returns the first node with a key that is not smaller than key. */
+struct rb_node *rb_lower_bound(struct rb_tree *tree, const void *key,
+	rb_cmp_t cmp, ptrdiff_t key_offset)
+{
+	return _rb_bound(tree, key, cmp, key_offset, 0);
+}
+
+/* Returns the first node with a key that is larger than key. */
+struct rb_node *rb_upper_bound(struct rb_tree *tree, const void *key,
+	rb_cmp_t cmp, ptrdiff_t key_offset)
 {
-	struct rb_node *parent, *child;
-	enum rb_dir dir, child_dir;
+	return _rb_bound(tree, key, cmp, key_offset, 1);
+}
+
+/* Inserts the node at the position given by its key and rebalances the tree.
+ * Nodes with equal keys are kept in insertion order.
+ */
+int rb_insert(struct rb_tree *tree, struct rb_node *node, rb_cmp_t cmp,
+	ptrdiff_t key_offset)
+{
+	return _rb_insert(tree, node, cmp, key_offset);
+}
+
+/* Like rb_insert(), but for trees that cache their outermost nodes. */
+int rb_insert_cached(struct rb_tree_cached *ctree, struct rb_node *node,
+	rb_cmp_t cmp, ptrdiff_t key_offset)
+{
+	return _rb_insert_cached(ctree, node, cmp, key_offset);
+}
+
+/* Links the node into the tree right next to hint, on the side dir of it, or
+ * as the outermost node on the other side if there is no hint.
+ */
+static void link_beside(struct rb_tree *tree, struct rb_node *hint,
+	struct rb_node *node, enum rb_dir dir)
+{
+	struct rb_node *parent;
+
+	if (!hint) {
+		parent = get_outermost(tree->root, !dir);
+		_rb_link_node(parent ? parent->child + !dir : &tree->root,
+			parent, node);
+	} else if (!hint->child[dir]) {
+		_rb_link_node(hint->child + dir, hint, node);
+	} else {
+		parent = get_outermost(hint->child[dir], !dir);
+		_rb_link_node(parent->child + !dir, parent, node);
+	}
+}
 
+/*
+ * Inserts the node right after hint, which must be in the tree, or as the
+ * first node if hint is NULL, without comparing any keys: the caller has to
+ * make sure that the key of the node lies between those of hint and of the
+ * node after it. Appending after the last node, e.g. for monotonic keys such
+ * as sequence numbers or timestamps, then skips the descent from the root and
+ * takes amortized O(1) time.
+ */
+int rb_insert_after(struct rb_tree *tree, struct rb_node *hint,
+	struct rb_node *node)
+{
 	if (!tree || !node)
 		return -1;
 
-	parent = node->parent;
+	link_beside(tree, hint, node, RB_RIGHT);
 
-	if (node->child[RB_LEFT] && node->child[RB_RIGHT]) {
-		child = node->child[RB_LEFT];
-		child = get_outermost(child, RB_RIGHT);
-		do_remove(tree, child);
+	return rb_balance(tree, node);
+}
 
-		child->child[RB_LEFT] = node->child[RB_LEFT];
+/* Like rb_insert_after(), but inserts the node right before hint, or as the
+ * last node if hint is NULL.
+ */
+int rb_insert_before(struct rb_tree *tree, struct rb_node *hint,
+	struct rb_node *node)
+{
+	if (!tree || !node)
+		return -1;
 
-		if (node->child[RB_LEFT])
-			node->child[RB_LEFT]->parent = child;
+	link_beside(tree, hint, node, RB_LEFT);
 
-		child->child[RB_RIGHT] = node->child[RB_RIGHT];
+	return rb_balance(tree, node);
+}
 
-		if (node->child[RB_RIGHT])
-			node->child[RB_RIGHT]->parent = child;
-	} else {
-		child_dir = !node->child[RB_LEFT];
-		child = node->child[child_dir];
-	}
+/* Like rb_insert_after(), for trees that cache their outermost nodes. Pass
+ * rb_last_cached() as the hint to append in constant time.
+ */
+int rb_insert_after_cached(struct rb_tree_cached *ctree, struct rb_node *hint,
+	struct rb_node *node)
+{
+	if (!ctree || !node)
+		return -1;
 
-	if (parent) {
-		dir = parent->child[RB_RIGHT] == node;
-		parent->child[dir] = child;
-	} else {
-		tree->root = child;
-	}
+	link_beside(&ctree->tree, hint, node, RB_RIGHT);
 
-	if (child)
-		child->parent = parent;
+	return rb_balance_cached(ctree, node);
+}
 
-	memset(node, 0, sizeof *node);
+int rb_insert_before_cached(struct rb_tree_cached *ctree,
+	struct rb_node *hint, struct rb_node *node)
+{
+	if (!ctree || !node)
+		return -1;
 
-	return 0;
+	link_beside(&ctree->tree, hint, node, RB_LEFT);
+
+	return rb_balance_cached(ctree, node);
 }
 
-int rb_remove(struct rb_tree *tree, struct rb_node *node)
+/*
+ * Rebalances the tree after the node has been linked into it as a leaf. For
+ * augmented trees, the aggregates are first propagated from the new leaf up
+ * to the root and then kept up to date across the rotations.
+ */
+int rb_balance_augmented(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug)
 {
-	struct rb_node *sibling, *child, *other;
-	enum rb_dir dir, child_dir;
+#ifdef RB_STATS
+	struct rb_node *cur;
+	size_t depth = 0;
+#endif
 
 	if (!tree || !node)
 		return -1;
 
-	child_dir = !node->child[RB_LEFT];
-	child = node->child[child_dir];
-	other = node->child[!child_dir];
+#ifdef RB_STATS
+	for (cur = node; cur; cur = rb_parent(cur))
+		depth++;
 
-	do_remove(tree, node);
+	if (depth > rb_stats.max_depth)
+		rb_stats.max_depth = depth;
+#endif
 
-	if (!child && !other)
-		return 0;
+	trace(TRACE_RB_BALANCE, node, tree);
+	rb_set_color(node, RB_RED);
 
-	if (node->color == RB_RED)
-		return 0;
+	if (aug)
+		aug->propagate(node, NULL);
 
-	node = child;
+	_rb_insert_fixup(tree, node, aug);
 
-	if (node->color == RB_RED) {
-		node->color = RB_BLACK;
-		return 0;
-	}
+	return 0;
+}
+
+int rb_balance(struct rb_tree *tree, struct rb_node *node)
+{
+	return rb_balance_augmented(tree, node, NULL);
+}
 
-	while (node->parent) {
-		dir = node->parent->child[RB_LEFT] == node;
-		sibling = node->parent->child[dir];
+/*
+ * Removes the node from the tree and rebalances it. For augmented trees, the
+ * aggregates are kept up to date along the way.
+ */
+int rb_remove_augmented(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug)
+{
+	if (!tree || !node)
+		return -1;
 
-		if (!sibling) {
-			break;
-		}
-
-		if (sibling->color == RB_RED) {
-			node->parent->color = RB_RED;
-			sibling->color = RB_BLACK;
-			rotate_node(tree, node->parent, !dir);
-			sibling = node->parent->child[dir];
-		};
-
-		if ((!sibling->child[!dir] || sibling->child[!dir]->color ==
-		    RB_BLACK) &&
-		    (!sibling->child[dir] || sibling->child[dir]->color ==
-		    RB_BLACK)) {
-			sibling->color = RB_RED;
-			node = node->parent;
-			continue;
-		}
-
-		if (!sibling->child[dir] || sibling->child[dir]->color ==
-		    RB_BLACK) {
-			sibling->color = RB_RED;
-			sibling->child[!dir]->color = RB_BLACK;
-			rotate_node(tree, node->parent, dir);
-			sibling = node->parent->child[dir];
-		}
-
-		sibling->color = node->parent->color;
-		node->parent->color = RB_BLACK;
-		sibling->child[dir]->color = RB_BLACK;
-		rotate_node(tree, node->parent, !dir);
-
-		node = tree->root;
-	}
+	trace(TRACE_RB_REMOVE, node, tree);
+	_rb_erase(tree, node, aug);
+	rb_node_init(node);
+
+	return 0;
+}
+
+int rb_remove(struct rb_tree *tree, struct rb_node *node)
+{
+	return rb_remove_augmented(tree, node, NULL);
+}
+
+/*
+ * Removes and returns the outermost node in the given direction, or NULL if the
+ * tree is empty. Being outermost, the node has at most one child, so it is
+ * unlinked without looking for a successor.
+ */
+static struct rb_node *pop(struct rb_tree *tree, enum rb_dir dir)
+{
+	struct rb_node *node = get_outermost(tree->root, dir);
 
 	if (node)
-		node->color = RB_BLACK;
+		rb_remove(tree, node);
 
-	return 0;
+	return node;
+}
+
+/* Removes and returns the first node, e.g. to use the tree as a priority
+ * queue, or NULL if the tree is empty.
+ */
+struct rb_node *rb_pop_first(struct rb_tree *tree)
+{
+	return pop(tree, RB_LEFT);
+}
+
+struct rb_node *rb_pop_last(struct rb_tree *tree)
+{
+	return pop(tree, RB_RIGHT);
 }
 
 int rb_replace(struct rb_tree *tree, struct rb_node *node,
 	struct rb_node *new_node)
 {
+	struct rb_node *parent;
+
 	if (!node || !new_node)
 		return -1;
 
-	if (node->parent)
-		node->parent->child[node->parent->child[RB_RIGHT] == node] =
-			new_node;
-	else
-		tree->root = new_node;
+	parent = rb_parent(node);
+
+	/* Set up the new node before publishing it. */
+	*new_node = *node;
+	change_child(tree, parent, node, new_node);
 
 	if (node->child[RB_LEFT])
-		node->child[RB_LEFT]->parent = new_node;
+		rb_set_parent(node->child[RB_LEFT], new_node);
 
 	if (node->child[RB_RIGHT])
-		node->child[RB_RIGHT]->parent = new_node;
+		rb_set_parent(node->child[RB_RIGHT], new_node);
 
-	*new_node = *node;
+	return 0;
+}
+
+
+/* Links nodes[0..n) into a perfectly balanced subtree below parent at the given
+ * depth. Only the nodes at red_depth are colored red.
+ */
+static struct rb_node *build_sorted(struct rb_node **nodes, size_t n,
+	struct rb_node *parent, size_t depth, size_t red_depth)
+{
+	struct rb_node *node;
+	size_t mid = n / 2;
+
+	if (n == 0)
+		return NULL;
+
+	node = nodes[mid];
+	node->parent_color = (uintptr_t)parent |
+		(depth == red_depth ? RB_RED : RB_BLACK);
+	node->child[RB_LEFT] = build_sorted(nodes, mid, node, depth + 1,
+		red_depth);
+	node->child[RB_RIGHT] = build_sorted(nodes + mid + 1, n - mid - 1, node,
+		depth + 1, red_depth);
+
+	return node;
+}
+
+/*
+ * Builds the tree from the n nodes in nodes[], which must be sorted, in a
+ * single linear pass without any rotations. The existing contents of the tree
+ * are discarded.
+ *
+ * Splitting at the middle node keeps all the missing children within the two
+ * deepest levels. Unless the tree is perfect, coloring the nodes of the
+ * deepest level red and all others black satisfies the red-black properties.
+ */
+int rb_build_sorted(struct rb_tree *tree, struct rb_node **nodes, size_t n)
+{
+	size_t height = 0, red_depth;
+
+	if (!tree || (n && !nodes))
+		return -1;
+
+	while (((size_t)1 << height) - 1 < n)
+		++height;
+
+	red_depth = (((size_t)1 << height) - 1 == n) ? (size_t)-1 : height - 1;
+	tree->root = build_sorted(nodes, n, NULL, 0, red_depth);
+
+	return 0;
+}
+
+/* Returns the number of black nodes on the leftmost path of the subtree. */
+static size_t black_height(struct rb_node *node)
+{
+	size_t height = 0;
+
+	for (; node; node = node->child[RB_LEFT])
+		height += rb_color(node) == RB_BLACK;
+
+	return height;
+}
+
+/*
+ * Joins the trees rooted at left and right, with black heights lbh and rbh,
+ * using pivot as the node in between: every key in left must be smaller than
+ * or equal to the key of pivot, which must be smaller than or equal to every
+ * key in right. The pivot is linked as a red node at the point along the spine
+ * of the taller tree where the black heights match, which then only needs the
+ * regular insertion fixup. This takes O(|lbh - rbh| + 1) time.
+ *
+ * Returns the new root and stores its black height in bh.
+ */
+static struct rb_node *join(struct rb_node *left, size_t lbh,
+	struct rb_node *pivot, struct rb_node *right, size_t rbh, size_t *bh)
+{
+	struct rb_tree tree;
+	struct rb_node *parent = NULL, *node;
+	size_t height;
+	enum rb_dir dir;
+
+	/* Roots must be black. */
+	if (left && rb_color(left) == RB_RED) {
+		rb_set_color(left, RB_BLACK);
+		++lbh;
+	}
+
+	if (right && rb_color(right) == RB_RED) {
+		rb_set_color(right, RB_BLACK);
+		++rbh;
+	}
+
+	if (lbh == rbh) {
+		pivot->parent_color = (uintptr_t)NULL | RB_BLACK;
+		pivot->child[RB_LEFT] = left;
+		pivot->child[RB_RIGHT] = right;
+
+		if (left)
+			rb_set_parent(left, pivot);
+
+		if (right)
+			rb_set_parent(right, pivot);
+
+		*bh = lbh + 1;
+
+		return pivot;
+	}
+
+	/* Descend along the inner spine of the taller tree. */
+	dir = lbh > rbh ? RB_RIGHT : RB_LEFT;
+	tree.root = node = lbh > rbh ? left : right;
+	height = lbh > rbh ? lbh : rbh;
+	*bh = height;
+
+	while (rb_color(node) == RB_RED || height > (lbh > rbh ? rbh : lbh)) {
+		height -= rb_color(node) == RB_BLACK;
+		parent = node;
+		node = node->child[dir];
+
+		if (!node)
+			break;
+	}
+
+	/* Take the place of node and adopt it along with the shorter tree. */
+	pivot->child[!dir] = node;
+	pivot->child[dir] = lbh > rbh ? right : left;
+	parent->child[dir] = pivot;
+	pivot->parent_color = (uintptr_t)parent | RB_RED;
+
+	if (pivot->child[RB_LEFT])
+		rb_set_parent(pivot->child[RB_LEFT], pivot);
+
+	if (pivot->child[RB_RIGHT])
+		rb_set_parent(pivot->child[RB_RIGHT], pivot);
+
+	*bh += _rb_insert_fixup(&tree, pivot, NULL);
+
+	return tree.root;
+}
+
+/*
+ * Appends right to tree: every key in tree must be smaller than or equal to
+ * every key in right. The leftmost node of right serves as the pivot of the
+ * join. Afterwards right is empty. This takes O(log n) time.
+ *
+ * Not for augmented trees.
+ */
+int rb_join(struct rb_tree *tree, struct rb_tree *right)
+{
+	struct rb_node *pivot;
+	size_t bh;
+
+	if (!tree || !right)
+		return -1;
+
+	if (!right->root)
+		return 0;
+
+	pivot = rb_first(right);
+	rb_remove(right, pivot);
+
+	tree->root = join(tree->root, black_height(tree->root), pivot,
+		right->root, black_height(right->root), &bh);
+	rb_set_parent(tree->root, NULL);
+	right->root = NULL;
 
 	return 0;
 }
 
+/* Splits the subtree rooted at node with black height bh into the nodes with
+ * keys smaller than key and the other nodes.
+ */
+static void split(struct rb_node *node, size_t bh, const void *key,
+	rb_cmp_t cmp, ptrdiff_t key_offset, struct rb_node **left, size_t *lbh,
+	struct rb_node **right, size_t *rbh)
+{
+	struct rb_node *lchild, *rchild, *rest;
+	size_t child_bh, rest_bh;
+
+	if (!node) {
+		*left = *right = NULL;
+		*lbh = *rbh = 0;
+		return;
+	}
+
+	child_bh = bh - (rb_color(node) == RB_BLACK);
+	lchild = node->child[RB_LEFT];
+	rchild = node->child[RB_RIGHT];
+
+	if (lchild)
+		rb_set_parent(lchild, NULL);
+
+	if (rchild)
+		rb_set_parent(rchild, NULL);
+
+	if (cmp(key, RB_KEY(node, key_offset)) <= 0) {
+		split(lchild, child_bh, key, cmp, key_offset, left, lbh, &rest,
+			&rest_bh);
+		*right = join(rest, rest_bh, node, rchild, child_bh, rbh);
+	} else {
+		split(rchild, child_bh, key, cmp, key_offset, &rest, &rest_bh,
+			right, rbh);
+		*left = join(lchild, child_bh, node, rest, rest_bh, lbh);
+	}
+}
+
+/*
+ * Splits tree at key: the nodes with keys smaller than key remain in tree and
+ * the others are moved to right, whose existing contents are discarded. This
+ * takes O(log n) time.
+ *
+ * Not for augmented trees.
+ */
+int rb_split(struct rb_tree *tree, const void *key, rb_cmp_t cmp,
+	ptrdiff_t key_offset, struct rb_tree *right)
+{
+	size_t lbh, rbh;
+
+	if (!tree || !right)
+		return -1;
+
+	split(tree->root, black_height(tree->root), key, cmp, key_offset,
+		&tree->root, &lbh, &right->root, &rbh);
+
+	if (tree->root)
+		rb_set_parent(tree->root, NULL);
+
+	if (right->root)
+		rb_set_parent(right->root, NULL);
+
+	return 0;
+}
+
+/* Like rb_balance() for a node that has just been linked into the tree as a
+ * leaf. A new leaf can only become the leftmost node by being linked as the
+ * left child of the current leftmost node, and likewise for the rightmost.
+ */
+int rb_balance_cached(struct rb_tree_cached *ctree, struct rb_node *node)
+{
+	if (!ctree || !node)
+		return -1;
+
+	if (!ctree->leftmost || ctree->leftmost->child[RB_LEFT] == node)
+		ctree->leftmost = node;
+
+	if (!ctree->rightmost || ctree->rightmost->child[RB_RIGHT] == node)
+		ctree->rightmost = node;
+
+	return rb_balance(&ctree->tree, node);
+}
+
+int rb_remove_cached(struct rb_tree_cached *ctree, struct rb_node *node)
+{
+	if (!ctree || !node)
+		return -1;
+
+	if (ctree->leftmost == node)
+		ctree->leftmost = rb_next(node);
+
+	if (ctree->rightmost == node)
+		ctree->rightmost = rb_prev(node);
+
+	return rb_remove(&ctree->tree, node);
+}
+
+/* Like rb_pop_first(), but takes the cached node rather than descending the
+ * tree, and the node after it becomes the first in amortized O(1) time.
+ */
+struct rb_node *rb_pop_first_cached(struct rb_tree_cached *ctree)
+{
+	struct rb_node *node = ctree->leftmost;
+
+	if (node)
+		rb_remove_cached(ctree, node);
+
+	return node;
+}
+
+struct rb_node *rb_pop_last_cached(struct rb_tree_cached *ctree)
+{
+	struct rb_node *node = ctree->rightmost;
+
+	if (node)
+		rb_remove_cached(ctree, node);
+
+	return node;
+}
+
+int rb_replace_cached(struct rb_tree_cached *ctree, struct rb_node *node,
+	struct rb_node *new_node)
+{
+	if (!ctree || !node || !new_node)
+		return -1;
+
+	if (ctree->leftmost == node)
+		ctree->leftmost = new_node;
+
+	if (ctree->rightmost == node)
+		ctree->rightmost = new_node;
+
+	return rb_replace(&ctree->tree, node, new_node);
+}
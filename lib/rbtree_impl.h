@@ -0,0 +1,75 @@
+#pragma once
+
+#include <rbtree.h>
+
+/*
+ * Shared between lib/rbtree.c and the rebalancing code, of which the kernel
+ * links either lib/rbtree_lib.c or lib/rbtree_linux.c (see RBTREE_IMPL in
+ * kernel/Makefiles/lab1-files.mk). Both provide _rb_insert_fixup() and
+ * _rb_erase() on top of the same struct rb_node, so the choice does not show
+ * in the API.
+ *
+ * Lockless readers may descend the tree while it is being modified (see
+ * rb_find_seq()). Every store to a child pointer or to the root therefore goes
+ * through WRITE_ONCE(), and a node is only published once its own children
+ * have been set up, such that readers never see a torn pointer or a node that
+ * is not linked up yet.
+ */
+
+#ifdef RB_STATS
+#define RB_STAT_INC(field) (rb_stats.field++)
+#else
+#define RB_STAT_INC(field) ((void)0)
+#endif
+
+/* Replaces the child old of parent by new, or the root if there is no parent.
+ */
+static inline void change_child(struct rb_tree *tree, struct rb_node *parent,
+	struct rb_node *old, struct rb_node *new)
+{
+	smp_wmb();
+
+	if (parent)
+		WRITE_ONCE(parent->child[parent->child[RB_RIGHT] == old], new);
+	else
+		WRITE_ONCE(tree->root, new);
+}
+
+static inline struct rb_node *get_outermost(struct rb_node *node,
+	enum rb_dir dir)
+{
+	if (!node)
+		return NULL;
+
+	while (node->child[dir])
+		node = node->child[dir];
+
+	return node;
+}
+
+/* Sets the color of a node during rebalancing. */
+static __always_inline void recolor(struct rb_node *node, enum rb_color color)
+{
+#ifdef RB_STATS
+	if (rb_color(node) != color)
+		RB_STAT_INC(recolors);
+#endif
+
+	rb_set_color(node, color);
+}
+
+static inline int is_black(struct rb_node *node)
+{
+	return !node || rb_color(node) == RB_BLACK;
+}
+
+/* Fixes up the red node after it has been linked into the tree. Returns 1 if
+ * the root had to be turned black again, i.e. if the fixup raised the black
+ * height of the tree by one, and 0 otherwise.
+ */
+int _rb_insert_fixup(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug);
+
+/* Unlinks the node and rebalances the tree, see rb_remove_augmented(). */
+void _rb_erase(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug);
@@ -0,0 +1,187 @@
+/*
+ * The rebalancing of the red-black trees in lib/rbtree.c, as they have been
+ * from the start: rotations go through rotate_node(), which relinks the three
+ * nodes involved, and the nodes are recolored separately.
+ */
+#include <rbtree.h>
+
+#include "rbtree_impl.h"
+
+static void rotate_node(struct rb_tree *tree, struct rb_node *node,
+	enum rb_dir dir, const struct rb_augment *aug)
+{
+	struct rb_node *parent = rb_parent(node);
+	struct rb_node *child = node->child[!dir];
+
+	RB_STAT_INC(rotations);
+
+	WRITE_ONCE(node->child[!dir], child->child[dir]);
+
+	if (child->child[dir]) {
+		rb_set_parent(child->child[dir], node);
+	}
+
+	WRITE_ONCE(child->child[dir], node);
+	rb_set_parent(child, parent);
+	change_child(tree, parent, node, child);
+	rb_set_parent(node, child);
+
+	/* The child now covers the subtree the node used to cover. */
+	if (aug)
+		aug->rotate(node, child);
+}
+
+int _rb_insert_fixup(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug)
+{
+	struct rb_node *parent, *grandparent, *uncle;
+	enum rb_dir dir;
+	int grew;
+
+	while ((parent = rb_parent(node)) && rb_color(parent) == RB_RED) {
+		RB_STAT_INC(balance_loops);
+
+		grandparent = rb_parent(parent);
+		dir = grandparent->child[RB_LEFT] == parent;
+		uncle = grandparent->child[dir];
+
+		if (uncle && rb_color(uncle) == RB_RED) {
+			recolor(parent, RB_BLACK);
+			recolor(uncle, RB_BLACK);
+			recolor(grandparent, RB_RED);
+			node = grandparent;
+
+			continue;
+		}
+
+		if (parent->child[dir] == node) {
+			rotate_node(tree, parent, !dir, aug);
+			node = parent;
+			parent = rb_parent(node);
+		}
+
+		recolor(parent, RB_BLACK);
+		recolor(grandparent, RB_RED);
+
+		rotate_node(tree, grandparent, dir, aug);
+	}
+
+	grew = rb_color(tree->root) == RB_RED;
+	recolor(tree->root, RB_BLACK);
+
+	return grew;
+}
+
+/*
+ * Restores the red-black properties after a black node has been unlinked. The
+ * unlinked node has been replaced by node, which lacks one black node on all
+ * its paths and may be NULL, hence the explicit parent.
+ */
+static void remove_fixup(struct rb_tree *tree, struct rb_node *node,
+	struct rb_node *parent, const struct rb_augment *aug)
+{
+	struct rb_node *sibling;
+	enum rb_dir dir;
+
+	while (node != tree->root && is_black(node)) {
+		RB_STAT_INC(remove_loops);
+
+		/* The direction of the sibling. */
+		dir = parent->child[RB_LEFT] == node;
+		sibling = parent->child[dir];
+
+		/* Make sure the sibling is black. */
+		if (rb_color(sibling) == RB_RED) {
+			recolor(sibling, RB_BLACK);
+			recolor(parent, RB_RED);
+			rotate_node(tree, parent, !dir, aug);
+			sibling = parent->child[dir];
+		}
+
+		/* Recolor the sibling and push the problem up the tree. */
+		if (is_black(sibling->child[RB_LEFT]) &&
+		    is_black(sibling->child[RB_RIGHT])) {
+			recolor(sibling, RB_RED);
+			node = parent;
+			parent = rb_parent(node);
+			continue;
+		}
+
+		/* Make sure the outer child of the sibling is red. */
+		if (is_black(sibling->child[dir])) {
+			recolor(sibling->child[!dir], RB_BLACK);
+			recolor(sibling, RB_RED);
+			rotate_node(tree, sibling, dir, aug);
+			sibling = parent->child[dir];
+		}
+
+		recolor(sibling, rb_color(parent));
+		recolor(parent, RB_BLACK);
+		recolor(sibling->child[dir], RB_BLACK);
+		rotate_node(tree, parent, !dir, aug);
+
+		node = tree->root;
+	}
+
+	if (node)
+		recolor(node, RB_BLACK);
+}
+
+/*
+ * Unlinks the node from the tree. A node with two children is replaced by its
+ * in-order successor, which takes over the position and the color of the node.
+ * For augmented trees, the successor takes over the aggregate of the node, and
+ * the aggregates are propagated from where a node was unlinked up to the root
+ * before rebalancing.
+ */
+void _rb_erase(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug)
+{
+	struct rb_node *child, *parent, *succ;
+	enum rb_color color;
+
+	if (!node->child[RB_LEFT] || !node->child[RB_RIGHT]) {
+		/* Unlink the node and move its only child up. */
+		child = node->child[!node->child[RB_LEFT]];
+		parent = rb_parent(node);
+		color = rb_color(node);
+
+		change_child(tree, parent, node, child);
+
+		if (child)
+			rb_set_parent(child, parent);
+	} else {
+		/* Unlink the successor and move it into the place of the node. */
+		succ = get_outermost(node->child[RB_RIGHT], RB_LEFT);
+		child = succ->child[RB_RIGHT];
+		color = rb_color(succ);
+
+		if (rb_parent(succ) == node) {
+			parent = succ;
+		} else {
+			parent = rb_parent(succ);
+			WRITE_ONCE(parent->child[RB_LEFT], child);
+
+			if (child)
+				rb_set_parent(child, parent);
+
+			WRITE_ONCE(succ->child[RB_RIGHT], node->child[RB_RIGHT]);
+			rb_set_parent(succ->child[RB_RIGHT], succ);
+		}
+
+		WRITE_ONCE(succ->child[RB_LEFT], node->child[RB_LEFT]);
+		rb_set_parent(succ->child[RB_LEFT], succ);
+
+		change_child(tree, rb_parent(node), node, succ);
+		succ->parent_color = node->parent_color;
+
+		if (aug)
+			aug->copy(node, succ);
+	}
+
+	if (aug && parent)
+		aug->propagate(parent, NULL);
+
+	if (color == RB_BLACK)
+		remove_fixup(tree, child, parent, aug);
+}
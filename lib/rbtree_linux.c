@@ -0,0 +1,266 @@
+/*
+ * The rebalancing of the red-black trees in lib/rbtree.c the way Linux does
+ * it in lib/rbtree.c there. Rather than going through a generic rotation and
+ * recoloring the nodes afterwards, every case of the fixups writes its final
+ * links and colors directly, and the parent and the color of a node are set
+ * with a single store. Removing a node with a single child only recolors that
+ * child, which is red, and only the removal of a black leaf needs a fixup.
+ *
+ * Both fixups are written for the node being on the side dir of its parent,
+ * such that the mirrored cases share the same code.
+ */
+#include <rbtree.h>
+
+#include "rbtree_impl.h"
+
+static __always_inline void set_parent_color(struct rb_node *node,
+	struct rb_node *parent, enum rb_color color)
+{
+#ifdef RB_STATS
+	if (rb_color(node) != color)
+		RB_STAT_INC(recolors);
+#endif
+
+	node->parent_color = (uintptr_t)parent | color;
+}
+
+/* Finishes a rotation in which new has taken the place of old: new takes over
+ * the parent and the color of old, and old becomes a child of new of the given
+ * color.
+ */
+static __always_inline void rotate_set_parents(struct rb_tree *tree,
+	struct rb_node *old, struct rb_node *new, enum rb_color color,
+	const struct rb_augment *aug)
+{
+	struct rb_node *parent = rb_parent(old);
+
+	RB_STAT_INC(rotations);
+
+	new->parent_color = old->parent_color;
+	set_parent_color(old, new, color);
+	change_child(tree, parent, old, new);
+
+	if (aug)
+		aug->rotate(old, new);
+}
+
+int _rb_insert_fixup(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug)
+{
+	struct rb_node *parent, *grandparent, *uncle, *tmp;
+	enum rb_dir dir;
+	int grew;
+
+	while ((parent = rb_parent(node)) && rb_color(parent) == RB_RED) {
+		RB_STAT_INC(balance_loops);
+
+		grandparent = rb_parent(parent);
+		dir = grandparent->child[RB_RIGHT] == parent;
+		uncle = grandparent->child[!dir];
+
+		if (uncle && rb_color(uncle) == RB_RED) {
+			set_parent_color(uncle, grandparent, RB_BLACK);
+			set_parent_color(parent, grandparent, RB_BLACK);
+			node = grandparent;
+			set_parent_color(node, rb_parent(node), RB_RED);
+
+			continue;
+		}
+
+		tmp = parent->child[!dir];
+
+		/* The inner case: rotate the node above its parent. */
+		if (node == tmp) {
+			tmp = node->child[dir];
+			WRITE_ONCE(parent->child[!dir], tmp);
+			WRITE_ONCE(node->child[dir], parent);
+
+			if (tmp)
+				set_parent_color(tmp, parent, RB_BLACK);
+
+			set_parent_color(parent, node, RB_RED);
+			RB_STAT_INC(rotations);
+
+			if (aug)
+				aug->rotate(parent, node);
+
+			parent = node;
+			tmp = node->child[!dir];
+		}
+
+		/* The outer case: rotate the parent above the grandparent. */
+		WRITE_ONCE(grandparent->child[dir], tmp);
+		WRITE_ONCE(parent->child[!dir], grandparent);
+
+		if (tmp)
+			set_parent_color(tmp, grandparent, RB_BLACK);
+
+		rotate_set_parents(tree, grandparent, parent, RB_RED, aug);
+		break;
+	}
+
+	grew = rb_color(tree->root) == RB_RED;
+	recolor(tree->root, RB_BLACK);
+
+	return grew;
+}
+
+/*
+ * Restores the red-black properties below parent, one of whose subtrees lacks
+ * a black node on all of its paths after a black leaf has been unlinked.
+ */
+static void erase_fixup(struct rb_tree *tree, struct rb_node *parent,
+	const struct rb_augment *aug)
+{
+	struct rb_node *node = NULL, *sibling, *far, *near;
+	enum rb_dir dir;
+
+	for (;;) {
+		RB_STAT_INC(remove_loops);
+
+		/* The direction of the node, which may be NULL. */
+		dir = parent->child[RB_RIGHT] == node;
+		sibling = parent->child[!dir];
+
+		/* Make sure the sibling is black. */
+		if (rb_color(sibling) == RB_RED) {
+			near = sibling->child[dir];
+			WRITE_ONCE(parent->child[!dir], near);
+			WRITE_ONCE(sibling->child[dir], parent);
+			set_parent_color(near, parent, RB_BLACK);
+			rotate_set_parents(tree, parent, sibling, RB_RED, aug);
+			sibling = near;
+		}
+
+		far = sibling->child[!dir];
+
+		if (is_black(far)) {
+			near = sibling->child[dir];
+
+			/* Recolor the sibling and push the problem up the tree,
+			 * unless the parent is red and can absorb it.
+			 */
+			if (is_black(near)) {
+				set_parent_color(sibling, parent, RB_RED);
+
+				if (rb_color(parent) == RB_RED) {
+					recolor(parent, RB_BLACK);
+				} else {
+					node = parent;
+					parent = rb_parent(node);
+
+					if (parent)
+						continue;
+				}
+
+				break;
+			}
+
+			/* Rotate the red inner child of the sibling above it. */
+			far = near->child[!dir];
+			WRITE_ONCE(sibling->child[dir], far);
+			WRITE_ONCE(near->child[!dir], sibling);
+			WRITE_ONCE(parent->child[!dir], near);
+
+			if (far)
+				set_parent_color(far, sibling, RB_BLACK);
+
+			RB_STAT_INC(rotations);
+
+			if (aug)
+				aug->rotate(sibling, near);
+
+			far = sibling;
+			sibling = near;
+		}
+
+		/* The outer child of the sibling is red: rotate the sibling
+		 * above the parent, which ends the fixup.
+		 */
+		near = sibling->child[dir];
+		WRITE_ONCE(parent->child[!dir], near);
+		WRITE_ONCE(sibling->child[dir], parent);
+		set_parent_color(far, sibling, RB_BLACK);
+
+		if (near)
+			rb_set_parent(near, parent);
+
+		rotate_set_parents(tree, parent, sibling, RB_BLACK, aug);
+		break;
+	}
+}
+
+/*
+ * Unlinks the node from the tree. A node with two children is replaced by its
+ * in-order successor, which takes over the position and the color of the node.
+ * A node with a single child is black and its child red, so the child only has
+ * to take over the parent and the color of the node. The same goes for the
+ * right child of the successor. For augmented trees, the successor takes over
+ * the aggregate of the node, and the aggregates are propagated from where a
+ * node was unlinked up to the root before rebalancing.
+ */
+void _rb_erase(struct rb_tree *tree, struct rb_node *node,
+	const struct rb_augment *aug)
+{
+	struct rb_node *left = node->child[RB_LEFT];
+	struct rb_node *right = node->child[RB_RIGHT];
+	struct rb_node *parent, *succ, *child, *rebalance = NULL, *from;
+	uintptr_t pc = node->parent_color;
+
+	if (!left || !right) {
+		child = left ? left : right;
+		parent = rb_parent(node);
+		change_child(tree, parent, node, child);
+
+		if (child)
+			child->parent_color = pc;
+		else if ((pc & 1) == RB_BLACK)
+			rebalance = parent;
+
+		from = parent;
+	} else {
+		succ = right;
+
+		if (!succ->child[RB_LEFT]) {
+			/* The right child of the node is its successor. */
+			parent = succ;
+			child = succ->child[RB_RIGHT];
+
+			if (aug)
+				aug->copy(node, succ);
+		} else {
+			do {
+				parent = succ;
+				succ = succ->child[RB_LEFT];
+			} while (succ->child[RB_LEFT]);
+
+			child = succ->child[RB_RIGHT];
+			WRITE_ONCE(parent->child[RB_LEFT], child);
+			WRITE_ONCE(succ->child[RB_RIGHT], right);
+			rb_set_parent(right, succ);
+
+			if (aug) {
+				aug->copy(node, succ);
+				aug->propagate(parent, succ);
+			}
+		}
+
+		WRITE_ONCE(succ->child[RB_LEFT], left);
+		rb_set_parent(left, succ);
+		change_child(tree, rb_parent(node), node, succ);
+
+		if (child)
+			set_parent_color(child, parent, RB_BLACK);
+		else if (rb_color(succ) == RB_BLACK)
+			rebalance = parent;
+
+		succ->parent_color = pc;
+		from = succ;
+	}
+
+	if (aug && from)
+		aug->propagate(from, NULL);
+
+	if (rebalance)
+		erase_fixup(tree, rebalance, aug);
+}
@@ -2,6 +2,8 @@
 
 #include <string.h>
 
+#include <x86-64/asm.h>
+
 /*
  * Using assembly for memset/memmove makes some difference on real hardware,
  * but it makes an even bigger difference on bochs.
@@ -9,22 +11,58 @@
  */
 #define ASM 1
 
+/*
+ * The string routines below look at 8 bytes at a time where they can. Strings
+ * of unknown length are only ever read using aligned words: an aligned word
+ * never straddles a page boundary, so reading past the terminator cannot fault
+ * when the terminator itself is mapped. Buffers of known length may be read
+ * using unaligned words, as long as the reads stay within the buffer.
+ */
+typedef uint64_t __attribute__((__may_alias__)) word_t;
+typedef uint64_t __attribute__((__may_alias__, __aligned__(1))) uword_t;
+
+#define WORD_ONES  0x0101010101010101ULL
+#define WORD_HIGHS 0x8080808080808080ULL
+
+/* Non-zero if and only if any of the bytes in the word x is zero. */
+#define HAS_ZERO(x) (((x) - WORD_ONES) & ~(x) & WORD_HIGHS)
+
+#define IS_ALIGNED(p) (((uintptr_t)(p) & (sizeof(word_t) - 1)) == 0)
+
 int strlen(const char *s)
 {
-	int n;
+	const char *p = s;
+	const word_t *w;
 
-	for (n = 0; *s != '\0'; s++)
-		n++;
-	return n;
+	for (; !IS_ALIGNED(p); p++)
+		if (*p == '\0')
+			return p - s;
+
+	for (w = (const word_t *)p; !HAS_ZERO(*w); w++)
+		/* do nothing */;
+
+	for (p = (const char *)w; *p != '\0'; p++)
+		/* do nothing */;
+
+	return p - s;
 }
 
 int strnlen(const char *s, size_t size)
 {
-	int n;
+	const char *p = s;
+
+	for (; size > 0 && !IS_ALIGNED(p); p++, size--)
+		if (*p == '\0')
+			return p - s;
 
-	for (n = 0; size > 0 && *s != '\0'; s++, size--)
-		n++;
-	return n;
+	for (; size >= sizeof(word_t) && !HAS_ZERO(*(const word_t *)p);
+	     p += sizeof(word_t), size -= sizeof(word_t))
+		/* do nothing */;
+
+	for (; size > 0 && *p != '\0'; p++, size--)
+		/* do nothing */;
+
+	return p - s;
 }
 
 char *strcpy(char *dst, const char *src)
@@ -73,6 +111,18 @@ size_t strlcpy(char *dst, const char *src, size_t size)
 
 int strcmp(const char *p, const char *q)
 {
+	/* Compare words if both strings can be aligned at the same time. */
+	if (IS_ALIGNED((uintptr_t)p - (uintptr_t)q)) {
+		for (; !IS_ALIGNED(p); p++, q++)
+			if (!*p || *p != *q)
+				goto out;
+
+		while (*(const word_t *)p == *(const word_t *)q &&
+		       !HAS_ZERO(*(const word_t *)p))
+			p += sizeof(word_t), q += sizeof(word_t);
+	}
+
+out:
 	while (*p && *p == *q)
 		p++, q++;
 	return (int) ((unsigned char) *p - (unsigned char) *q);
@@ -80,6 +130,19 @@ int strcmp(const char *p, const char *q)
 
 int strncmp(const char *p, const char *q, size_t n)
 {
+	/* Compare words if both strings can be aligned at the same time. */
+	if (IS_ALIGNED((uintptr_t)p - (uintptr_t)q)) {
+		for (; n > 0 && !IS_ALIGNED(p); n--, p++, q++)
+			if (!*p || *p != *q)
+				goto out;
+
+		while (n >= sizeof(word_t) &&
+		       *(const word_t *)p == *(const word_t *)q &&
+		       !HAS_ZERO(*(const word_t *)p))
+			n -= sizeof(word_t), p += sizeof(word_t), q += sizeof(word_t);
+	}
+
+out:
 	while (n > 0 && *p && *p == *q)
 		n--, p++, q++;
 	if (n == 0)
@@ -94,7 +157,21 @@ int strncmp(const char *p, const char *q, size_t n)
  */
 char *strchr(const char *s, char c)
 {
-	for (; *s; s++)
+	uint64_t pattern = (uint8_t)c * WORD_ONES;
+	const word_t *w;
+
+	for (; !IS_ALIGNED(s); s++) {
+		if (!*s)
+			return 0;
+		if (*s == c)
+			return (char *) s;
+	}
+
+	/* Skip words that contain neither the terminator nor c. */
+	for (w = (const word_t *)s; !HAS_ZERO(*w) && !HAS_ZERO(*w ^ pattern); w++)
+		/* do nothing */;
+
+	for (s = (const char *)w; *s; s++)
 		if (*s == c)
 			return (char *) s;
 	return 0;
@@ -113,25 +190,171 @@ char *strfind(const char *s, char c)
 }
 
 #if ASM
+/*
+ * Chunks of at least this size are cleared with non-temporal stores, as they
+ * would only evict useful data from the caches otherwise.
+ */
+#define MEMSET_NT_MIN 4096
+
+/* CPU features used by the string routines, detected on first use. */
+#define STR_FEAT_ERMS (1 << 0) /* Enhanced REP MOVSB/STOSB. */
+
+static int str_features = -1;
+
+static int string_features(void)
+{
+	uint32_t max_leaf, ebx;
+
+	if (str_features >= 0)
+		return str_features;
+
+	str_features = 0;
+	cpuid(0, &max_leaf, NULL, NULL, NULL);
+
+	if (max_leaf >= 7) {
+		cpuid_count(7, 0, NULL, &ebx, NULL, NULL);
+
+		if (ebx & (1 << 9))
+			str_features |= STR_FEAT_ERMS;
+	}
+
+	return str_features;
+}
+
+/*
+ * Fills n quad words using non-temporal stores. MOVNTI stores straight from a
+ * general purpose register, so this works without touching the SSE registers
+ * (the kernel is built with -mno-sse and does not save them).
+ */
+static void memset_nt(uint64_t *p, uint64_t pattern, size_t n)
+{
+	for (; n >= 4; n -= 4, p += 4)
+		asm volatile(
+			"movnti %1, 0(%0)\n"
+			"movnti %1, 8(%0)\n"
+			"movnti %1, 16(%0)\n"
+			"movnti %1, 24(%0)\n"
+			:: "r" (p), "r" (pattern) : "memory");
+
+	for (; n > 0; --n, ++p)
+		asm volatile("movnti %1, (%0)\n"
+			:: "r" (p), "r" (pattern) : "memory");
+
+	/* Order the weakly-ordered stores before any later stores. */
+	asm volatile("sfence" ::: "memory");
+}
+
 void *memset(void *v, int c, size_t n)
 {
-	char *p;
+	uint64_t pattern = (uint8_t)c * 0x0101010101010101ULL;
+	char *p = v;
+	size_t head;
 
 	if (n == 0)
 		return v;
-	if ((uintptr_t)v%4 == 0 && n%4 == 0) {
-		c &= 0xFF;
-		c = (c<<24)|(c<<16)|(c<<8)|c;
-		asm volatile("cld; rep stosl\n"
-			:: "D" (v), "a" (c), "c" (n/4)
-			: "cc", "memory");
-	} else
+
+	/* Fast strings handle any alignment, but bypass them for large chunks
+	 * that would pollute the caches.
+	 */
+	if ((string_features() & STR_FEAT_ERMS) && n < MEMSET_NT_MIN) {
 		asm volatile("cld; rep stosb\n"
-			:: "D" (v), "a" (c), "c" (n)
-			: "cc", "memory");
+			: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
+		return v;
+	}
+
+	/* Align the destination to 8 bytes. */
+	head = -(uintptr_t)p & 7;
+
+	if (head > n)
+		head = n;
+
+	n -= head;
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (head) : "a" (c) : "cc", "memory");
+
+	if (n >= MEMSET_NT_MIN) {
+		memset_nt((uint64_t *)p, pattern, n / 8);
+		p += n & ~7;
+		n &= 7;
+	} else {
+		head = n / 8;
+		asm volatile("cld; rep stosq\n"
+			: "+D" (p), "+c" (head) : "a" (pattern) : "cc", "memory");
+		n &= 7;
+	}
+
+	/* Fill the remaining tail. */
+	asm volatile("cld; rep stosb\n"
+		: "+D" (p), "+c" (n) : "a" (c) : "cc", "memory");
+
 	return v;
 }
 
+/* Copies n bytes from s to d front to back. */
+static void copy_forward(char *d, const char *s, size_t n)
+{
+	size_t head;
+
+	if (string_features() & STR_FEAT_ERMS) {
+		asm volatile("cld; rep movsb\n"
+			: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
+		return;
+	}
+
+	/* Align the destination to 8 bytes, then move quad words. */
+	head = -(uintptr_t)d & 7;
+
+	if (head > n)
+		head = n;
+
+	n -= head;
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (head) :: "cc", "memory");
+
+	head = n / 8;
+	n &= 7;
+	asm volatile("cld; rep movsq\n"
+		: "+D" (d), "+S" (s), "+c" (head) :: "cc", "memory");
+	asm volatile("cld; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
+}
+
+/* Copies n bytes from s to d back to front, for overlapping moves with s < d.
+ * d and s point just past the end of the buffers.
+ */
+static void copy_backward(char *d, const char *s, size_t n)
+{
+	size_t tail, nquads;
+
+	/* Align the end of the destination to 8 bytes, then move quad words. */
+	tail = (uintptr_t)d & 7;
+
+	if (tail > n)
+		tail = n;
+
+	n -= tail;
+	nquads = n / 8;
+	n &= 7;
+
+	--d;
+	--s;
+	asm volatile("std; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (tail) :: "cc", "memory");
+
+	d -= 7;
+	s -= 7;
+	asm volatile("std; rep movsq\n"
+		: "+D" (d), "+S" (s), "+c" (nquads) :: "cc", "memory");
+
+	d += 7;
+	s += 7;
+	asm volatile("std; rep movsb\n"
+		: "+D" (d), "+S" (s), "+c" (n) :: "cc", "memory");
+
+	/* Some versions of GCC rely on DF being clear. */
+	asm volatile("cld" ::: "cc");
+}
+
 void *memmove(void *dst, const void *src, size_t n)
 {
 	const char *s;
@@ -139,25 +362,18 @@ void *memmove(void *dst, const void *src, size_t n)
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		if ((uintptr_t)s%4 == 0 && (uintptr_t)d%4 == 0 && n%4 == 0)
-			asm volatile("std; rep movsl\n"
-				:: "D" (d-4), "S" (s-4), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("std; rep movsb\n"
-				:: "D" (d-1), "S" (s-1), "c" (n) : "cc", "memory");
-		/* Some versions of GCC rely on DF being clear. */
-		asm volatile("cld" ::: "cc");
-	} else {
-		if ((uintptr_t)s%4 == 0 && (uintptr_t)d%4 == 0 && n%4 == 0)
-			asm volatile("cld; rep movsl\n"
-				:: "D" (d), "S" (s), "c" (n/4) : "cc", "memory");
-		else
-			asm volatile("cld; rep movsb\n"
-				:: "D" (d), "S" (s), "c" (n) : "cc", "memory");
-	}
+	if (s < d && s + n > d)
+		copy_backward(d + n, s + n, n);
+	else
+		copy_forward(d, s, n);
+
+	return dst;
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+	copy_forward(dst, src, n);
+
 	return dst;
 }
 
@@ -194,18 +410,23 @@ void *memmove(void *dst, const void *src, size_t n)
 
 	return dst;
 }
-#endif
 
 void *memcpy(void *dst, const void *src, size_t n)
 {
 	return memmove(dst, src, n);
 }
+#endif
 
 int memcmp(const void *v1, const void *v2, size_t n)
 {
 	const uint8_t *s1 = (const uint8_t *) v1;
 	const uint8_t *s2 = (const uint8_t *) v2;
 
+	/* Skip equal words, then find the differing byte. */
+	while (n >= sizeof(uword_t) &&
+	       *(const uword_t *)s1 == *(const uword_t *)s2)
+		n -= sizeof(uword_t), s1 += sizeof(uword_t), s2 += sizeof(uword_t);
+
 	while (n-- > 0) {
 		if (*s1 != *s2)
 			return (int) *s1 - (int) *s2;
@@ -217,7 +438,14 @@ int memcmp(const void *v1, const void *v2, size_t n)
 
 void *memfind(const void *s, int c, size_t n)
 {
+	uint64_t pattern = (uint8_t)c * WORD_ONES;
 	const void *ends = (const char *) s + n;
+
+	/* Skip words that do not contain c. */
+	for (; (const char *) ends - (const char *) s >= sizeof(uword_t) &&
+	     !HAS_ZERO(*(const uword_t *)s ^ pattern); s += sizeof(uword_t))
+		/* do nothing */;
+
 	for (; s < ends; s++)
 		if (*(const unsigned char *) s == (unsigned char) c)
 			break;
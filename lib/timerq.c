@@ -0,0 +1,79 @@
+#include <types.h>
+
+#include <timerq.h>
+
+static int deadline_cmp(const void *lhs, const void *rhs)
+{
+	uint64_t a = *(const uint64_t *)lhs;
+	uint64_t b = *(const uint64_t *)rhs;
+
+	return (a > b) - (a < b);
+}
+
+/* Arms the timer to expire at the deadline, moving it if it has been armed
+ * already.
+ *
+ * Returns 1 if the timer was or is now the first to expire, i.e. if the time
+ * the next timer expires at may have changed, and 0 otherwise.
+ */
+int timerq_arm(struct timerq *q, struct timer *timer, uint64_t deadline)
+{
+	int first = timerq_cancel(q, timer);
+	struct rb_node *last;
+
+	timer->deadline = deadline;
+	timer->armed = 1;
+	++q->count;
+	last = rb_last_cached(&q->tree);
+
+	/* Timers are mostly armed some fixed time from now, which makes them
+	 * expire last: append them right away rather than descending the tree.
+	 */
+	if (!last || container_of(last, struct timer, node)->deadline <=
+	    deadline)
+		rb_insert_after_cached(&q->tree, last, &timer->node);
+	else
+		_rb_insert_cached(&q->tree, &timer->node, deadline_cmp,
+			RB_KEY_OFFSET(struct timer, node, deadline));
+
+	return first || q->tree.leftmost == &timer->node;
+}
+
+/* Disarms the timer, which may not be armed at all.
+ *
+ * Returns 1 if the timer was the first to expire, and 0 otherwise.
+ */
+int timerq_cancel(struct timerq *q, struct timer *timer)
+{
+	int first;
+
+	if (!timer->armed)
+		return 0;
+
+	first = q->tree.leftmost == &timer->node;
+	rb_remove_cached(&q->tree, &timer->node);
+	timer->armed = 0;
+	--q->count;
+
+	return first;
+}
+
+/* Disarms and runs every timer with a deadline up to now, in order of their
+ * deadlines. The callbacks may arm and cancel timers, including their own,
+ * but a timer armed for a deadline up to now runs again in the same call.
+ *
+ * Returns the number of timers that have been run.
+ */
+size_t timerq_expire(struct timerq *q, uint64_t now)
+{
+	struct timer *timer;
+	size_t nexpired = 0;
+
+	while ((timer = timerq_first(q)) && timer->deadline <= now) {
+		timerq_cancel(q, timer);
+		timer->fn(timer);
+		++nexpired;
+	}
+
+	return nexpired;
+}
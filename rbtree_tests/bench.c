@@ -0,0 +1,402 @@
+/*
+ * Benchmarks for the red-black tree implementations, and for the B+-tree in
+ * ../lib/btree.c as an alternative.
+ *
+ * Every workload runs in its own child process, such that an implementation
+ * that crashes only takes down the workload it crashed in. For every workload
+ * the time, the number of rotations and the number of cache misses (if the
+ * kernel lets us use perf_event_open()) per operation are reported.
+ *
+ * Usage: rbtree_bench [max nodes]
+ */
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/perf_event.h>
+
+#if USE_BTREE
+#include <btree.h>
+#define VARIANT "btree"
+#define rotations() 0UL
+#elif USE_LIB
+#include <rbtree.h>
+#if USE_LIB_LINUX
+#define VARIANT "liblnx"
+#else
+#define VARIANT "lib"
+#endif
+#define rotations() rb_stats.rotations
+#define node_set_parent(node, p) rb_set_parent(node, p)
+#elif USE_AOS
+#include "rbtree_aos.h"
+#define VARIANT "aos"
+#define rotations() rb_stat_rotations
+#define node_set_parent(node, p) ((node)->parent = (p))
+#else
+#include "rbtree.h"
+#define VARIANT "linux"
+#define rotations() rb_stat_rotations
+#define node_set_parent(node, p) ((node)->parent = (p))
+#endif
+
+#ifndef container_of
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+
+#define SEED 1337
+
+#if !USE_LIB && !USE_BTREE
+/* Defined by rbtree.c when built with -DRB_STATS. */
+extern unsigned long rb_stat_rotations;
+#endif
+
+struct cont {
+#if !USE_BTREE
+    struct rb_node node;
+#endif
+    uint64_t key;
+};
+
+static uint64_t rand_state;
+
+static uint64_t xorshift64(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+static void shuffle(struct cont **conts, size_t n) {
+    for (size_t i = n; i > 1; i--) {
+        size_t j = xorshift64() % i;
+        struct cont *tmp = conts[i - 1];
+        conts[i - 1] = conts[j];
+        conts[j] = tmp;
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Returns a file descriptor counting cache misses, or -1 if unavailable. */
+static int perf_open(void) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof attr;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Per-workload measurement. */
+struct sample {
+    int fd;
+    uint64_t start;
+    unsigned long rotations;
+};
+
+static void sample_start(struct sample *s) {
+    s->fd = perf_open();
+    if (s->fd >= 0) {
+        ioctl(s->fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(s->fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    s->rotations = rotations();
+    s->start = now_ns();
+}
+
+static void sample_stop(struct sample *s, const char *name, size_t n,
+                        size_t ops) {
+    uint64_t ns = now_ns() - s->start;
+    unsigned long rotations = rotations() - s->rotations;
+    uint64_t misses;
+    char buf[32] = "n/a";
+
+    if (s->fd >= 0) {
+        ioctl(s->fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(s->fd, &misses, sizeof misses) == sizeof misses)
+            snprintf(buf, sizeof buf, "%.2f", (double)misses / ops);
+        close(s->fd);
+    }
+
+    printf("%-6s %-8s %9zu %10.1f %10.3f %10s\n", VARIANT, name, n,
+           (double)ns / ops, (double)rotations / ops, buf);
+    fflush(stdout);
+}
+
+#if USE_BTREE
+/* The B+-tree maps the keys to their containers. */
+typedef struct btree index_t;
+
+static void index_init(index_t *tree) {
+    btree_init(tree);
+}
+
+static struct cont *find(index_t *tree, uint64_t key) {
+    return btree_find(tree, key);
+}
+
+static void insert(index_t *tree, struct cont *new) {
+    btree_insert(tree, new->key, new);
+}
+
+static void delete(index_t *tree, struct cont *cont) {
+    btree_remove(tree, cont->key);
+}
+#else
+typedef struct rb_tree index_t;
+
+static void index_init(index_t *tree) {
+    rb_init(tree);
+}
+
+static struct cont *find(index_t *tree, uint64_t key) {
+    struct rb_node *node = tree->root;
+
+    while (node) {
+        uint64_t other = container_of(node, struct cont, node)->key;
+
+        if (key == other)
+            return container_of(node, struct cont, node);
+
+        node = node->child[key > other];
+    }
+
+    return NULL;
+}
+
+static void insert(index_t *tree, struct cont *new) {
+    struct rb_node *parent = NULL;
+    struct rb_node **link = &tree->root;
+
+    while (*link) {
+        parent = *link;
+        link = &parent->child[new->key > container_of(parent, struct cont,
+                                                      node)->key];
+    }
+
+    rb_node_init(&new->node);
+    node_set_parent(&new->node, parent);
+    *link = &new->node;
+    rb_balance(tree, &new->node);
+}
+
+static void delete(index_t *tree, struct cont *cont) {
+    rb_remove(tree, &cont->node);
+}
+#endif
+
+/* Gives every node a unique random key, in random order. */
+static struct cont **alloc_conts(size_t n) {
+    struct cont *conts = calloc(n, sizeof *conts);
+    struct cont **ptrs = calloc(n, sizeof *ptrs);
+
+    if (!conts || !ptrs) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        conts[i].key = (xorshift64() & ~0xffffffull) | i;
+        ptrs[i] = &conts[i];
+    }
+
+    shuffle(ptrs, n);
+    return ptrs;
+}
+
+static void bench_insert(size_t n) {
+    index_t tree;
+    struct cont **conts = alloc_conts(n);
+    struct sample s;
+
+    index_init(&tree);
+    sample_start(&s);
+    for (size_t i = 0; i < n; i++)
+        insert(&tree, conts[i]);
+    sample_stop(&s, "insert", n, n);
+}
+
+static void bench_lookup(size_t n) {
+    index_t tree;
+    struct cont **conts = alloc_conts(n);
+    struct sample s;
+    size_t found = 0;
+
+    index_init(&tree);
+    for (size_t i = 0; i < n; i++)
+        insert(&tree, conts[i]);
+    shuffle(conts, n);
+
+    sample_start(&s);
+    for (size_t i = 0; i < n; i++)
+        found += find(&tree, conts[i]->key) == conts[i];
+    sample_stop(&s, "lookup", n, n);
+
+    if (found != n)
+        printf("lookup: found %zu out of %zu nodes\n", found, n);
+}
+
+static void bench_scan(size_t n) {
+    index_t tree;
+    struct cont **conts = alloc_conts(n);
+#if USE_BTREE
+    struct btree_iter iter;
+    void *val;
+#else
+    struct rb_node *node;
+#endif
+    struct sample s;
+    uint64_t key, last = 0;
+    size_t count = 0;
+
+    index_init(&tree);
+    for (size_t i = 0; i < n; i++)
+        insert(&tree, conts[i]);
+
+    sample_start(&s);
+#if USE_BTREE
+    btree_iter_seek(&iter, &tree, 0);
+    while (btree_iter_next(&iter, &key, &val)) {
+#else
+    for (node = rb_first(&tree); node; node = rb_next(node)) {
+        key = container_of(node, struct cont, node)->key;
+#endif
+        if (count++ && key <= last)
+            break;
+        last = key;
+    }
+    sample_stop(&s, "scan", n, n);
+
+    if (count != n)
+        printf("scan: visited %zu out of %zu nodes\n", count, n);
+}
+
+static void bench_delete(size_t n) {
+    index_t tree;
+    struct cont **conts = alloc_conts(n);
+    struct sample s;
+
+    index_init(&tree);
+    for (size_t i = 0; i < n; i++)
+        insert(&tree, conts[i]);
+    shuffle(conts, n);
+
+    sample_start(&s);
+    for (size_t i = 0; i < n; i++)
+        delete(&tree, conts[i]);
+    sample_stop(&s, "delete", n, n);
+
+    if (tree.root)
+        printf("delete: tree is not empty\n");
+}
+
+/*
+ * Starts out with n nodes and performs n operations, half of which are
+ * lookups, a quarter are inserts and a quarter are removals.
+ */
+static void bench_mixed(size_t n) {
+    index_t tree;
+    struct cont **conts = alloc_conts(2 * n);
+    struct sample s;
+    size_t live = n, found = 0;
+
+    index_init(&tree);
+    for (size_t i = 0; i < n; i++)
+        insert(&tree, conts[i]);
+
+    sample_start(&s);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t r = xorshift64();
+        size_t j = (r >> 2) % live;
+        struct cont *tmp;
+
+        switch (r & 3) {
+        case 0:
+        case 1:
+            found += find(&tree, conts[j]->key) != NULL;
+            break;
+        case 2:
+            if (live < 2 * n)
+                insert(&tree, conts[live++]);
+            break;
+        case 3:
+            delete(&tree, conts[j]);
+            tmp = conts[j];
+            conts[j] = conts[--live];
+            conts[live] = tmp;
+            break;
+        }
+    }
+    sample_stop(&s, "mixed", n, n);
+}
+
+static void (*workloads[])(size_t) = {
+    bench_insert,
+    bench_lookup,
+    bench_scan,
+    bench_delete,
+    bench_mixed,
+};
+
+static const char *workload_names[] = {
+    "insert",
+    "lookup",
+    "scan",
+    "delete",
+    "mixed",
+};
+
+int main(int argc, char **argv) {
+    size_t max = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000;
+
+    printf("%-6s %-8s %9s %10s %10s %10s\n", "impl", "workload", "nodes",
+           "ns/op", "rot/op", "miss/op");
+
+    for (size_t n = 1000; n <= max; n *= 10) {
+        for (size_t i = 0; i < sizeof workloads / sizeof *workloads; i++) {
+            pid_t pid;
+            int status;
+
+            fflush(stdout);
+            pid = fork();
+
+            if (pid < 0) {
+                perror("fork");
+                return EXIT_FAILURE;
+            }
+
+            if (pid == 0) {
+                rand_state = SEED + n;
+                workloads[i](n);
+                fflush(stdout);
+                _exit(EXIT_SUCCESS);
+            }
+
+            waitpid(pid, &status, 0);
+            if (WIFSIGNALED(status))
+                printf("%-6s %-8s %9zu crashed (signal %d)\n", VARIANT,
+                       workload_names[i], n, WTERMSIG(status));
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,3 +1,11 @@
+#ifdef RB_STATS
+/* Number of rotations performed, see bench.c. */
+unsigned long rb_stat_rotations;
+#define RB_STAT_ROTATION() (rb_stat_rotations++)
+#else
+#define RB_STAT_ROTATION()
+#endif
+
 #ifdef USE_AOS
 #include "rbtree_aos.c"
 #else
@@ -8,6 +8,8 @@ static void rotate_node(struct rb_tree *tree, struct rb_node *node,
     struct rb_node *parent = node->parent;
     struct rb_node *child = node->child[!dir];
 
+    RB_STAT_ROTATION();
+
     if ((node->child[!dir] = child->child[dir])) {
         child->child[dir]->parent = node;
     }
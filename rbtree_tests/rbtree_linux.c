@@ -53,6 +53,7 @@ rb_rotate_set_parents(struct rb_node *old, struct rb_node *new,
                       struct rb_tree *root, int color)
 {
     struct rb_node *parent = old->parent;
+    RB_STAT_ROTATION();
     new->parent = old->parent;
     new->color = old->color;
     old->parent = new;
@@ -137,6 +138,7 @@ int rb_balance(struct rb_tree *root, struct rb_node *node)
                  * This still leaves us in violation of 4), the
                  * continuation into Case 3 will fix that.
                  */
+                RB_STAT_ROTATION();
                 tmp = node->child[RB_LEFT];
                 parent->child[RB_RIGHT] = tmp;
                 node->child[RB_LEFT] = parent;
@@ -186,6 +188,7 @@ int rb_balance(struct rb_tree *root, struct rb_node *node)
             tmp = parent->child[RB_LEFT];
             if (node == tmp) {
                 /* Case 2 - right rotate at parent */
+                RB_STAT_ROTATION();
                 tmp = node->child[RB_RIGHT];
                 parent->child[RB_LEFT] = tmp;
                 node->child[RB_RIGHT] = parent;
@@ -410,6 +413,7 @@ void rb_erase_color(struct rb_node *parent, struct rb_tree *root)
                  *         \
                  *          Sr
                  */
+                RB_STAT_ROTATION();
                 tmp1 = tmp2->child[RB_RIGHT];
                 sibling->child[RB_LEFT] = tmp1;
                 tmp2->child[RB_RIGHT] = sibling;
@@ -474,6 +478,7 @@ void rb_erase_color(struct rb_node *parent, struct rb_tree *root)
                     break;
                 }
                 /* Case 3 - left rotate at sibling */
+                RB_STAT_ROTATION();
                 tmp1 = tmp2->child[RB_LEFT];
                 sibling->child[RB_RIGHT] =  tmp1;
                 tmp2->child[RB_LEFT] =  sibling;
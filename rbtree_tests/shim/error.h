@@ -0,0 +1,7 @@
+#pragma once
+
+/*
+ * The host has an <error.h> of its own, which would otherwise shadow the one
+ * in ../include.
+ */
+#include "../../include/error.h"
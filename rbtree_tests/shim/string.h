@@ -0,0 +1,4 @@
+#pragma once
+
+/* Use the host string functions rather than the ones in ../lib/string.c. */
+#include_next <string.h>
@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ * Stand-in for include/types.h, such that ../lib/rbtree.c can be built and
+ * benchmarked against the host libc.
+ */
+#include <sys/cdefs.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define length_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef __always_inline
+#define __always_inline         inline __attribute__((always_inline))
+#endif
+
+#define READ_ONCE(x)            (*(const volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, val)      (*(volatile typeof(x) *)&(x) = (val))
@@ -0,0 +1,11 @@
+#pragma once
+
+/*
+ * Stand-in for include/x86-64/asm.h, which declares a pause() of its own that
+ * clashes with the one in the host <unistd.h>. The trees only need the memory
+ * barriers.
+ */
+#define barrier() asm volatile("" ::: "memory")
+#define smp_rmb() barrier()
+#define smp_wmb() barrier()
+#define smp_mb()  asm volatile("mfence" ::: "memory")
@@ -0,0 +1,5 @@
+#pragma once
+
+/* The fixed-width types come from the host <stdint.h>, see ../types.h. */
+#include <stdint.h>
+#include <stddef.h>
@@ -0,0 +1,116 @@
+/*
+ * Benchmark for the timer queue in ../lib/timerq.c, with n timers outstanding
+ * at all times.
+ *
+ * The "rearm" workload pushes back the deadline of random timers, as timeouts
+ * that keep getting postponed do. The "churn" workload models a tickless
+ * kernel: the clock jumps to the first deadline, the timers that are due run
+ * and arm themselves again, and in between, random timers are cancelled and
+ * armed anew before they get to expire. For every workload the time per
+ * operation is reported.
+ *
+ * Usage: rbtree_bench_timers [timers]
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <timerq.h>
+
+#define SEED 1337
+
+/* The timers run at most this far in the future. */
+#define HORIZON 1000000
+
+static uint64_t rand_state = SEED;
+static uint64_t now;
+static size_t nfired;
+
+static uint64_t xorshift64(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct timerq queue;
+
+static void fire(struct timer *timer) {
+    ++nfired;
+    timerq_arm(&queue, timer, now + 1 + xorshift64() % HORIZON);
+}
+
+static void report(const char *name, size_t n, size_t ops, uint64_t ns) {
+    printf("%-8s %9zu %10zu %10.1f\n", name, n, ops, (double)ns / ops);
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 0) : 100000;
+    struct timer *timers = malloc(n * sizeof *timers);
+    size_t ops = 10 * n, i, nops;
+    uint64_t start;
+
+    if (!timers) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s %9s %10s %10s\n", "workload", "timers", "ops", "ns/op");
+
+    timerq_init(&queue);
+    start = now_ns();
+    for (i = 0; i < n; i++) {
+        timer_setup(&timers[i], fire);
+        timerq_arm(&queue, &timers[i], 1 + xorshift64() % HORIZON);
+    }
+    report("arm", n, n, now_ns() - start);
+
+    start = now_ns();
+    for (i = 0; i < ops; i++) {
+        struct timer *timer = &timers[xorshift64() % n];
+
+        timerq_arm(&queue, timer, timer->deadline + xorshift64() % HORIZON);
+    }
+    report("rearm", n, ops, now_ns() - start);
+
+    start = now_ns();
+    for (nops = 0; nops < ops;) {
+        struct timer *timer = &timers[xorshift64() % n];
+
+        /* Cancel a timer and arm it again, or run to the next deadline. */
+        if (xorshift64() & 1) {
+            timerq_cancel(&queue, timer);
+            timerq_arm(&queue, timer, now + 1 + xorshift64() % HORIZON);
+            nops += 2;
+        } else {
+            now = timerq_first(&queue)->deadline;
+            nops += 2 * timerq_expire(&queue, now);
+        }
+    }
+    report("churn", n, nops, now_ns() - start);
+
+    if (queue.count != n)
+        printf("churn: %zu timers armed instead of %zu\n", queue.count, n);
+
+    start = now_ns();
+    for (i = 0; i < n; i++)
+        timerq_cancel(&queue, &timers[i]);
+    report("cancel", n, n, now_ns() - start);
+
+    if (timerq_first(&queue))
+        printf("cancel: queue is not empty\n");
+
+    printf("%zu timers fired\n", nfired);
+    free(timers);
+
+    return EXIT_SUCCESS;
+}